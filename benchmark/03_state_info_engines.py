@@ -0,0 +1,68 @@
+import time
+import sys
+import os
+import timeit
+from loguru import logger
+import numpy as np
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.realpath(__file__)), "..", "python"))
+import lattice_symmetries as ls
+
+from systems import (
+    get_processor_name,
+    make_basis,
+    square_lattice_symmetries,
+    triangular_lattice_symmetries,
+)
+
+
+def random_spins(number_spins, hamming_weight, count, seed=42):
+    rng = np.random.default_rng(seed)
+    up = np.argsort(rng.random((count, number_spins)), axis=1)[:, :hamming_weight]
+    return np.bitwise_or.reduce(np.uint64(1) << up.astype(np.uint64), axis=1)
+
+
+def benchmark_lattices(lattice, engine, count=200000):
+    assert lattice in {"square", "triangular"}
+    assert engine in {"benes", "sublattice"}
+    make_symmetries = (
+        square_lattice_symmetries if lattice == "square" else triangular_lattice_symmetries
+    )
+    for L_y, L_x in [(4, 4), (5, 5), (4, 6), (6, 6), (6, 7), (7, 7), (8, 8)]:
+        logger.info("Benchmarking {} engine for {} {}x{}...", engine, lattice, L_y, L_x)
+        number_spins = L_x * L_y
+        basis = make_basis(
+            make_symmetries(L_x, L_y),
+            number_spins=number_spins,
+            hamming_weight=number_spins // 2,
+            build=False,
+        )
+        tick = time.time()
+        basis.set_state_info_engine(engine)
+        setup = time.time() - tick
+        spins = random_spins(number_spins, number_spins // 2, count)
+        ts = timeit.repeat(lambda: basis.batched_state_info(spins), repeat=3, number=1)
+        logger.info("  -> {:.3f} ± {:.3f} (setup: {:.3f})", np.mean(ts), np.std(ts), setup)
+        yield ("${} \\times {}$".format(L_y, L_x), (np.mean(ts), np.std(ts)))
+
+
+def main():
+    for lattice in ["square", "triangular"]:
+        output_file = "03_state_info_engines_{}.dat".format(lattice)
+        with open(output_file, "w") as output:
+            output.write("# Date: {}\n".format(time.asctime()))
+            cpu = get_processor_name()
+            if cpu is not None:
+                output.write("#  CPU: {}\n".format(cpu))
+            output.write("system\tbenes\tsublattice\trelative\terror\n")
+        rs = dict(benchmark_lattices(lattice, "benes"))
+        for (key, (mean, std)) in benchmark_lattices(lattice, "sublattice"):
+            with open(output_file, "a") as output:
+                output.write(
+                    "{}\t{}\t{}\t{}\t{}\n".format(key, rs[key][0], mean, rs[key][0] / mean, std)
+                )
+                output.flush()
+
+
+if __name__ == "__main__":
+    main()
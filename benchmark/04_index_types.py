@@ -0,0 +1,56 @@
+import time
+import sys
+import os
+import timeit
+from loguru import logger
+import numpy as np
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.realpath(__file__)), "..", "python"))
+import lattice_symmetries as ls
+
+from systems import get_processor_name, make_basis, square_lattice_symmetries
+
+
+def benchmark_index(index_type, count=1000000):
+    assert index_type in {"default", "hash", "btree"}
+    for L_y, L_x in [(4, 4), (4, 5), (5, 5), (4, 6), (5, 6), (6, 6)]:
+        logger.info("Benchmarking {} index for square {}x{}...", index_type, L_y, L_x)
+        number_spins = L_x * L_y
+        basis = make_basis(
+            square_lattice_symmetries(L_x, L_y),
+            number_spins=number_spins,
+            hamming_weight=number_spins // 2,
+            build=True,
+        )
+        tick = time.time()
+        basis.set_index_type(index_type)
+        setup = time.time() - tick
+        rng = np.random.default_rng(42)
+        spins = rng.choice(basis.states, size=count)
+        ts = timeit.repeat(lambda: basis.batched_index(spins), repeat=3, number=1)
+        logger.info("  -> {:.3f} ± {:.3f} (setup: {:.3f})", np.mean(ts), np.std(ts), setup)
+        yield ("${} \\times {}$".format(L_y, L_x), (np.mean(ts), np.std(ts)))
+
+
+def main():
+    output_file = "04_index_types.dat"
+    with open(output_file, "w") as output:
+        output.write("# Date: {}\n".format(time.asctime()))
+        cpu = get_processor_name()
+        if cpu is not None:
+            output.write("#  CPU: {}\n".format(cpu))
+        output.write("system\tdefault\thash\tbtree\terror_hash\terror_btree\n")
+    rs = dict(benchmark_index("default"))
+    hs = dict(benchmark_index("hash"))
+    for (key, (mean, std)) in benchmark_index("btree"):
+        with open(output_file, "a") as output:
+            output.write(
+                "{}\t{}\t{}\t{}\t{}\t{}\n".format(
+                    key, rs[key][0], hs[key][0], mean, hs[key][1], std
+                )
+            )
+            output.flush()
+
+
+if __name__ == "__main__":
+    main()
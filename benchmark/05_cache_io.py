@@ -0,0 +1,94 @@
+import time
+import sys
+import os
+from ctypes import c_int
+from loguru import logger
+import numpy as np
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.realpath(__file__)), "..", "python"))
+import lattice_symmetries as ls
+
+from systems import get_processor_name, make_basis, square_lattice_symmetries
+
+LS_MAP_COPY = 3
+
+
+def evict_from_page_cache(filename):
+    # Clean pages can be dropped without root privileges, so every load reads from the disk
+    fd = os.open(filename, os.O_RDONLY)
+    try:
+        os.fsync(fd)
+        os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)
+    finally:
+        os.close(fd)
+
+
+def save(basis, filename):
+    tick = time.time()
+    ls._check_error(ls._lib.ls_save_cache(basis._payload, filename.encode("utf-8")))
+    fd = os.open(filename, os.O_RDONLY)
+    os.fsync(fd)
+    os.close(fd)
+    return time.time() - tick
+
+
+def load(new_basis, filename):
+    basis = new_basis()
+    evict_from_page_cache(filename)
+    tick = time.time()
+    ls._check_error(
+        ls._lib.ls_load_cache_mapped(basis._payload, filename.encode("utf-8"), c_int(LS_MAP_COPY))
+    )
+    return time.time() - tick
+
+
+def benchmark_io(direct, filename, repeat=3):
+    if direct:
+        ls.enable_direct_io()
+    else:
+        ls.disable_direct_io()
+    for L_y, L_x in [(4, 6), (5, 6), (6, 6)]:
+        logger.info("Benchmarking {} I/O for square {}x{}...", "direct" if direct else "buffered", L_y, L_x)
+        number_spins = L_x * L_y
+        new_basis = lambda: make_basis(
+            square_lattice_symmetries(L_x, L_y),
+            number_spins=number_spins,
+            hamming_weight=number_spins // 2,
+            build=False,
+        )
+        basis = new_basis()
+        basis.build()
+        writes = [save(basis, filename) for _ in range(repeat)]
+        size = os.path.getsize(filename) / 1024 ** 3
+        reads = [load(new_basis, filename) for _ in range(repeat)]
+        os.remove(filename)
+        write_bandwidth = size / np.mean(writes)
+        read_bandwidth = size / np.mean(reads)
+        logger.info("  -> write: {:.3f} GiB/s, read: {:.3f} GiB/s", write_bandwidth, read_bandwidth)
+        yield ("${} \\times {}$".format(L_y, L_x), (size, write_bandwidth, read_bandwidth))
+
+
+def main():
+    # Put the file on the file system of interest, e.g. a parallel file system or an NVMe drive
+    filename = sys.argv[1] if len(sys.argv) > 1 else "05_cache_io.cache"
+    output_file = "05_cache_io.dat"
+    with open(output_file, "w") as output:
+        output.write("# Date: {}\n".format(time.asctime()))
+        cpu = get_processor_name()
+        if cpu is not None:
+            output.write("#  CPU: {}\n".format(cpu))
+        output.write("# Threads: {}\n".format(os.environ.get("OMP_NUM_THREADS", "default")))
+        output.write("system\tsize\twrite\tread\twrite_direct\tread_direct\n")
+    buffered = dict(benchmark_io(False, filename))
+    for (key, (size, write, read)) in benchmark_io(True, filename):
+        with open(output_file, "a") as output:
+            output.write(
+                "{}\t{}\t{}\t{}\t{}\t{}\n".format(
+                    key, size, buffered[key][1], buffered[key][2], write, read
+                )
+            )
+            output.flush()
+
+
+if __name__ == "__main__":
+    main()
@@ -54,6 +54,30 @@ def square_lattice_symmetries(L_x, L_y, sectors=dict()):
     return symmetries
 
 
+def triangular_lattice_symmetries(L_x, L_y, sectors=dict()):
+    # Sites (x, y) are at positions x * a_1 + y * a_2 where a_1 = (1, 0) and a_2 = (1/2, √3/2)
+    assert L_x > 0 and L_y > 0
+    sites = np.arange(L_y * L_x, dtype=np.int32)
+    x = sites % L_x
+    y = sites // L_x
+
+    symmetries = []
+    if L_x > 1:
+        T_x = (x + 1) % L_x + L_x * y  # translation along a_1
+        symmetries.append(("T_x", T_x, sectors.get("T_x", 0)))
+    if L_y > 1:
+        T_y = x + L_x * ((y + 1) % L_y)  # translation along a_2
+        symmetries.append(("T_y", T_y, sectors.get("T_y", 0)))
+    if L_x == L_y and L_x > 1:  # Point group symmetries are valid only for rhombic samples
+        R = (-y) % L_x + L_x * ((x + y) % L_y)  # rotation by 60°: a_1 -> a_2, a_2 -> a_2 - a_1
+        symmetries.append(("R", R, sectors.get("R", 0)))
+        P = y + L_x * x  # reflection which swaps a_1 and a_2
+        symmetries.append(("P", P, sectors.get("P", 0)))
+    if L_x * L_y % 2 == 0:
+        symmetries.append(("I", None, sectors.get("I", 0)))
+    return symmetries
+
+
 def square_lattice_edges(L_x, L_y):
     assert L_x > 0 and L_y > 0
     # Example 4x6 square to illustrate the ordering of sites:
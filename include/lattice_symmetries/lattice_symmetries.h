@@ -141,6 +141,8 @@ typedef enum ls_error_code {
     LS_OPERATOR_IS_COMPLEX,     ///< Trying to apply complex operator to real vector
     LS_DIMENSION_MISMATCH,      ///< Operator dimension does not match vector length
     LS_SYSTEM_ERROR,            ///< Unknown error
+    LS_CANCELLED,               ///< Operation was cancelled by the progress callback
+    LS_CACHE_MISMATCH,          ///< File contains representatives of a different basis
 } ls_error_code;
 
 char const* ls_error_to_string(ls_error_code code);
@@ -182,11 +184,25 @@ bool ls_has_avx2();
 bool ls_has_avx();
 bool ls_has_sse4();
 
+typedef enum {
+    LS_ARCH_SSE2, ///< Baseline x86-64 (Halide kernels use their generic version)
+    LS_ARCH_SSE4, ///< SSE4.1 and SSE4.2
+    LS_ARCH_AVX,
+    LS_ARCH_AVX2, ///< AVX2, BMI2 and FMA
+} ls_arch;
+
+typedef struct ls_kernel_info {
+    char const* name;    ///< Name of the kernel
+    char const* variant; ///< Instruction set of the implementation which is used
+} ls_kernel_info;
+
+ls_arch       ls_get_kernel_arch(void);
+ls_error_code ls_set_kernel_arch(ls_arch arch);
+uint64_t      ls_get_kernel_info(ls_kernel_info info[], uint64_t size);
+
+// Kernels are resolved once when the library is loaded (see src/dispatch.hpp)
 #define LATTICE_SYMMETRIES_DISPATCH(func, ...)                                                     \
-    if (ls_has_avx2()) { return ::lattice_symmetries::avx2::func(__VA_ARGS__); }                   \
-    if (ls_has_avx()) { return ::lattice_symmetries::avx::func(__VA_ARGS__); }                     \
-    if (ls_has_sse4()) { return ::lattice_symmetries::sse4::func(__VA_ARGS__); }                   \
-    return ::lattice_symmetries::sse2::func(__VA_ARGS__)
+    return ::lattice_symmetries::dispatch_table.load(std::memory_order_relaxed)->func(__VA_ARGS__)
 
 // This is an internal function!
 void ls_private_log_debug(char const* file, unsigned line, char const* function, char const* fmt,
@@ -246,8 +262,51 @@ int            ls_get_hamming_weight(ls_spin_basis const* basis);
 int            ls_get_spin_inversion(ls_spin_basis const* basis);
 bool           ls_has_symmetries(ls_spin_basis const* basis);
 
+typedef enum {
+    LS_STATE_INFO_BENES,      ///< Apply batched Benes networks for every symmetry (default)
+    LS_STATE_INFO_SUBLATTICE, ///< Use lookup tables to only apply a few candidate symmetries
+} ls_state_info_engine;
+
+ls_error_code ls_set_state_info_engine(ls_spin_basis* basis, ls_state_info_engine engine);
+
+typedef enum {
+    LS_INDEX_DEFAULT,    ///< Combinatorial ranking without symmetries, prefix table with symmetries
+    LS_INDEX_LIN,        ///< Two-level table over high and low halves of spin configurations
+    LS_INDEX_COMPRESSED, ///< Prefix table over a compressed list of representatives
+    LS_INDEX_HASH,       ///< Minimal perfect hash over the list of representatives
+    LS_INDEX_BTREE,      ///< Prefix table with a static B+tree inside every large bucket
+} ls_index_type;
+
+ls_error_code ls_set_index_type(ls_spin_basis* basis, ls_index_type type);
+
+typedef enum {
+    LS_NUMA_FIRST_TOUCH, ///< Pages end up on the node of whichever thread touches them first
+    LS_NUMA_INTERLEAVE,  ///< Pages are distributed over NUMA nodes round-robin
+    LS_NUMA_PARTITION,   ///< Every OpenMP thread gets a contiguous part of the arrays
+} ls_numa_policy;
+
+ls_error_code  ls_set_numa_policy(ls_spin_basis* basis, ls_numa_policy policy,
+                                  bool replicate_buckets);
+ls_numa_policy ls_get_numa_policy(ls_spin_basis const* basis);
+
+typedef struct ls_progress {
+    uint64_t processed; ///< Number of states processed so far
+    uint64_t total;     ///< Total number of states to process
+    double   elapsed;   ///< Time since the start of the operation in seconds
+    double   eta;       ///< Estimated remaining time in seconds, negative if unknown
+} ls_progress;
+
+/// Returning false cancels the operation
+typedef bool (*ls_progress_callback)(ls_progress const* progress, void* cxt);
+
 ls_error_code ls_get_number_states(ls_spin_basis const* basis, uint64_t* out);
+ls_error_code ls_get_fast_reject_statistics(ls_spin_basis const* basis, uint64_t* checked,
+                                            uint64_t* rejected);
 ls_error_code ls_build(ls_spin_basis* basis);
+ls_error_code ls_build_checkpointed(ls_spin_basis* basis, char const* directory);
+ls_error_code ls_build_with_progress(ls_spin_basis* basis, ls_progress_callback callback,
+                                     void* cxt);
+ls_error_code ls_build_sectors(unsigned count, ls_spin_basis* const bases[]);
 ls_error_code ls_build_unsafe(ls_spin_basis* basis, uint64_t size,
                               uint64_t const representatives[]);
 void          ls_get_state_info(ls_spin_basis const* basis, ls_bits512 const* bits,
@@ -259,9 +318,24 @@ void ls_batched_get_state_info(ls_spin_basis const* basis, uint64_t count, ls_bi
 ls_error_code ls_is_representative(ls_spin_basis const* basis, uint64_t count,
                                    uint64_t const bits[], uint8_t out[]);
 ls_error_code ls_get_index(ls_spin_basis const* basis, uint64_t bits, uint64_t* index);
+ls_error_code ls_get_representative(ls_spin_basis const* basis, uint64_t index, uint64_t* bits);
+ls_error_code ls_get_index_512(ls_spin_basis const* basis, ls_bits512 const* bits, uint64_t* index);
+ls_error_code ls_get_representative_512(ls_spin_basis const* basis, uint64_t index,
+                                        ls_bits512* bits);
 ls_error_code ls_batched_get_index(ls_spin_basis const* basis, uint64_t count,
                                    ls_bits64 const* spins, uint64_t spins_stride, uint64_t* out,
                                    uint64_t out_stride);
+ls_error_code ls_batched_get_index_with_sentinel(ls_spin_basis const* basis, uint64_t count,
+                                                 ls_bits64 const* spins, uint64_t spins_stride,
+                                                 uint64_t* out, uint64_t out_stride,
+                                                 uint64_t sentinel);
+ls_error_code ls_batched_get_index_sorted(ls_spin_basis const* basis, uint64_t count,
+                                          ls_bits64 const* spins, uint64_t spins_stride,
+                                          uint64_t* out, uint64_t out_stride);
+ls_error_code ls_batched_get_index_sorted_with_sentinel(ls_spin_basis const* basis, uint64_t count,
+                                                        ls_bits64 const* spins,
+                                                        uint64_t spins_stride, uint64_t* out,
+                                                        uint64_t out_stride, uint64_t sentinel);
 
 ls_error_code   ls_get_states(ls_states** ptr, ls_spin_basis const* basis);
 void            ls_destroy_states(ls_states* states);
@@ -296,6 +370,28 @@ uint64_t ls_binary_search(uint64_t const* data, uint64_t size, uint64_t key);
 ls_error_code ls_save_cache(ls_spin_basis const* basis, char const* filename);
 ls_error_code ls_load_cache(ls_spin_basis* basis, char const* filename);
 
+typedef enum {
+    LS_MAP_DEFAULT,  ///< Pages are read on first access (states are not checksummed)
+    LS_MAP_POPULATE, ///< The whole file is read into the page cache before returning
+    LS_MAP_WILLNEED, ///< The kernel reads the file in the background (states are not checksummed)
+    LS_MAP_COPY,     ///< The file is read into private memory instead of being mapped
+} ls_map_mode;
+
+ls_error_code ls_load_cache_mapped(ls_spin_basis* basis, char const* filename, ls_map_mode mode);
+ls_error_code ls_build_to_file(ls_spin_basis const* basis, char const* filename);
+ls_error_code ls_save_cache_with_norms(ls_spin_basis const* basis, char const* filename,
+                                       bool with_norms);
+ls_error_code ls_save_cache_compressed(ls_spin_basis const* basis, char const* filename,
+                                       bool with_norms);
+ls_error_code ls_get_norms(ls_spin_basis const* basis, double const** norms);
+
+void ls_enable_direct_io();
+void ls_disable_direct_io();
+bool ls_is_direct_io_enabled();
+
+ls_error_code ls_load_cache_async(ls_spin_basis* basis, char const* filename, ls_map_mode mode);
+ls_error_code ls_wait_cache(ls_spin_basis const* basis);
+
 typedef struct ls_interaction ls_interaction;
 typedef struct ls_operator    ls_operator;
 
@@ -333,6 +429,10 @@ uint64_t ls_batched_operator_apply(ls_operator const* op, uint64_t count, ls_bit
 ls_error_code ls_operator_matmat(ls_operator const* op, ls_datatype dtype, uint64_t size,
                                  uint64_t block_size, void const* x, uint64_t x_stride, void* y,
                                  uint64_t y_stride);
+ls_error_code ls_operator_matmat_with_progress(ls_operator const* op, ls_datatype dtype,
+                                               uint64_t size, uint64_t block_size, void const* x,
+                                               uint64_t x_stride, void* y, uint64_t y_stride,
+                                               ls_progress_callback callback, void* cxt);
 
 ls_error_code ls_operator_expectation(ls_operator const* op, ls_datatype dtype, uint64_t size,
                                       uint64_t block_size, void const* x, uint64_t x_stride,
@@ -71,7 +71,7 @@ import os
 import subprocess
 import sys
 import time
-from typing import List, Optional, Tuple, Union
+from typing import Callable, Dict, List, Optional, Tuple, Union
 import warnings
 import weakref
 
@@ -130,6 +130,40 @@ ls_bits512 = c_uint64 * 8
 ls_callback = CFUNCTYPE(c_int, POINTER(ls_bits512), POINTER(c_double * 2), c_void_p)
 
 
+class ls_progress(ctypes.Structure):
+    _fields_ = [
+        ("processed", c_uint64),
+        ("total", c_uint64),
+        ("elapsed", c_double),
+        ("eta", c_double),
+    ]
+
+
+ls_progress_callback = CFUNCTYPE(c_bool, POINTER(ls_progress), c_void_p)
+
+
+class ls_kernel_info(ctypes.Structure):
+    _fields_ = [("name", c_char_p), ("variant", c_char_p)]
+
+
+_kernel_archs = {"sse2": 0, "sse4": 1, "avx": 2, "avx2": 3}
+
+
+def _make_progress_callback(progress: Callable[[int, int, float, float], bool]):
+    """Wrap a Python function `progress(processed, total, elapsed, eta)` into a
+    `ls_progress_callback`. Returning `False` from the function cancels the operation. Exceptions
+    are not propagated through C code, so they cancel the operation as well."""
+
+    def callback(info, _cxt):
+        try:
+            info = info.contents
+            return bool(progress(info.processed, info.total, info.elapsed, info.eta))
+        except Exception:
+            return False
+
+    return ls_progress_callback(callback)
+
+
 def __preprocess_library():
     # fmt: off
     info = [
@@ -137,6 +171,10 @@ def __preprocess_library():
         ("ls_enable_logging", [], None),
         ("ls_disable_logging", [], None),
         ("ls_is_logging_enabled", [], c_bool),
+        # Kernel selection
+        ("ls_get_kernel_arch", [], c_int),
+        ("ls_set_kernel_arch", [c_int], c_int),
+        ("ls_get_kernel_info", [POINTER(ls_kernel_info), c_uint64], c_uint64),
         # Error messages
         ("ls_error_to_string", [c_int], POINTER(c_char)),
         ("ls_destroy_string", [POINTER(c_char)], None),
@@ -168,9 +206,15 @@ def __preprocess_library():
         ("ls_get_number_bits", [c_void_p], c_uint),
         ("ls_get_hamming_weight", [c_void_p], c_int),
         ("ls_has_symmetries", [c_void_p], c_bool),
+        ("ls_set_state_info_engine", [c_void_p, c_int], c_int),
+        ("ls_set_index_type", [c_void_p, c_int], c_int),
+        ("ls_set_numa_policy", [c_void_p, c_int, c_bool], c_int),
         ("ls_get_number_states", [c_void_p, POINTER(c_uint64)], c_int),
+        ("ls_get_fast_reject_statistics", [c_void_p, POINTER(c_uint64), POINTER(c_uint64)], c_int),
         ("ls_build", [c_void_p], c_int),
         ("ls_build_unsafe", [c_void_p, c_uint64, POINTER(c_uint64)], c_int),
+        ("ls_build_with_progress", [c_void_p, ls_progress_callback, c_void_p], c_int),
+        ("ls_build_sectors", [c_uint, POINTER(c_void_p)], c_int),
         # ("ls_get_state_info", [c_void_p, POINTER(ls_bits512), POINTER(ls_bits512), c_double * 2, POINTER(c_double)], None),
         ("ls_get_state_info", [c_void_p, POINTER(c_uint64), POINTER(c_uint64), c_void_p, POINTER(c_double)], None),
         ("ls_batched_get_state_info", [c_void_p, c_uint64, POINTER(c_uint64), c_uint64,
@@ -178,13 +222,32 @@ def __preprocess_library():
                                        c_void_p, c_uint64,
                                        POINTER(c_double), c_uint64], None),
         ("ls_get_index", [c_void_p, c_uint64, POINTER(c_uint64)], c_int),
+        ("ls_get_representative", [c_void_p, c_uint64, POINTER(c_uint64)], c_int),
+        ("ls_get_index_512", [c_void_p, POINTER(ls_bits512), POINTER(c_uint64)], c_int),
+        ("ls_get_representative_512", [c_void_p, c_uint64, POINTER(ls_bits512)], c_int),
         ("ls_batched_get_index", [c_void_p, c_uint64, POINTER(c_uint64), c_uint64, POINTER(c_uint64), c_uint64], c_int),
+        ("ls_batched_get_index_with_sentinel", [c_void_p, c_uint64, POINTER(c_uint64), c_uint64, POINTER(c_uint64), c_uint64,
+                                                c_uint64], c_int),
+        ("ls_batched_get_index_sorted", [c_void_p, c_uint64, POINTER(c_uint64), c_uint64, POINTER(c_uint64), c_uint64], c_int),
+        ("ls_batched_get_index_sorted_with_sentinel", [c_void_p, c_uint64, POINTER(c_uint64), c_uint64, POINTER(c_uint64),
+                                                       c_uint64, c_uint64], c_int),
         ("ls_get_states", [POINTER(c_void_p), c_void_p], c_int),
         ("ls_destroy_states", [c_void_p], None),
         ("ls_states_get_data", [c_void_p], POINTER(c_uint64)),
         ("ls_states_get_size", [c_void_p], c_uint64),
         ("ls_save_cache", [c_void_p, c_char_p], c_int),
         ("ls_load_cache", [c_void_p, c_char_p], c_int),
+        ("ls_load_cache_mapped", [c_void_p, c_char_p, c_int], c_int),
+        ("ls_build_to_file", [c_void_p, c_char_p], c_int),
+        ("ls_save_cache_with_norms", [c_void_p, c_char_p, c_bool], c_int),
+        ("ls_save_cache_compressed", [c_void_p, c_char_p, c_bool], c_int),
+        ("ls_load_cache_async", [c_void_p, c_char_p, c_int], c_int),
+        ("ls_wait_cache", [c_void_p], c_int),
+        ("ls_get_norms", [c_void_p, POINTER(POINTER(c_double))], c_int),
+        ("ls_enable_direct_io", [], None),
+        ("ls_disable_direct_io", [], None),
+        ("ls_is_direct_io_enabled", [], c_bool),
+        ("ls_build_checkpointed", [c_void_p, c_char_p], c_int),
         # Flat basis
         ("ls_convert_to_flat_spin_basis", [POINTER(c_void_p), c_void_p], c_int),
         ("ls_destroy_flat_spin_basis", [c_void_p], None),
@@ -212,6 +275,8 @@ def __preprocess_library():
         ("ls_batched_operator_apply", [c_void_p, c_uint64, POINTER(c_uint64),
                                        POINTER(c_uint64), c_void_p, POINTER(c_uint64)], c_uint64),
         ("ls_operator_matmat", [c_void_p, c_int, c_uint64, c_uint64, c_void_p, c_uint64, c_void_p, c_uint64], c_int),
+        ("ls_operator_matmat_with_progress", [c_void_p, c_int, c_uint64, c_uint64, c_void_p, c_uint64, c_void_p, c_uint64,
+                                              ls_progress_callback, c_void_p], c_int),
         ("ls_operator_expectation", [c_void_p, c_int, c_uint64, c_uint64, c_void_p, c_uint64, c_void_p], c_int),
     ]
     # fmt: on
@@ -239,6 +304,45 @@ def is_logging_enabled() -> bool:
     return _lib.ls_is_logging_enabled()
 
 
+def enable_direct_io() -> None:
+    """Read and write cache files with O_DIRECT, i.e. bypassing the page cache."""
+    _lib.ls_enable_direct_io()
+
+
+def disable_direct_io() -> None:
+    """Read and write cache files through the page cache (default)."""
+    _lib.ls_disable_direct_io()
+
+
+def is_direct_io_enabled() -> bool:
+    """Return whether cache files are read and written with O_DIRECT."""
+    return _lib.ls_is_direct_io_enabled()
+
+
+def get_kernel_arch() -> str:
+    """Return the instruction set used by CPU kernels: "sse2", "sse4", "avx", or "avx2"."""
+    arch = _lib.ls_get_kernel_arch()
+    return next(name for (name, value) in _kernel_archs.items() if value == arch)
+
+
+def set_kernel_arch(arch: str) -> None:
+    """Pin CPU kernels to the given instruction set (see `get_kernel_arch`). This function must
+    not be called while other threads are using the library."""
+    if arch not in _kernel_archs:
+        raise ValueError(
+            "invalid architecture: {}; expected one of {}".format(arch, list(_kernel_archs))
+        )
+    _check_error(_lib.ls_set_kernel_arch(_kernel_archs[arch]))
+
+
+def get_kernel_info() -> Dict[str, str]:
+    """Return a dictionary mapping names of hot kernels to the variants which are used."""
+    count = _lib.ls_get_kernel_info(None, 0)
+    info = (ls_kernel_info * count)()
+    _lib.ls_get_kernel_info(info, count)
+    return {i.name.decode("utf-8"): i.variant.decode("utf-8") for i in info}
+
+
 def debug_log(msg: str, end: str = "\n") -> None:
     if is_logging_enabled():
         current_frame = inspect.currentframe()
@@ -598,6 +702,40 @@ class SpinBasis:
         """Whether lattice symmetries were used to construct the basis."""
         return _lib.ls_has_symmetries(self._payload)
 
+    def set_state_info_engine(self, engine: str) -> None:
+        """Choose how representatives are computed: either "benes" (apply all symmetries using
+        batched Benes networks, the default) or "sublattice" (use lookup tables to only apply a few
+        candidate symmetries)."""
+        engines = {"benes": 0, "sublattice": 1}
+        if engine not in engines:
+            raise ValueError(
+                "invalid engine: {}; expected either 'benes' or 'sublattice'".format(engine)
+            )
+        _check_error(_lib.ls_set_state_info_engine(self._payload, engines[engine]))
+
+    def set_index_type(self, index_type: str) -> None:
+        """Choose how `index` is computed: either "default", "lin" (two-level tables over
+        halves of spin configurations, available for up to 48 spins), "compressed" (compressed
+        list of representatives; should be set before `build` to reduce memory usage), "hash"
+        (minimal perfect hash over representatives), or "btree" (static B+trees inside large
+        buckets)."""
+        index_types = {"default": 0, "lin": 1, "compressed": 2, "hash": 3, "btree": 4}
+        if index_type not in index_types:
+            raise ValueError(
+                "invalid index type: {}; expected one of {}".format(index_type, list(index_types))
+            )
+        _check_error(_lib.ls_set_index_type(self._payload, index_types[index_type]))
+
+    def set_numa_policy(self, policy: str, replicate_buckets: bool = False) -> None:
+        """Choose how the list of representatives is placed on NUMA nodes: "first_touch",
+        "interleave", or "partition". Should be called before `build`."""
+        policies = {"first_touch": 0, "interleave": 1, "partition": 2}
+        if policy not in policies:
+            raise ValueError(
+                "invalid NUMA policy: {}; expected one of {}".format(policy, list(policies))
+            )
+        _check_error(_lib.ls_set_numa_policy(self._payload, policies[policy], replicate_buckets))
+
     @property
     def number_states(self) -> int:
         """Number of states in the basis (i.e. dimension of the Hilbert space). This attribute is
@@ -606,10 +744,42 @@ class SpinBasis:
         _check_error(_lib.ls_get_number_states(self._payload, byref(r)))
         return r.value
 
-    def build(self, representatives: Optional[np.ndarray] = None) -> None:
-        """Build internal cache."""
+    @property
+    def fast_reject_statistics(self) -> Tuple[int, int]:
+        """Number of candidates which were checked by the cheap pre-filter during `build` and
+        number of those which it rejected. Both are zero when the pre-filter is not used."""
+        checked = c_uint64()
+        rejected = c_uint64()
+        _check_error(
+            _lib.ls_get_fast_reject_statistics(self._payload, byref(checked), byref(rejected))
+        )
+        return checked.value, rejected.value
+
+    def build(
+        self,
+        representatives: Optional[np.ndarray] = None,
+        checkpoint: Optional[str] = None,
+        progress: Optional[Callable[[int, int, float, float], bool]] = None,
+    ) -> None:
+        """Build internal cache. If `checkpoint` directory is given, progress is saved there
+        and an interrupted build can be resumed by calling `build` again with the same directory.
+
+        `progress(processed, total, elapsed, eta)` is periodically called with the number of
+        processed spin configurations and times in seconds. Returning `False` cancels the build.
+        Checkpointed builds do not report progress, so `checkpoint` and `progress` may not be
+        combined.
+        """
+        if checkpoint is not None and progress is not None:
+            raise ValueError("progress reporting is not supported for checkpointed builds")
         if representatives is None:
-            _check_error(_lib.ls_build(self._payload))
+            if checkpoint is None and progress is not None:
+                callback = _make_progress_callback(progress)
+                _check_error(_lib.ls_build_with_progress(self._payload, callback, None))
+            elif checkpoint is None:
+                _check_error(_lib.ls_build(self._payload))
+            else:
+                directory = checkpoint.encode("utf-8")
+                _check_error(_lib.ls_build_checkpointed(self._payload, directory))
         else:
             if not isinstance(representatives, np.ndarray) or representatives.dtype != np.uint64:
                 raise TypeError(
@@ -706,26 +876,55 @@ class SpinBasis:
         after a call to `self.build`."""
         bits = int(bits)
         i = c_uint64()
-        _check_error(_lib.ls_get_index(self._payload, bits, byref(i)))
+        if self.number_bits > 64:
+            spin = _int_to_ls_bits512(bits)
+            _check_error(_lib.ls_get_index_512(self._payload, byref(spin), byref(i)))
+        else:
+            _check_error(_lib.ls_get_index(self._payload, bits, byref(i)))
         return i.value
 
-    def batched_index(self, spins: np.ndarray) -> np.ndarray:
+    def representative(self, index: int) -> int:
+        """Obtain the representative with the given index, i.e. `self.states[index]`. For bases
+        without lattice symmetries this does not require the list of representatives to be
+        stored. This function is available only after a call to `self.build`."""
+        index = int(index)
+        if self.number_bits > 64:
+            spin = ls_bits512()
+            _check_error(_lib.ls_get_representative_512(self._payload, index, byref(spin)))
+            return _ls_bits512_to_int(spin)
+        bits = c_uint64()
+        _check_error(_lib.ls_get_representative(self._payload, index, byref(bits)))
+        return bits.value
+
+    def batched_index(
+        self, spins: np.ndarray, sentinel: Optional[int] = None, assume_sorted: bool = False
+    ) -> np.ndarray:
         """Batched version of `self.index`. `batched_index` is equivalent to looping over `spins`
         and calling `self.index` for each element, but is much faster.
+
+        If `sentinel` is given, it is returned for elements of `spins` which are not
+        representatives instead of raising an exception. If `spins` are sorted, passing
+        `assume_sorted=True` replaces independent searches with a single merge join.
         """
         if not isinstance(spins, np.ndarray) or spins.dtype != np.uint64 or spins.ndim != 1:
             raise TypeError("'spins' must be a 1D NumPy array of uint64")
         out = np.empty(spins.shape, dtype=np.uint64)
-        _check_error(
-            _lib.ls_batched_get_index(
-                self._payload,
-                spins.shape[0],
-                spins.ctypes.data_as(POINTER(c_uint64)),
-                spins.strides[0] // spins.itemsize,
-                out.ctypes.data_as(POINTER(c_uint64)),
-                out.strides[0] // out.itemsize,
-            )
+        args = (
+            self._payload,
+            spins.shape[0],
+            spins.ctypes.data_as(POINTER(c_uint64)),
+            spins.strides[0] // spins.itemsize,
+            out.ctypes.data_as(POINTER(c_uint64)),
+            out.strides[0] // out.itemsize,
         )
+        if assume_sorted and sentinel is None:
+            _check_error(_lib.ls_batched_get_index_sorted(*args))
+        elif assume_sorted:
+            _check_error(_lib.ls_batched_get_index_sorted_with_sentinel(*args, sentinel))
+        elif sentinel is None:
+            _check_error(_lib.ls_batched_get_index(*args))
+        else:
+            _check_error(_lib.ls_batched_get_index_with_sentinel(*args, sentinel))
         return out
 
     @property
@@ -748,6 +947,19 @@ class SpinBasis:
         return SpinBasis(group, number_spins, hamming_weight, spin_inversion)
 
 
+def build_sectors(bases: List[SpinBasis]) -> None:
+    """Build internal caches of several bases at once. Bases must only differ in their sectors
+    (i.e. they have to be constructed from the same permutations and have the same number of
+    spins and Hamming weight). This is much faster than calling `build` for each basis.
+    """
+    if not all(map(lambda x: isinstance(x, SpinBasis), bases)):
+        raise TypeError("'bases' must be a List[SpinBasis]")
+    view = (c_void_p * len(bases))()
+    for i in range(len(bases)):
+        view[i] = bases[i]._payload
+    _check_error(_lib.ls_build_sectors(len(bases), view))
+
+
 def _create_flat_spin_basis(basis: SpinBasis) -> c_void_p:
     if not isinstance(basis, SpinBasis):
         raise TypeError("expected SpinBasis, but got {}".format(type(group)))
@@ -1052,7 +1264,8 @@ class Operator:
         self._finalizer = weakref.finalize(self, _destroy(_lib.ls_destroy_operator), self._payload)
         self.basis = basis
 
-    def __call__(self, x, out=None):
+    def __call__(self, x, out=None, progress=None):
+        """Apply the operator to `x`. See `SpinBasis.build` for the meaning of `progress`."""
         if x.ndim != 1 and x.ndim != 2:
             raise ValueError(
                 "'x' must either a vector or a matrix, but got a {}-dimensional array"
@@ -1083,8 +1296,13 @@ class Operator:
                 raise ValueError(
                     "datatypes of 'x' and 'out' do not match: {} vs {}".format(x.dtype, out.dtype)
                 )
+        callback = (
+            _make_progress_callback(progress)
+            if progress is not None
+            else ctypes.cast(None, ls_progress_callback)
+        )
         _check_error(
-            _lib.ls_operator_matmat(
+            _lib.ls_operator_matmat_with_progress(
                 self._payload,
                 _get_dtype(x.dtype),
                 x.shape[0],
@@ -1093,6 +1311,8 @@ class Operator:
                 x.strides[1] // x.itemsize,
                 out.ctypes.data_as(c_void_p),
                 out.strides[1] // out.itemsize,
+                callback,
+                None,
             )
         )
         if x_was_a_vector:
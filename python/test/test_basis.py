@@ -18,6 +18,12 @@ def test_huge():
         ls.SpinBasis(ls.Group([]), number_spins=1000)
 
 
+def test_checkpoint_with_progress(tmp_path):
+    basis = ls.SpinBasis(ls.Group([]), number_spins=4)
+    with pytest.raises(ValueError):
+        basis.build(checkpoint=str(tmp_path), progress=lambda *_: True)
+
+
 def test_1_spin():
     basis = ls.SpinBasis(ls.Group([]), number_spins=1)
     basis.build()
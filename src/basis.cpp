@@ -27,13 +27,19 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "basis.hpp"
+#include "bits.hpp"
 #include "cache.hpp"
+#include "cache_file.hpp"
 #include "cpu/state_info.hpp"
+#include "progress.hpp"
+#include "sublattice.hpp"
 #include "halide/kernels.hpp"
+#include <omp.h>
 #include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <functional>
+#include <string>
 
 #if defined(__APPLE__)
 #    include <libkern/OSByteOrder.h>
@@ -96,10 +102,17 @@ namespace {
     }
 } // namespace
 
-small_basis_t::small_basis_t(ls_group const& group) : cache{nullptr}
+small_basis_t::small_basis_t(ls_group const& group)
+    : symmetries{extract<small_symmetry_t>(
+        tcb::span{ls_group_get_symmetries(&group), ls_get_group_size(&group)})}
+    , cache{nullptr}
+    , sublattice{nullptr}
+    , fast_reject{nullptr}
+    , index_type{LS_INDEX_DEFAULT}
+    , numa_policy{LS_NUMA_FIRST_TOUCH}
+    , replicate_buckets{false}
+    , loader{nullptr}
 {
-    auto symmetries = extract<small_symmetry_t>(
-        tcb::span{ls_group_get_symmetries(&group), ls_get_group_size(&group)});
     std::tie(batched_symmetries, other_symmetries, number_other_symmetries) =
         split_into_batches(symmetries);
 }
@@ -107,8 +120,67 @@ small_basis_t::small_basis_t(ls_group const& group) : cache{nullptr}
 big_basis_t::big_basis_t(ls_group const& group)
     : symmetries{extract<big_symmetry_t>(
         tcb::span{ls_group_get_symmetries(&group), ls_get_group_size(&group)})}
+    , cache{nullptr}
 {}
 
+fast_reject_t::fast_reject_t(unsigned const number_spins, bool const spin_inversion,
+                             std::vector<unsigned> shifts)
+    : _number_spins{number_spins}
+    , _mask{number_spins == 64U ? ~uint64_t{0} : ((uint64_t{1} << number_spins) - 1U)}
+    , _flip_mask{spin_inversion ? _mask : uint64_t{0}}
+    , _shifts{std::move(shifts)}
+    , _checked{0}
+    , _rejected{0}
+{
+    LATTICE_SYMMETRIES_CHECK(0 < number_spins && number_spins <= 64U, "invalid number of spins");
+    for (auto const shift : _shifts) {
+        LATTICE_SYMMETRIES_CHECK(0 < shift && shift < number_spins, "invalid shift");
+    }
+}
+
+auto fast_reject_t::record(counts_t const& counts) const noexcept -> void
+{
+    _checked.fetch_add(counts.checked, std::memory_order_relaxed);
+    _rejected.fetch_add(counts.rejected, std::memory_order_relaxed);
+}
+
+auto fast_reject_t::checked() const noexcept -> uint64_t
+{
+    return _checked.load(std::memory_order_relaxed);
+}
+
+auto fast_reject_t::rejected() const noexcept -> uint64_t
+{
+    return _rejected.load(std::memory_order_relaxed);
+}
+
+auto make_fast_reject(basis_base_t const& header, small_basis_t const& payload)
+    -> std::unique_ptr<fast_reject_t>
+{
+    // Otherwise the stage costs about as much as the full check
+    if (payload.symmetries.size() <= 2U * fast_reject_t::max_shifts) { return nullptr; }
+    auto const number_spins = header.number_spins;
+    auto       shifts       = std::vector<unsigned>{};
+    for (auto const& symmetry : payload.symmetries) {
+        // Symmetry is a rotation by r if it maps every spin i to (i + r) % number_spins
+        auto const r = static_cast<unsigned>(__builtin_ctzl(symmetry.network(uint64_t{1})));
+        if (r == 0U) { continue; }
+        auto is_rotation = true;
+        for (auto i = 1U; i < number_spins && is_rotation; ++i) {
+            is_rotation = symmetry.network(uint64_t{1} << i)
+                          == uint64_t{1} << ((i + r) % number_spins);
+        }
+        if (is_rotation) { shifts.push_back(r); }
+    }
+    if (shifts.empty()) { return nullptr; }
+    // Order by the shift such that the cheapest rejections of the smallest translations come first
+    std::sort(std::begin(shifts), std::end(shifts));
+    shifts.erase(std::unique(std::begin(shifts), std::end(shifts)), std::end(shifts));
+    if (shifts.size() > fast_reject_t::max_shifts) { shifts.resize(fast_reject_t::max_shifts); }
+    return std::make_unique<fast_reject_t>(number_spins, header.spin_inversion != 0,
+                                           std::move(shifts));
+}
+
 } // namespace lattice_symmetries
 
 using namespace lattice_symmetries;
@@ -652,6 +724,9 @@ extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_create_spin_basis(ls_spin_
                  : std::make_unique<ls_spin_basis>(std::in_place_type_t<small_basis_t>{}, group_ref,
                                                    number_spins, _hamming_weight, spin_inversion);
     if (using_trivial_group) { ls_destroy_group(trivial_group); }
+    if (auto* small = std::get_if<small_basis_t>(&p->payload); small != nullptr) {
+        small->fast_reject = make_fast_reject(p->header, *small);
+    }
     increment(p->header.refcount);
     *ptr = p.release();
     return LS_SUCCESS;
@@ -711,16 +786,68 @@ extern "C" LATTICE_SYMMETRIES_EXPORT bool ls_has_symmetries(ls_spin_basis const*
 }
 
 // cppcheck-suppress unusedFunction
-extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_get_number_states(ls_spin_basis const* basis,
-                                                                        uint64_t*            out)
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_set_state_info_engine(ls_spin_basis* basis, ls_state_info_engine const engine)
+{
+    auto* p = std::get_if<small_basis_t>(&basis->payload);
+    if (p == nullptr) { return LS_WRONG_BASIS_TYPE; }
+    switch (engine) {
+    case LS_STATE_INFO_BENES: p->sublattice = nullptr; return LS_SUCCESS;
+    case LS_STATE_INFO_SUBLATTICE:
+        // Without symmetries there is nothing to speed up
+        if (p->sublattice == nullptr && basis->header.has_symmetries) {
+            p->sublattice = std::make_unique<sublattice_engine_t>(basis->header, *p);
+        }
+        return LS_SUCCESS;
+    default: return LS_INVALID_ARGUMENT;
+    }
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_get_fast_reject_statistics(ls_spin_basis const* basis, uint64_t* checked, uint64_t* rejected)
 {
     auto const* p = std::get_if<small_basis_t>(&basis->payload);
-    if (LATTICE_SYMMETRIES_UNLIKELY(p == nullptr)) { return LS_WRONG_BASIS_TYPE; }
-    if (LATTICE_SYMMETRIES_UNLIKELY(p->cache == nullptr)) { return LS_CACHE_NOT_BUILT; }
-    *out = p->cache->number_states();
+    if (p == nullptr) { return LS_WRONG_BASIS_TYPE; }
+    *checked  = p->fast_reject != nullptr ? p->fast_reject->checked() : 0U;
+    *rejected = p->fast_reject != nullptr ? p->fast_reject->rejected() : 0U;
     return LS_SUCCESS;
 }
 
+namespace {
+/// Blocks until a cache which is being loaded by ls_load_cache_async is ready and returns the
+/// status of loading (LS_SUCCESS if nothing is being loaded).
+auto wait_for_cache(small_basis_t const& p) noexcept -> ls_error_code
+{
+    return p.loader != nullptr ? p.loader->wait() : LS_SUCCESS;
+}
+
+/// Same as wait_for_cache, but also joins the background thread. It is used by functions which
+/// modify the cache, i.e. it must not run concurrently with lookups.
+auto finish_loading(small_basis_t& p) noexcept -> ls_error_code
+{
+    auto const status = wait_for_cache(p);
+    p.loader          = nullptr;
+    return status;
+}
+
+auto wait_for_cache(big_basis_t const& /*unused*/) noexcept -> ls_error_code { return LS_SUCCESS; }
+} // namespace
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_get_number_states(ls_spin_basis const* basis,
+                                                                        uint64_t*            out)
+{
+    return std::visit(
+        [out](auto const& p) noexcept {
+            if (auto const status = wait_for_cache(p); status != LS_SUCCESS) { return status; }
+            if (LATTICE_SYMMETRIES_UNLIKELY(p.cache == nullptr)) { return LS_CACHE_NOT_BUILT; }
+            *out = p.cache->number_states();
+            return LS_SUCCESS;
+        },
+        basis->payload);
+}
+
 // cppcheck-suppress unusedFunction
 extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_get_index(ls_spin_basis const* basis,
                                                                 uint64_t const       bits,
@@ -728,16 +855,299 @@ extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_get_index(ls_spin_basis co
 {
     auto const* p = std::get_if<small_basis_t>(&basis->payload);
     if (LATTICE_SYMMETRIES_UNLIKELY(p == nullptr)) { return LS_WRONG_BASIS_TYPE; }
+    if (auto const status = wait_for_cache(*p); status != LS_SUCCESS) { return status; }
     if (LATTICE_SYMMETRIES_UNLIKELY(p->cache == nullptr)) { return LS_CACHE_NOT_BUILT; }
     return p->cache->index(bits, index);
 }
 
+namespace {
+    auto batched_get_index(ls_spin_basis const* basis, uint64_t const count,
+                           uint64_t const* spins, uint64_t const spins_stride, uint64_t* out,
+                           uint64_t const out_stride, std::optional<uint64_t> const sentinel,
+                           bool const sorted = false) -> ls_error_code
+    {
+        auto const* p = std::get_if<small_basis_t>(&basis->payload);
+        if (LATTICE_SYMMETRIES_UNLIKELY(p == nullptr)) { return LS_WRONG_BASIS_TYPE; }
+        if (auto const status = wait_for_cache(*p); status != LS_SUCCESS) { return status; }
+        if (LATTICE_SYMMETRIES_UNLIKELY(p->cache == nullptr)) { return LS_CACHE_NOT_BUILT; }
+        auto const& cache = *p->cache;
+
+        // Lookups take tens of nanoseconds, so threads only pay off for large batches. For sorted
+        // batches every chunk is an independent merge join which starts at the bucket of its
+        // first key, i.e. threads walk disjoint ranges of the list of representatives
+        constexpr auto chunk_size    = uint64_t{4096};
+        auto const     number_chunks = (count + chunk_size - 1U) / chunk_size;
+        auto           status        = LS_SUCCESS;
+#pragma omp parallel for default(none) schedule(dynamic, 1)                                        \
+    if (number_chunks > 1 && !omp_in_parallel())                                                   \
+        firstprivate(count, spins, spins_stride, out, out_stride, sentinel, sorted, chunk_size,    \
+                         number_chunks) shared(cache, status)
+        for (auto i = uint64_t{0}; i < number_chunks; ++i) {
+            ls_error_code local_status; // NOLINT: initialized by atomic read
+#pragma omp atomic read
+            local_status = status;
+            if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) { continue; }
+            auto const offset = i * chunk_size;
+            auto const n      = std::min(chunk_size, count - offset);
+            local_status =
+                sorted ? cache.index_sorted(n, spins + offset * spins_stride, spins_stride,
+                                            out + offset * out_stride, out_stride, sentinel)
+                       : cache.index(n, spins + offset * spins_stride, spins_stride,
+                                     out + offset * out_stride, out_stride, sentinel);
+            if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) {
+#pragma omp atomic write
+                status = local_status;
+            }
+        }
+        return status;
+    }
+} // namespace
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_batched_get_index(ls_spin_basis const* basis, uint64_t const count, ls_bits64 const* spins,
+                     uint64_t const spins_stride, uint64_t* out, uint64_t const out_stride)
+{
+    return batched_get_index(basis, count, spins, spins_stride, out, out_stride, std::nullopt);
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_batched_get_index_with_sentinel(
+    ls_spin_basis const* basis, uint64_t const count, ls_bits64 const* spins,
+    uint64_t const spins_stride, uint64_t* out, uint64_t const out_stride, uint64_t const sentinel)
+{
+    return batched_get_index(basis, count, spins, spins_stride, out, out_stride, sentinel);
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_batched_get_index_sorted(
+    ls_spin_basis const* basis, uint64_t const count, ls_bits64 const* spins,
+    uint64_t const spins_stride, uint64_t* out, uint64_t const out_stride)
+{
+    return batched_get_index(basis, count, spins, spins_stride, out, out_stride, std::nullopt,
+                             true);
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_batched_get_index_sorted_with_sentinel(
+    ls_spin_basis const* basis, uint64_t const count, ls_bits64 const* spins,
+    uint64_t const spins_stride, uint64_t* out, uint64_t const out_stride, uint64_t const sentinel)
+{
+    return batched_get_index(basis, count, spins, spins_stride, out, out_stride, sentinel, true);
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_get_representative(ls_spin_basis const* basis,
+                                                                         uint64_t const       index,
+                                                                         uint64_t*            bits)
+{
+    auto const* p = std::get_if<small_basis_t>(&basis->payload);
+    if (LATTICE_SYMMETRIES_UNLIKELY(p == nullptr)) { return LS_WRONG_BASIS_TYPE; }
+    if (auto const status = wait_for_cache(*p); status != LS_SUCCESS) { return status; }
+    if (LATTICE_SYMMETRIES_UNLIKELY(p->cache == nullptr)) { return LS_CACHE_NOT_BUILT; }
+    return p->cache->state(index, bits);
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_get_index_512(ls_spin_basis const* basis,
+                                                                    ls_bits512 const*    bits,
+                                                                    uint64_t*            index)
+{
+    auto const* p = std::get_if<big_basis_t>(&basis->payload);
+    // Spin configurations of small bases only occupy the first word
+    if (p == nullptr) { return ls_get_index(basis, bits->words[0], index); }
+    if (LATTICE_SYMMETRIES_UNLIKELY(p->cache == nullptr)) { return LS_CACHE_NOT_BUILT; }
+    return p->cache->index(*bits, index);
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_get_representative_512(ls_spin_basis const* basis, uint64_t const index, ls_bits512* bits)
+{
+    auto const* p = std::get_if<big_basis_t>(&basis->payload);
+    if (p == nullptr) {
+        set_zero(*bits);
+        return ls_get_representative(basis, index, &bits->words[0]);
+    }
+    if (LATTICE_SYMMETRIES_UNLIKELY(p->cache == nullptr)) { return LS_CACHE_NOT_BUILT; }
+    return p->cache->state(index, *bits);
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_set_index_type(ls_spin_basis*      basis,
+                                                                     ls_index_type const type)
+{
+    auto* p = std::get_if<small_basis_t>(&basis->payload);
+    if (p == nullptr) { return LS_WRONG_BASIS_TYPE; }
+    if (type != LS_INDEX_DEFAULT && type != LS_INDEX_LIN && type != LS_INDEX_COMPRESSED
+        && type != LS_INDEX_HASH && type != LS_INDEX_BTREE) {
+        return LS_INVALID_ARGUMENT;
+    }
+    if (type == LS_INDEX_LIN && basis->header.number_spins > lin_index_t::max_number_spins) {
+        return LS_INVALID_NUMBER_SPINS;
+    }
+    // The background thread reads index_type, so it has to finish first
+    static_cast<void>(finish_loading(*p));
+    p->index_type = type;
+    if (p->cache != nullptr) { p->cache->set_index_type(basis->header, type); }
+    return LS_SUCCESS;
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_set_numa_policy(ls_spin_basis*       basis,
+                                                                      ls_numa_policy const policy,
+                                                                      bool const replicate_buckets)
+{
+    auto* p = std::get_if<small_basis_t>(&basis->payload);
+    if (p == nullptr) { return LS_WRONG_BASIS_TYPE; }
+    if (policy != LS_NUMA_FIRST_TOUCH && policy != LS_NUMA_INTERLEAVE
+        && policy != LS_NUMA_PARTITION) {
+        return LS_INVALID_ARGUMENT;
+    }
+    // NOTE: an already built cache is not moved, because ls_states may reference it
+    static_cast<void>(finish_loading(*p));
+    p->numa_policy       = policy;
+    p->replicate_buckets = replicate_buckets;
+    return LS_SUCCESS;
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_numa_policy ls_get_numa_policy(ls_spin_basis const* basis)
+{
+    auto const* p = std::get_if<small_basis_t>(&basis->payload);
+    return p != nullptr ? p->numa_policy : LS_NUMA_FIRST_TOUCH;
+}
+
 // cppcheck-suppress unusedFunction
 extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_build(ls_spin_basis* basis)
+{
+    if (auto* p = std::get_if<big_basis_t>(&basis->payload); p != nullptr) {
+        // Without a fixed Hamming weight there are at least 2^64 spin configurations to check
+        if (!basis->header.hamming_weight.has_value()) { return LS_INVALID_HAMMING_WEIGHT; }
+        if (p->cache == nullptr) {
+            p->cache = std::make_unique<big_basis_cache_t>(basis->header, *p);
+        }
+        return LS_SUCCESS;
+    }
+    auto& p = std::get<small_basis_t>(basis->payload);
+    // If asynchronous loading failed, the cache is built instead
+    static_cast<void>(finish_loading(p));
+    if (p.cache == nullptr) { p.cache = std::make_unique<basis_cache_t>(basis->header, p); }
+    return LS_SUCCESS;
+}
+
+namespace {
+    auto same_permutations(unsigned const number_spins, small_basis_t const& a,
+                           small_basis_t const& b) noexcept -> bool
+    {
+        if (a.symmetries.size() != b.symmetries.size()) { return false; }
+        for (auto k = size_t{0}; k < a.symmetries.size(); ++k) {
+            for (auto i = 0U; i < number_spins; ++i) {
+                if (a.symmetries[k].network(uint64_t{1} << i)
+                    != b.symmetries[k].network(uint64_t{1} << i)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+} // namespace
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_build_sectors(unsigned const count,
+                                                                    ls_spin_basis* const bases[])
+{
+    if (count == 0) { return LS_SUCCESS; }
+    // Caches which are being loaded by ls_load_cache_async have to be ready (or have failed)
+    // before we look at them
+    for (auto i = 0U; i < count; ++i) {
+        if (auto* p = std::get_if<small_basis_t>(&bases[i]->payload); p != nullptr) {
+            if (auto const status = finish_loading(*p); status != LS_SUCCESS) { return status; }
+        }
+    }
+    auto headers  = std::vector<basis_base_t const*>{};
+    auto payloads = std::vector<small_basis_t const*>{};
+    for (auto i = 0U; i < count; ++i) {
+        auto const* p = std::get_if<small_basis_t>(&bases[i]->payload);
+        if (p == nullptr) { return LS_WRONG_BASIS_TYPE; }
+        auto const& header = bases[i]->header;
+        auto const& first  = bases[0]->header;
+        if (header.number_spins != first.number_spins
+            || header.hamming_weight != first.hamming_weight
+            || (header.spin_inversion != 0) != (first.spin_inversion != 0)) {
+            return LS_INVALID_ARGUMENT;
+        }
+        if (!same_permutations(header.number_spins, *p,
+                               std::get<small_basis_t>(bases[0]->payload))) {
+            return LS_INCOMPATIBLE_SYMMETRIES;
+        }
+        headers.push_back(&header);
+        payloads.push_back(p);
+    }
+    // Without symmetries there is only one sector and no list of representatives to share
+    if (is_dense(bases[0]->header)) {
+        for (auto i = 0U; i < count; ++i) {
+            if (auto const status = ls_build(bases[i]); status != LS_SUCCESS) { return status; }
+        }
+        return LS_SUCCESS;
+    }
+    if (std::all_of(bases, bases + count, [](auto const* basis) noexcept {
+            return std::get<small_basis_t>(basis->payload).cache != nullptr;
+        })) {
+        return LS_SUCCESS;
+    }
+
+    auto states = generate_states(headers, payloads);
+    for (auto i = 0U; i < count; ++i) {
+        auto& p = std::get<small_basis_t>(bases[i]->payload);
+        if (p.cache == nullptr) {
+            p.cache = std::make_unique<basis_cache_t>(bases[i]->header, p, std::move(states[i]));
+        }
+    }
+    return LS_SUCCESS;
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_build_checkpointed(ls_spin_basis* basis,
+                                                                         char const* directory)
 {
     auto* p = std::get_if<small_basis_t>(&basis->payload);
     if (p == nullptr) { return LS_WRONG_BASIS_TYPE; }
-    if (p->cache == nullptr) { p->cache = std::make_unique<basis_cache_t>(basis->header, *p); }
+    static_cast<void>(finish_loading(*p));
+    if (p->cache != nullptr) { return LS_SUCCESS; }
+    // Dense bases do not store representatives, so there is nothing to checkpoint
+    if (is_dense(basis->header)) { return ls_build(basis); }
+
+    auto&& r = generate_states(basis->header, *p, directory);
+    if (!r) {
+        if (r.error().category() == get_error_category()) {
+            return static_cast<ls_error_code>(r.error().value());
+        }
+        return LS_SYSTEM_ERROR;
+    }
+    p->cache = std::make_unique<basis_cache_t>(basis->header, *p, std::move(r).value());
+    return LS_SUCCESS;
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_build_with_progress(ls_spin_basis* basis, ls_progress_callback callback, void* cxt)
+{
+    auto* p = std::get_if<small_basis_t>(&basis->payload);
+    // Dense bases do not store representatives, so there is nothing to report
+    if (callback == nullptr || p == nullptr || is_dense(basis->header)) { return ls_build(basis); }
+    static_cast<void>(finish_loading(*p));
+    if (p->cache != nullptr) { return LS_SUCCESS; }
+
+    auto   progress = progress_t{callback, cxt};
+    auto&& r        = generate_states(basis->header, *p, progress);
+    if (!r) {
+        if (r.error().category() == get_error_category()) {
+            return static_cast<ls_error_code>(r.error().value());
+        }
+        return LS_SYSTEM_ERROR;
+    }
+    p->cache = std::make_unique<basis_cache_t>(basis->header, *p, std::move(r).value());
     return LS_SUCCESS;
 }
 
@@ -748,6 +1158,7 @@ extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_build_unsafe(ls_spin_basis
 {
     auto* p = std::get_if<small_basis_t>(&basis->payload);
     if (p == nullptr) { return LS_WRONG_BASIS_TYPE; }
+    static_cast<void>(finish_loading(*p));
     if (p->cache == nullptr) {
         std::vector<uint64_t> rs{representatives, representatives + size};
         p->cache = std::make_unique<basis_cache_t>(basis->header, *p, std::move(rs));
@@ -807,6 +1218,7 @@ extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_get_states(ls_states**
 {
     auto const* small_basis = std::get_if<small_basis_t>(&basis->payload);
     if (LATTICE_SYMMETRIES_UNLIKELY(small_basis == nullptr)) { return LS_WRONG_BASIS_TYPE; }
+    if (auto const status = wait_for_cache(*small_basis); status != LS_SUCCESS) { return status; }
     if (LATTICE_SYMMETRIES_UNLIKELY(small_basis->cache == nullptr)) { return LS_CACHE_NOT_BUILT; }
     auto const states = small_basis->cache->states();
     auto       p      = std::make_unique<ls_states>(states, basis);
@@ -832,15 +1244,59 @@ extern "C" LATTICE_SYMMETRIES_EXPORT uint64_t ls_states_get_size(ls_states const
     return states->payload.size();
 }
 
+namespace {
+auto write_cache(ls_spin_basis const* basis, char const* filename, bool const with_norms,
+                 bool const compress) noexcept -> ls_error_code
+{
+    auto const* small_basis = std::get_if<small_basis_t>(&basis->payload);
+    if (small_basis == nullptr) { return LS_WRONG_BASIS_TYPE; }
+    if (auto const status = wait_for_cache(*small_basis); status != LS_SUCCESS) { return status; }
+    if (small_basis->cache == nullptr) { return LS_CACHE_NOT_BUILT; }
+    auto const r = save_cache(basis->header, *small_basis, *small_basis->cache, with_norms,
+                              compress, filename);
+    if (!r) {
+        if (r.error().category() == get_error_category()) {
+            return static_cast<ls_error_code>(r.error().value());
+        }
+        return LS_SYSTEM_ERROR;
+    }
+    return LS_SUCCESS;
+}
+} // namespace
+
 // cppcheck-suppress unusedFunction
 extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_save_cache(ls_spin_basis const* basis,
                                                                  char const*          filename)
+{
+    return write_cache(basis, filename, false, false);
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_save_cache_with_norms(ls_spin_basis const* basis, char const* filename, bool const with_norms)
+{
+    return write_cache(basis, filename, with_norms, false);
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_save_cache_compressed(ls_spin_basis const* basis, char const* filename, bool const with_norms)
+{
+    return write_cache(basis, filename, with_norms, true);
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_build_to_file(ls_spin_basis const* basis,
+                                                                    char const*          filename)
 {
     auto const* small_basis = std::get_if<small_basis_t>(&basis->payload);
     if (small_basis == nullptr) { return LS_WRONG_BASIS_TYPE; }
-    if (small_basis->cache == nullptr) { return LS_CACHE_NOT_BUILT; }
-    auto const states = small_basis->cache->states();
-    auto const r      = save_states(states, filename);
+    // A failed asynchronous load is not an error here, because the states are simply regenerated
+    static_cast<void>(wait_for_cache(*small_basis));
+    auto const r = small_basis->cache != nullptr
+                       ? save_cache(basis->header, *small_basis, *small_basis->cache, false,
+                                    false, filename)
+                       : save_states(basis->header, *small_basis, filename);
     if (!r) {
         if (r.error().category() == get_error_category()) {
             return static_cast<ls_error_code>(r.error().value());
@@ -854,19 +1310,88 @@ extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_save_cache(ls_spin_basis c
 extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_load_cache(ls_spin_basis* basis,
                                                                  char const*    filename)
 {
-    auto* p = std::get_if<small_basis_t>(&basis->payload);
-    if (p == nullptr) { return LS_WRONG_BASIS_TYPE; }
-    // Cache already built
-    if (p->cache != nullptr) { return LS_SUCCESS; }
+    return ls_load_cache_mapped(basis, filename, LS_MAP_DEFAULT);
+}
 
-    auto&& r = load_states(filename);
+namespace {
+auto read_cache(basis_base_t const& header, small_basis_t& payload, char const* filename,
+                ls_map_mode const mode) noexcept -> ls_error_code
+{
+    auto&& r = load_cache(header, payload, filename, mode);
     if (!r) {
         if (r.error().category() == get_error_category()) {
             return static_cast<ls_error_code>(r.error().value());
         }
         return LS_SYSTEM_ERROR;
     }
-    p->cache = std::make_unique<basis_cache_t>(basis->header, *p, r.value());
+    payload.cache = std::make_unique<basis_cache_t>(header, payload, std::move(r).value());
+    return LS_SUCCESS;
+}
+
+/// Common part of ls_load_cache_mapped and ls_load_cache_async. Returns nullptr if there is
+/// nothing to load.
+auto prepare_loading(ls_spin_basis* basis, ls_map_mode const mode, ls_error_code& status) noexcept
+    -> small_basis_t*
+{
+    auto* p = std::get_if<small_basis_t>(&basis->payload);
+    status  = LS_SUCCESS;
+    if (p == nullptr) {
+        status = LS_WRONG_BASIS_TYPE;
+        return nullptr;
+    }
+    if (mode != LS_MAP_DEFAULT && mode != LS_MAP_POPULATE && mode != LS_MAP_WILLNEED
+        && mode != LS_MAP_COPY) {
+        status = LS_INVALID_ARGUMENT;
+        return nullptr;
+    }
+    static_cast<void>(finish_loading(*p));
+    // Cache already built
+    if (p->cache != nullptr) { return nullptr; }
+    return p;
+}
+} // namespace
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_load_cache_mapped(ls_spin_basis* basis, char const* filename, ls_map_mode const mode)
+{
+    auto  status = LS_SUCCESS;
+    auto* p      = prepare_loading(basis, mode, status);
+    if (p == nullptr) { return status; }
+    return read_cache(basis->header, *p, filename, mode);
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
+ls_load_cache_async(ls_spin_basis* basis, char const* filename, ls_map_mode const mode)
+{
+    auto  status = LS_SUCCESS;
+    auto* p      = prepare_loading(basis, mode, status);
+    if (p == nullptr) { return status; }
+    // filename is copied, because the caller may free it before the thread starts
+    p->loader = std::make_unique<cache_loader_t>(
+        [header = &basis->header, p, name = std::string{filename}, mode]() noexcept {
+            return read_cache(*header, *p, name.c_str(), mode);
+        });
+    return LS_SUCCESS;
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_wait_cache(ls_spin_basis const* basis)
+{
+    return std::visit([](auto const& p) noexcept { return wait_for_cache(p); }, basis->payload);
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_get_norms(ls_spin_basis const* basis,
+                                                                double const**       norms)
+{
+    auto const* p = std::get_if<small_basis_t>(&basis->payload);
+    if (p == nullptr) { return LS_WRONG_BASIS_TYPE; }
+    if (auto const status = wait_for_cache(*p); status != LS_SUCCESS) { return status; }
+    if (p->cache == nullptr) { return LS_CACHE_NOT_BUILT; }
+    auto const table = p->cache->norms();
+    *norms           = table.empty() ? nullptr : table.data();
     return LS_SUCCESS;
 }
 
@@ -891,4 +1416,16 @@ auto is_real(ls_spin_basis const& basis) noexcept -> bool
     };
     return std::visit(visitor_fn_t{}, basis.payload);
 }
+
+auto get_small_cache(ls_spin_basis const& basis) noexcept -> basis_cache_t const*
+{
+    auto const* p = std::get_if<small_basis_t>(&basis.payload);
+    return p != nullptr ? p->cache.get() : nullptr;
+}
+
+auto get_big_cache(ls_spin_basis const& basis) noexcept -> big_basis_cache_t const*
+{
+    auto const* p = std::get_if<big_basis_t>(&basis.payload);
+    return p != nullptr ? p->cache.get() : nullptr;
+}
 } // namespace lattice_symmetries
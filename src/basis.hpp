@@ -30,10 +30,12 @@
 
 #include "intrusive_ptr.hpp"
 #include "symmetry.hpp"
+#include <atomic>
 #include <cstdlib>
 #include <functional>
 #include <memory>
 #include <optional>
+#include <vector>
 
 namespace lattice_symmetries {
 
@@ -46,23 +48,90 @@ struct basis_base_t {
 };
 
 struct basis_cache_t;
+struct big_basis_cache_t;
+class cache_loader_t;
+class sublattice_engine_t;
+
+/// Cheap test which rejects most spin configurations before the full group is applied.
+///
+/// Symmetries which act on spin configurations as cyclic shifts (e.g. translations of a chain or
+/// translations by whole rows of a lattice) are applied using bit rotations. If a rotation
+/// (optionally followed by a global spin flip) maps x to a smaller state, x is not a
+/// representative. Passing the test says nothing.
+class fast_reject_t {
+    unsigned                      _number_spins;
+    uint64_t                      _mask;
+    uint64_t                      _flip_mask; // zero unless spin inversion is used
+    std::vector<unsigned>         _shifts;
+    mutable std::atomic<uint64_t> _checked;
+    mutable std::atomic<uint64_t> _rejected;
+
+  public:
+    /// At most this many rotations are checked
+    static constexpr auto max_shifts = 4U;
+
+    fast_reject_t(unsigned number_spins, bool spin_inversion, std::vector<unsigned> shifts);
+
+    [[nodiscard]] auto rejects(uint64_t const x) const noexcept -> bool
+    {
+        if ((x ^ _flip_mask) < x) { return true; }
+        for (auto const shift : _shifts) {
+            auto const y = ((x << shift) | (x >> (_number_spins - shift))) & _mask;
+            if (y < x || (y ^ _flip_mask) < x) { return true; }
+        }
+        return false;
+    }
+
+    /// Statistics are accumulated by the batched representative check (i.e. during builds). To
+    /// keep threads from contending on the atomics, every task counts into its own counts_t which
+    /// is passed to #record once at the end.
+    struct counts_t {
+        uint64_t checked;
+        uint64_t rejected;
+    };
+    auto record(counts_t const& counts) const noexcept -> void;
+    [[nodiscard]] auto checked() const noexcept -> uint64_t;
+    [[nodiscard]] auto rejected() const noexcept -> uint64_t;
+};
 
 struct small_basis_t {
+    // Same symmetries as in batched_symmetries and other_symmetries, but one by one
+    std::vector<small_symmetry_t>           symmetries;
     std::vector<batched_small_symmetry_t>   batched_symmetries;
     std::optional<batched_small_symmetry_t> other_symmetries;
     unsigned                                number_other_symmetries;
     std::unique_ptr<basis_cache_t>          cache;
+    // When set, it is used instead of batched_symmetries to compute representatives
+    std::unique_ptr<sublattice_engine_t>    sublattice;
+    // When set, it is tried before the full group in is_representative_64
+    std::unique_ptr<fast_reject_t>          fast_reject;
+    ls_index_type                           index_type;
+    // Placement of the list of representatives and of the bucket table
+    ls_numa_policy                          numa_policy;
+    bool                                    replicate_buckets;
+    // Set by ls_load_cache_async. cache must not be accessed until loader->wait() returns. It is
+    // declared last such that the background thread is joined before anything else is destroyed
+    std::unique_ptr<cache_loader_t>         loader;
 
     explicit small_basis_t(ls_group const& group);
 };
 
 struct big_basis_t {
-    std::vector<big_symmetry_t> symmetries;
+    std::vector<big_symmetry_t>        symmetries;
+    std::unique_ptr<big_basis_cache_t> cache;
 
     explicit big_basis_t(ls_group const& group);
 };
 
 auto is_real(ls_spin_basis const& basis) noexcept -> bool;
+/// Caches of small and big bases respectively, or nullptr if the basis is of the other kind or
+/// the cache has not been built. Loading by ls_load_cache_async must have finished.
+auto get_small_cache(ls_spin_basis const& basis) noexcept -> basis_cache_t const*;
+auto get_big_cache(ls_spin_basis const& basis) noexcept -> big_basis_cache_t const*;
+/// Picks symmetries for #fast_reject_t. Returns nullptr if the group has no suitable ones or if
+/// it is so small that the full check is cheap anyway.
+auto make_fast_reject(basis_base_t const& header, small_basis_t const& payload)
+    -> std::unique_ptr<fast_reject_t>;
 
 template <bool CallDestructor = true> struct free_deleter_fn_t {
     template <class T> auto operator()(T* ptr) const noexcept -> void
@@ -28,40 +28,29 @@
 
 #include "cache.hpp"
 #include "bits.hpp"
+#include "byte_order.hpp"
+#include "cache_file.hpp"
 #include "cpu/search_sorted.hpp"
 #include "cpu/state_info.hpp"
+#include "cpu/unpack_block.hpp"
+#include "progress.hpp"
 // #include "kernels.hpp"
 
-#if defined(__APPLE__)
-#    include <libkern/OSByteOrder.h>
-#    include <machine/endian.h>
-
-#    define htobe16(x) OSSwapHostToBigInt16(x)
-#    define htole16(x) OSSwapHostToLittleInt16(x)
-#    define be16toh(x) OSSwapBigToHostInt16(x)
-#    define le16toh(x) OSSwapLittleToHostInt16(x)
-
-#    define htobe32(x) OSSwapHostToBigInt32(x)
-#    define htole32(x) OSSwapHostToLittleInt32(x)
-#    define be32toh(x) OSSwapBigToHostInt32(x)
-#    define le32toh(x) OSSwapLittleToHostInt32(x)
-
-#    define htobe64(x) OSSwapHostToBigInt64(x)
-#    define htole64(x) OSSwapHostToLittleInt64(x)
-#    define be64toh(x) OSSwapBigToHostInt64(x)
-#    define le64toh(x) OSSwapLittleToHostInt64(x)
-#else
-#    include <endian.h>
-#endif
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include <omp.h>
 #include <algorithm>
+#include <array>
 #include <cerrno>
 #include <cstdio>
 #include <numeric>
+#include <string>
 
 #include <unordered_map>
+#include <utility>
 
 namespace lattice_symmetries {
 
@@ -87,8 +76,8 @@ namespace {
     }
 #endif
 
-    auto generate_ranges_v2(tcb::span<uint64_t const> states, unsigned const bits,
-                            unsigned const shift) -> std::vector<uint64_t>
+    auto generate_ranges(tcb::span<uint64_t const> states, unsigned const bits,
+                         unsigned const shift) -> std::vector<uint64_t>
     {
         LATTICE_SYMMETRIES_CHECK(0 < bits && bits < 64, "invalid bits");
         LATTICE_SYMMETRIES_CHECK(shift < 64, "invalid shift");
@@ -115,33 +104,31 @@ namespace {
         return bits >= number_spins ? 0U : (number_spins - bits);
     }
 
-    auto generate_ranges(tcb::span<uint64_t const> states, unsigned const bits,
-                         unsigned const shift)
+    auto last_level_cache_size() noexcept -> uint64_t
     {
-        LATTICE_SYMMETRIES_ASSERT(0 < bits && bits <= 32, "invalid bits");
-        constexpr auto empty = std::make_pair(~uint64_t{0}, uint64_t{0});
-        auto const     size  = uint64_t{1} << bits;
+        constexpr auto fallback = uint64_t{8} * 1024U * 1024U;
+#if defined(_SC_LEVEL3_CACHE_SIZE) && defined(_SC_LEVEL2_CACHE_SIZE)
+        for (auto const name : {_SC_LEVEL3_CACHE_SIZE, _SC_LEVEL2_CACHE_SIZE}) {
+            auto const size = sysconf(name);
+            if (size > 0) { return static_cast<uint64_t>(size); }
+        }
+#endif
+        return fallback;
+    }
 
-        std::vector<std::pair<uint64_t, uint64_t>> ranges;
-        ranges.reserve(size);
-        auto const*       first = states.data();
-        auto const* const last  = first + states.size();
-        auto const* const begin = first;
-        for (auto i = uint64_t{0}; i < size; ++i) {
-            auto element = empty;
-            if (first != last && ((*first) >> shift) == i) {
-                element.first = static_cast<uint64_t>(first - begin);
-                ++first;
-                ++element.second;
-                while (first != last && ((*first) >> shift) == i) {
-                    ++first;
-                    ++element.second;
-                }
-            }
-            ranges.push_back(element);
+    /// Chooses the number of bits which determine the bucket of a state such that buckets contain
+    /// between states_per_bucket / 2 and states_per_bucket states on average (8-16 by default),
+    /// unless the table would not fit into the last level cache.
+    auto choose_bucket_bits(unsigned const number_spins, uint64_t const number_states,
+                            uint64_t const states_per_bucket = 16U) noexcept -> unsigned
+    {
+        auto const max_size = last_level_cache_size() / sizeof(uint64_t);
+        auto           bits              = 1U;
+        while (bits < number_spins && (number_states >> bits) > states_per_bucket
+               && (uint64_t{2} << bits) + 1U <= max_size) {
+            ++bits;
         }
-        LATTICE_SYMMETRIES_CHECK(first == last, "not all states checked");
-        return ranges;
+        return bits;
     }
 
     template <bool FixedHammingWeight> auto next_state(uint64_t const v) noexcept -> uint64_t
@@ -159,41 +146,224 @@ namespace {
         }
     }
 
-    template <bool FixedHammingWeight>
-    auto generate_states_task(uint64_t current, uint64_t const upper_bound,
-                              basis_base_t const& header, small_basis_t const& payload,
-                              std::vector<uint64_t>& states) -> void
+    /// Skips over spin configurations which are known not to be representatives.
+    ///
+    /// Suppose that g(x) < x and let d be the highest bit where g(x) and x differ. Then g(y) < y
+    /// for every y which agrees with x on bits ≥ d and on bits which g maps onto positions ≥ d.
+    /// If t is the lowest of these positions, none of the configurations sharing bits ≥ t with x
+    /// is a representative. For lattices most rejected configurations are rejected because of
+    /// their high bits, so whole blocks of configurations can be skipped at once.
+    class prefix_pruner_t {
+        struct element_t {
+            small_network_t network;
+            uint64_t        flip;
+            // sources[d] are the spins which are mapped onto positions ≥ d
+            std::array<uint64_t, 64> sources;
+        };
+
+        std::vector<element_t> _elements;
+
+      public:
+        prefix_pruner_t(basis_base_t const& header, small_basis_t const& payload) : _elements{}
+        {
+            auto const number_spins = header.number_spins;
+            auto const flip_mask =
+                number_spins == 64U ? ~uint64_t{0} : ((uint64_t{1} << number_spins) - 1U);
+            _elements.reserve(payload.symmetries.size() * (header.spin_inversion != 0 ? 2U : 1U));
+            for (auto const& symmetry : payload.symmetries) {
+                std::array<uint64_t, 64> sources{};
+                for (auto i = 0U; i < number_spins; ++i) {
+                    auto const j = static_cast<unsigned>(
+                        __builtin_ctzl(symmetry.network(uint64_t{1} << i)));
+                    sources[j] = uint64_t{1} << i;
+                }
+                for (auto d = 63U; d-- > 0;) {
+                    sources[d] |= sources[d + 1U];
+                }
+                _elements.push_back({symmetry.network, uint64_t{0}, sources});
+                if (header.spin_inversion != 0) {
+                    _elements.push_back({symmetry.network, flip_mask, sources});
+                }
+            }
+        }
+
+        /// Given a configuration \p x which is not a representative, returns the largest z such
+        /// that no configuration in [x, z] is a representative.
+        [[nodiscard]] auto skip(uint64_t const x) const noexcept -> uint64_t
+        {
+            // Among all witnesses g(x) < x, pick the one which allows to skip the most
+            auto best = 0U;
+            for (auto const& element : _elements) {
+                auto const y = element.network(x) ^ element.flip;
+                if (y < x) {
+                    auto const d = 63U - static_cast<unsigned>(__builtin_clzl(x ^ y));
+                    auto const t = static_cast<unsigned>(
+                        __builtin_ctzl((~uint64_t{0} << d) | element.sources[d]));
+                    best = std::max(best, t);
+                }
+            }
+            // x is not a representative because of its norm, there is nothing to skip
+            if (best == 0U) { return x; }
+            return x | ((uint64_t{1} << best) - 1U);
+        }
+    };
+
+    /// Decides, within one task, whether asking prefix_pruner_t is worth it.
+    ///
+    /// A call to skip costs |G| scalar network evaluations, i.e. about as much as checking a whole
+    /// batch of candidates. For lattices with translations many calls skip large blocks, but for
+    /// some groups (e.g. a lone reflection of a chain) rejections are never due to the high bits
+    /// and every call is wasted. Hence, calls are counted in windows, and if fewer than
+    /// 1/min_hit_ratio of the calls in a window skipped anything, the next pause_length rejected
+    /// configurations are not passed to the pruner. This bounds the overhead to a few percent of
+    /// the calls while keeping the pruner for the parts of the task where it does help.
+    class pruner_throttle_t {
+        static constexpr unsigned window_size   = 64;
+        static constexpr unsigned min_hit_ratio = 16;
+        static constexpr unsigned pause_length  = 1024;
+
+        prefix_pruner_t const* _pruner;
+        unsigned               _calls;
+        unsigned               _hits;
+        unsigned               _paused;
+
+      public:
+        explicit pruner_throttle_t(prefix_pruner_t const* pruner) noexcept
+            : _pruner{pruner}, _calls{0}, _hits{0}, _paused{0}
+        {}
+
+        /// Returns the largest z such that no configuration in [x, z] is a representative. When
+        /// the pruner is not used, z == x.
+        [[nodiscard]] auto skip(uint64_t const x) noexcept -> uint64_t
+        {
+            if (_pruner == nullptr) { return x; }
+            if (_paused != 0U) {
+                --_paused;
+                return x;
+            }
+            auto const z = _pruner->skip(x);
+            if (z > x) { ++_hits; }
+            if (++_calls == window_size) {
+                if (_hits * min_hit_ratio < _calls) { _paused = pause_length; }
+                _calls = 0;
+                _hits  = 0;
+            }
+            return z;
+        }
+    };
+
+    /// Calls \p visit for every spin configuration in [current, upper_bound]. \p visit returns
+    /// false for configurations which are not representatives, and then \p pruner (if any, see
+    /// pruner_throttle_t) is used to skip over configurations which are not representatives either.
+    template <bool FixedHammingWeight, class Visitor>
+    auto visit_task(uint64_t current, uint64_t const upper_bound, prefix_pruner_t const* pruner,
+                    Visitor&& visit) -> void
     {
         if constexpr (FixedHammingWeight) {
             LATTICE_SYMMETRIES_ASSERT(popcount(current) == popcount(upper_bound),
                                       "current and upper_bound must have the same Hamming weight");
         }
-        auto const handle = [&header, &payload, &states](uint64_t const x) noexcept -> void {
-            // uint64_t             repr;
-            // std::complex<double> character;
-            // double               norm;
-            // auto const is_repr = is_representative(payload.batched_symmetries, payload.other_symmetries, x);
-            auto const is_repr = is_representative_64(header, payload, x);
-            if (is_repr) { states.push_back(x); }
-            // get_state_info(batched_symmetries, symmetries, x, repr, character, norm);
-            // if (repr == x && norm > 0.0) { states.push_back(x); }
-        };
+        auto throttle = pruner_throttle_t{pruner};
+        for (;;) {
+            // All configurations in [current, last] have been processed
+            auto last = current;
+            if (!visit(current)) { last = throttle.skip(current); }
+            if (last >= upper_bound) { break; }
+            if constexpr (FixedHammingWeight) {
+                current = last == current ? next_state<true>(current)
+                                          : closest_hamming(last + 1U, popcount(current));
+            }
+            else {
+                current = last + 1U;
+            }
+        }
+    }
+
+    template <class Visitor>
+    auto visit_task(uint64_t current, uint64_t const upper_bound, basis_base_t const& header,
+                    prefix_pruner_t const* pruner, Visitor&& visit) -> void
+    {
+        if (header.hamming_weight.has_value()) {
+            return visit_task<true>(current, upper_bound, pruner, std::forward<Visitor>(visit));
+        }
+        return visit_task<false>(current, upper_bound, pruner, std::forward<Visitor>(visit));
+    }
+
+    /// Calls \p callback for every representative in [current, upper_bound].
+    ///
+    /// Consecutive candidates are checked batch_size at a time using
+    /// batched_is_representative_64. Afterwards, \p pruner (if any, see pruner_throttle_t) is asked
+    /// about the rejected ones, and the next batch starts after the last configuration known not to be a
+    /// representative.
+    template <bool FixedHammingWeight, class Callback>
+    auto generate_states_task(uint64_t current, uint64_t const upper_bound,
+                              basis_base_t const& header, small_basis_t const& payload,
+                              prefix_pruner_t const* pruner, Callback&& callback) -> void
+    {
+        constexpr auto batch_size = batched_small_symmetry_t::batch_size;
+        alignas(32) std::array<uint64_t, batch_size> candidates;
+        std::array<uint8_t, batch_size>              accepted;
+        auto                                         throttle = pruner_throttle_t{pruner};
+        auto                                         counts   = fast_reject_t::counts_t{0, 0};
+        for (;;) {
+            auto count = 0U;
+            for (auto x = current;; x = next_state<FixedHammingWeight>(x)) {
+                candidates[count++] = x;
+                if (count == batch_size || x >= upper_bound) { break; }
+            }
+            // The last batch of a task is padded with copies of the last candidate
+            std::fill(std::begin(candidates) + count, std::end(candidates), candidates[count - 1U]);
+            batched_is_representative_64(header, payload, candidates.data(), accepted.data(),
+                                         counts);
 
-        for (; current < upper_bound; current = next_state<FixedHammingWeight>(current)) {
-            handle(current);
+            // No configuration in [.., pruned] is a representative
+            auto pruned     = uint64_t{0};
+            auto has_pruned = false;
+            for (auto i = 0U; i < count; ++i) {
+                auto const x = candidates[i];
+                if (accepted[i] != 0) { callback(x); }
+                // No need to ask about candidates inside an already skipped block
+                else if (!(has_pruned && x <= pruned)) {
+                    auto const z = throttle.skip(x);
+                    if (z > x) {
+                        pruned     = z;
+                        has_pruned = true;
+                    }
+                }
+            }
+            // All configurations in [current, last] have been processed
+            auto const end  = candidates[count - 1U];
+            auto const last = has_pruned ? std::max(end, pruned) : end;
+            if (last >= upper_bound) { break; }
+            if constexpr (FixedHammingWeight) {
+                current = last == end ? next_state<true>(last)
+                                      : closest_hamming(last + 1U, popcount(current));
+            }
+            else {
+                current = last + 1U;
+            }
         }
-        LATTICE_SYMMETRIES_ASSERT(current == upper_bound, "");
-        handle(current);
+        if (payload.fast_reject != nullptr) { payload.fast_reject->record(counts); }
     }
 
+    template <class Callback>
     auto generate_states_task(uint64_t current, uint64_t const upper_bound,
                               basis_base_t const& header, small_basis_t const& payload,
-                              std::vector<uint64_t>& states) -> void
+                              prefix_pruner_t const* pruner, Callback&& callback) -> void
     {
         if (header.hamming_weight.has_value()) {
-            return generate_states_task<true>(current, upper_bound, header, payload, states);
+            return generate_states_task<true>(current, upper_bound, header, payload, pruner,
+                                              std::forward<Callback>(callback));
         }
-        return generate_states_task<false>(current, upper_bound, header, payload, states);
+        return generate_states_task<false>(current, upper_bound, header, payload, pruner,
+                                           std::forward<Callback>(callback));
+    }
+
+    auto make_pruner(basis_base_t const& header, small_basis_t const& payload)
+        -> std::optional<prefix_pruner_t>
+    {
+        if (!header.has_symmetries) { return std::nullopt; }
+        return prefix_pruner_t{header, payload};
     }
 
     template <bool FixedHammingWeight>
@@ -284,8 +454,7 @@ auto closest_hamming(uint64_t x, unsigned const hamming_weight) noexcept -> uint
 }
 
 namespace {
-    auto generate_states(basis_base_t const& header, small_basis_t const& payload)
-        -> std::vector<std::vector<uint64_t>>
+    auto make_tasks(basis_base_t const& header) -> std::vector<std::pair<uint64_t, uint64_t>>
     {
         LATTICE_SYMMETRIES_CHECK(0 < header.number_spins && header.number_spins <= 64,
                                  "invalid number of spins");
@@ -298,171 +467,1524 @@ namespace {
             auto const [current, bound] = get_bounds(header.number_spins, header.hamming_weight);
             return std::max((bound - current) / number_chunks, uint64_t{1});
         }();
-        auto ranges = lattice_symmetries::split_into_tasks(header.number_spins,
-                                                           header.hamming_weight, chunk_size);
-        auto states = std::vector<std::vector<uint64_t>>(ranges.size());
-#pragma omp parallel for schedule(dynamic, 1) default(none) shared(header, payload, ranges, states)
+        return lattice_symmetries::split_into_tasks(header.number_spins, header.hamming_weight,
+                                                    chunk_size);
+    }
+
+    /// Number of spin configurations which every task has to check.
+    auto get_task_sizes(basis_base_t const&                                 header,
+                        std::vector<std::pair<uint64_t, uint64_t>> const& ranges)
+        -> std::vector<uint64_t>
+    {
+        auto sizes = std::vector<uint64_t>(ranges.size());
+        if (!header.hamming_weight.has_value()) {
+            std::transform(std::begin(ranges), std::end(ranges), std::begin(sizes),
+                           [](auto const& r) { return r.second - r.first + 1U; });
+            return sizes;
+        }
+        auto const ranking = combinatorial_index_t{header.number_spins, header.hamming_weight};
+        std::transform(std::begin(ranges), std::end(ranges), std::begin(sizes),
+                       [&ranking](auto const& r) {
+                           uint64_t first; // NOLINT: initialized by rank
+                           uint64_t last;  // NOLINT: initialized by rank
+                           LATTICE_SYMMETRIES_CHECK(ranking.rank(r.first, &first) == LS_SUCCESS
+                                                        && ranking.rank(r.second, &last)
+                                                               == LS_SUCCESS,
+                                                    "");
+                           return last - first + 1U;
+                       });
+        return sizes;
+    }
+
+    /// Generates the list of representatives in two passes. First, we count the number of
+    /// representatives in every task which tells us where each task should write its results.
+    /// Then, the tasks are run once more writing directly into the final buffer. This doubles the
+    /// number of calls to is_representative_64, but peak memory usage is equal to the size of the
+    /// basis.
+    ///
+    /// When \p progress is given, every finished task reports the number of spin configurations
+    /// it has checked. After cancellation the remaining tasks are skipped and the returned list
+    /// is incomplete, so the caller must check `progress->cancelled()`.
+    auto generate_states(basis_base_t const& header, small_basis_t const& payload,
+                         progress_t* progress = nullptr) -> std::vector<uint64_t>
+    {
+        auto const ranges  = make_tasks(header);
+        auto const pruner  = make_pruner(header, payload);
+        auto const* skip   = pruner.has_value() ? &*pruner : nullptr;
+        auto       offsets = std::vector<uint64_t>(ranges.size() + 1);
+        auto const sizes   = progress != nullptr ? get_task_sizes(header, ranges)
+                                                 : std::vector<uint64_t>(ranges.size());
+        if (progress != nullptr) {
+            progress->start(2U * std::accumulate(std::begin(sizes), std::end(sizes), uint64_t{0}));
+        }
+#pragma omp parallel for schedule(dynamic, 1) default(none)                                        \
+    shared(header, payload, ranges, skip, offsets, sizes, progress)
         for (auto i = size_t{0}; i < ranges.size(); ++i) {
+            if (progress != nullptr && progress->cancelled()) { continue; }
             auto const [current, bound] = ranges[i];
-            // NOLINTNEXTLINE: 1024 * 1024 == 1048576 == 1MB
-            states[i].reserve((1024 * 1024) / sizeof(uint64_t));
-            generate_states_task(current, bound, header, payload, states[i]);
+            auto count                  = uint64_t{0};
+            generate_states_task(current, bound, header, payload, skip,
+                                 [&count](uint64_t /*unused*/) noexcept { ++count; });
+            offsets[i + 1] = count;
+            if (progress != nullptr) { progress->advance(sizes[i]); }
         }
+        if (progress != nullptr && progress->cancelled()) { return {}; }
+        std::partial_sum(std::begin(offsets), std::end(offsets), std::begin(offsets));
+
+        auto states = std::vector<uint64_t>(offsets.back());
+#pragma omp parallel for schedule(dynamic, 1) default(none)                                        \
+    shared(header, payload, ranges, skip, offsets, states, sizes, progress)
+        for (auto i = size_t{0}; i < ranges.size(); ++i) {
+            if (progress != nullptr && progress->cancelled()) { continue; }
+            auto const [current, bound] = ranges[i];
+            auto* out                   = states.data() + offsets[i];
+            generate_states_task(current, bound, header, payload, skip,
+                                 [&out](uint64_t const x) noexcept { *(out++) = x; });
+            LATTICE_SYMMETRIES_CHECK(out == states.data() + offsets[i + 1],
+                                     "number of representatives changed between passes");
+            if (progress != nullptr) { progress->advance(sizes[i]); }
+        }
+        if (progress != nullptr) { progress->finish(); }
+        if (progress != nullptr && progress->cancelled()) { return {}; }
         return states;
     }
+} // namespace
+
+auto generate_states(basis_base_t const& header, small_basis_t const& payload,
+                     progress_t& progress) -> outcome::result<std::vector<uint64_t>>
+{
+    auto states = generate_states(header, payload, &progress);
+    if (progress.cancelled()) { return LS_CANCELLED; }
+    return states;
+}
+
+auto generate_states(tcb::span<basis_base_t const* const>  headers,
+                     tcb::span<small_basis_t const* const> payloads)
+    -> std::vector<std::vector<uint64_t>>
+{
+    LATTICE_SYMMETRIES_CHECK(!headers.empty() && headers.size() == payloads.size(),
+                             "invalid number of sectors");
+    auto const& header       = *headers[0];
+    auto const& symmetries   = payloads[0]->symmetries;
+    auto const  number_spins = header.number_spins;
+    auto const  inversion    = header.spin_inversion != 0;
+    auto const  flip_mask =
+        number_spins == 64U ? ~uint64_t{0} : ((uint64_t{1} << number_spins) - 1U);
+
+    // characters[s * stride + k] is the real part of the character of the k'th group element in
+    // sector s. Elements combined with spin inversion come after all the others.
+    auto const number_sectors = headers.size();
+    auto const stride         = (inversion ? 2U : 1U) * symmetries.size();
+    auto       characters     = std::vector<double>(number_sectors * stride);
+    for (auto s = size_t{0}; s < number_sectors; ++s) {
+        auto const& other = payloads[s]->symmetries;
+        for (auto k = size_t{0}; k < other.size(); ++k) {
+            auto const real                = other[k].eigenvalue.real();
+            characters[s * stride + k] = real;
+            if (inversion) {
+                characters[s * stride + other.size() + k] =
+                    static_cast<double>(headers[s]->spin_inversion) * real;
+            }
+        }
+    }
 
-    auto concatenate(std::vector<std::vector<uint64_t>> const& chunks)
+    auto const  ranges = make_tasks(header);
+    auto const  pruner = make_pruner(header, *payloads[0]);
+    auto const* skip   = pruner.has_value() ? &*pruner : nullptr;
+    // chunks[i * number_sectors + s] are representatives from task i in sector s
+    auto chunks = std::vector<std::vector<uint64_t>>(ranges.size() * number_sectors);
+#pragma omp parallel default(none) firstprivate(number_sectors, stride, inversion, flip_mask)     \
+    shared(header, symmetries, characters, ranges, skip, chunks)
     {
-        auto r = std::vector<uint64_t>{};
-        r.reserve(std::accumulate(std::begin(chunks), std::end(chunks), size_t{0},
-                                  [](auto acc, auto const& x) { return acc + x.size(); }));
-        std::for_each(std::begin(chunks), std::end(chunks),
-                      [&r](auto const& x) { r.insert(std::end(r), std::begin(x), std::end(x)); });
-        return r;
+        auto stabilizer = std::vector<size_t>{};
+#pragma omp for schedule(dynamic, 1)
+        for (auto i = size_t{0}; i < ranges.size(); ++i) {
+            auto const [current, bound] = ranges[i];
+            auto* out                   = chunks.data() + i * number_sectors;
+            visit_task(current, bound, header, skip, [&](uint64_t const x) {
+                // The orbit and the stabilizer of x are the same in all sectors
+                stabilizer.clear();
+                for (auto k = size_t{0}; k < symmetries.size(); ++k) {
+                    auto const y = symmetries[k].network(x);
+                    if (y < x) { return false; }
+                    if (y == x) { stabilizer.push_back(k); }
+                    if (inversion) {
+                        if ((y ^ flip_mask) < x) { return false; }
+                        if ((y ^ flip_mask) == x) { stabilizer.push_back(symmetries.size() + k); }
+                    }
+                }
+                // Only the norm depends on the sector
+                for (auto s = size_t{0}; s < number_sectors; ++s) {
+                    auto n = 0.0;
+                    for (auto const k : stabilizer) {
+                        n += characters[s * stride + k];
+                    }
+                    // Same threshold as in is_representative_64
+                    constexpr auto norm_threshold = 1.0e-5;
+                    if (n > norm_threshold) { out[s].push_back(x); }
+                }
+                return true;
+            });
+        }
     }
-} // namespace
 
-// basis_cache_t::basis_cache_t(tcb::span<batched_small_symmetry_t const> batched,
-//                              tcb::span<small_symmetry_t const> other, unsigned number_spins,
-//                              std::optional<unsigned> hamming_weight,
-//                              std::vector<uint64_t>   _unsafe_states)
-//     : _shift{bits >= number_spins ? 0U : (number_spins - bits)}
-//     , _states{_unsafe_states.empty()
-//                   ? concatenate(generate_states(batched, other, number_spins, hamming_weight))
-//                   : std::move(_unsafe_states)}
-//     , _ranges{generate_ranges(_states, bits, _shift)}
-// {}
+    auto states = std::vector<std::vector<uint64_t>>(number_sectors);
+    for (auto s = size_t{0}; s < number_sectors; ++s) {
+        auto size = size_t{0};
+        for (auto i = size_t{0}; i < ranges.size(); ++i) {
+            size += chunks[i * number_sectors + s].size();
+        }
+        states[s].reserve(size);
+        for (auto i = size_t{0}; i < ranges.size(); ++i) {
+            auto& chunk = chunks[i * number_sectors + s];
+            states[s].insert(std::end(states[s]), std::begin(chunk), std::end(chunk));
+            chunk = std::vector<uint64_t>{};
+        }
+    }
+    return states;
+}
 
-basis_cache_t::basis_cache_t(basis_base_t const& header, small_basis_t const& payload,
-                             std::vector<uint64_t> _unsafe_states)
-    : _shift{make_shift(header.number_spins, bits)}
-    , _states{_unsafe_states.empty() ? concatenate(generate_states(header, payload))
-                                     : std::move(_unsafe_states)}
-    , _ranges{generate_ranges(_states, bits, _shift)}
-    , _ranges_v2{generate_ranges_v2(_states, bits, _shift)}
+combinatorial_index_t::combinatorial_index_t(unsigned const                number_spins,
+                                             std::optional<unsigned> const hamming_weight)
+    : _number_spins{number_spins}, _hamming_weight{hamming_weight}, _number_states{}, _binomials{}
+{
+    LATTICE_SYMMETRIES_CHECK(0 < number_spins && number_spins <= 64, "invalid number of spins");
+    if (!hamming_weight.has_value()) {
+        LATTICE_SYMMETRIES_CHECK(number_spins < 64, "too many states");
+        _number_states = uint64_t{1} << number_spins;
+        return;
+    }
+    LATTICE_SYMMETRIES_CHECK(*hamming_weight <= number_spins, "invalid hamming weight");
+    // Pascal's triangle; we only need rows up to the Hamming weight
+    auto const rows = *hamming_weight + 1U;
+    _binomials.resize(rows * 65U);
+    for (auto n = 0U; n <= 64U; ++n) {
+        _binomials[n] = 1U;
+    }
+    for (auto k = 1U; k < rows; ++k) {
+        for (auto n = k; n <= 64U; ++n) {
+            _binomials[k * 65U + n] = _binomials[(k - 1) * 65U + (n - 1)] + binomial(n - 1, k);
+        }
+    }
+    _number_states = binomial(number_spins, *hamming_weight);
+}
+
+auto combinatorial_index_t::binomial(unsigned const n, unsigned const k) const noexcept -> uint64_t
+{
+    LATTICE_SYMMETRIES_ASSERT(n <= 64U && k * 65U + n < _binomials.size(), "index out of bounds");
+    return _binomials[k * 65U + n];
+}
+
+auto combinatorial_index_t::rank(uint64_t x, uint64_t* out) const noexcept -> ls_error_code
+{
+    if (_number_spins < 64U && (x >> _number_spins) != 0) { return LS_NOT_A_REPRESENTATIVE; }
+    if (!_hamming_weight.has_value()) {
+        *out = x;
+        return LS_SUCCESS;
+    }
+    if (popcount(x) != *_hamming_weight) { return LS_NOT_A_REPRESENTATIVE; }
+    auto r = uint64_t{0};
+    for (auto k = 1U; x != 0; ++k, x &= x - 1U) {
+        r += binomial(static_cast<unsigned>(__builtin_ctzl(x)), k);
+    }
+    *out = r;
+    return LS_SUCCESS;
+}
+
+auto combinatorial_index_t::unrank(uint64_t index) const noexcept -> uint64_t
 {
-    for (auto i = uint64_t{0}; i < _ranges.size(); ++i) {
-        LATTICE_SYMMETRIES_CHECK(_ranges[i].second == _ranges_v2[i + 1] - _ranges_v2[i], nullptr);
-        if (_ranges[i].second != 0) {
-            LATTICE_SYMMETRIES_CHECK(_ranges[i].first == _ranges_v2[i], nullptr);
+    LATTICE_SYMMETRIES_ASSERT(index < _number_states, "index out of bounds");
+    if (!_hamming_weight.has_value()) { return index; }
+    auto x = uint64_t{0};
+    auto n = _number_spins;
+    for (auto k = *_hamming_weight; k > 0; --k) {
+        // Find the largest n such that binomial(n, k) <= index
+        do {
+            --n;
+        } while (binomial(n, k) > index);
+        x |= uint64_t{1} << n;
+        index -= binomial(n, k);
+    }
+    return x;
+}
+
+namespace {
+    auto make_ranks(unsigned const low_bits, std::optional<unsigned> const hamming_weight)
+        -> std::vector<uint32_t>
+    {
+        std::vector<uint32_t> ranks(uint64_t{1} << low_bits);
+        if (!hamming_weight.has_value()) {
+            std::iota(std::begin(ranks), std::end(ranks), uint32_t{0});
+            return ranks;
         }
+        // Low halves with the same Hamming weight are enumerated in increasing order
+        std::array<uint32_t, 65> counts{};
+        for (auto low = uint64_t{0}; low < ranks.size(); ++low) {
+            ranks[low] = counts[popcount(low)]++;
+        }
+        return ranks;
+    }
+
+    auto make_capacities(unsigned const low_bits) -> std::vector<uint64_t>
+    {
+        std::vector<uint64_t> capacities(low_bits + 1U);
+        for (auto low = uint64_t{0}; low < (uint64_t{1} << low_bits); ++low) {
+            ++capacities[popcount(low)];
+        }
+        return capacities;
+    }
+} // namespace
+
+lin_index_t::lin_index_t(unsigned const number_spins, std::optional<unsigned> const hamming_weight)
+    : _low_bits{number_spins / 2U}
+    , _hamming_weight{hamming_weight}
+    , _offsets((uint64_t{1} << (number_spins - _low_bits)) + 1U)
+    , _ranks{make_ranks(_low_bits, hamming_weight)}
+    , _capacities{make_capacities(_low_bits)}
+{
+    LATTICE_SYMMETRIES_CHECK(0 < number_spins && number_spins <= max_number_spins,
+                             "invalid number of spins");
+    // Every block is full
+    for (auto high = uint64_t{0}; high + 1U < _offsets.size(); ++high) {
+        _offsets[high + 1U] = _offsets[high] + capacity(high);
     }
-    LATTICE_SYMMETRIES_CHECK(_ranges_v2[_ranges.size()] == _states.size(), nullptr);
 }
 
-auto basis_cache_t::states() const noexcept -> tcb::span<uint64_t const> { return _states; }
+lin_index_t::lin_index_t(unsigned const number_spins, std::optional<unsigned> const hamming_weight,
+                         tcb::span<uint64_t const> states)
+    : _low_bits{number_spins / 2U}
+    , _hamming_weight{hamming_weight}
+    , _offsets((uint64_t{1} << (number_spins - _low_bits)) + 1U)
+    , _ranks{make_ranks(_low_bits, hamming_weight)}
+    , _capacities{make_capacities(_low_bits)}
+{
+    LATTICE_SYMMETRIES_CHECK(0 < number_spins && number_spins <= max_number_spins,
+                             "invalid number of spins");
+    for (auto const x : states) {
+        ++_offsets[(x >> _low_bits) + 1U];
+    }
+    std::partial_sum(std::begin(_offsets), std::end(_offsets), std::begin(_offsets));
+}
 
-auto basis_cache_t::number_states() const noexcept -> uint64_t { return _states.size(); }
+auto lin_index_t::capacity(uint64_t const high) const noexcept -> uint64_t
+{
+    if (!_hamming_weight.has_value()) { return uint64_t{1} << _low_bits; }
+    auto const weight = popcount(high);
+    if (weight > *_hamming_weight || *_hamming_weight - weight > _low_bits) { return 0U; }
+    return _capacities[*_hamming_weight - weight];
+}
 
-auto basis_cache_t::index_v2(uint64_t const x, uint64_t* out) const noexcept -> ls_error_code
+auto lin_index_t::index(uint64_t const x, tcb::span<uint64_t const> states, uint64_t* out) const
+    noexcept -> ls_error_code
 {
-    auto const  size  = uint64_t{1} << bits;
-    auto const  mask  = size - 1;
-    auto const  i     = (x >> _shift) & mask;
-    auto const* first = _states.data() + _ranges_v2[i];
-    auto const* last  = _states.data() + _ranges_v2[i + 1];
-    if constexpr (false) {
-        auto const index = std::lower_bound(first, last, x);
-        if (index == last || *index != x) { return LS_NOT_A_REPRESENTATIVE; }
-        *out = static_cast<uint64_t>(index - _states.data());
+    auto const high = x >> _low_bits;
+    if (high + 1U >= _offsets.size()) { return LS_NOT_A_REPRESENTATIVE; }
+    auto const first = _offsets[high];
+    auto const count = _offsets[high + 1U] - first;
+    if (count != 0 && count == capacity(high)) {
+        if (_hamming_weight.has_value() && popcount(x) != *_hamming_weight) {
+            return LS_NOT_A_REPRESENTATIVE;
+        }
+        *out = first + _ranks[x & ((uint64_t{1} << _low_bits) - 1U)];
         return LS_SUCCESS;
     }
+    auto const i = search_sorted(states.data() + first, count, x);
+    if (i == count) { return LS_NOT_A_REPRESENTATIVE; }
+    *out = first + i;
+    return LS_SUCCESS;
+}
+
+namespace {
+    /// Finalizer of MurmurHash3 applied to x mixed with the level number.
+    constexpr auto hash_64(uint64_t x, unsigned const level) noexcept -> uint64_t
+    {
+        x += 0x9E3779B97F4A7C15ULL * (level + 1U);
+        x ^= x >> 33U;
+        x *= 0xFF51AFD7ED558CCDULL;
+        x ^= x >> 33U;
+        x *= 0xC4CEB9FE1A85EC53ULL;
+        x ^= x >> 33U;
+        return x;
+    }
+
+    __extension__ typedef unsigned __int128 uint128_t; // NOLINT(modernize-use-using)
+
+    /// Maps a hash to [0, n) without division.
+    constexpr auto reduce(uint64_t const hash, uint64_t const n) noexcept -> uint64_t
+    {
+        return static_cast<uint64_t>((static_cast<uint128_t>(hash) * n) >> 64U);
+    }
+} // namespace
+
+perfect_hash_t::perfect_hash_t(tcb::span<uint64_t const> states)
+    : _bits{}, _levels{0}, _ranks{}, _fallback{}, _indices(states.size())
+{
+    auto keys = std::vector<uint64_t>(std::begin(states), std::end(states));
+    for (auto level = 0U; !keys.empty() && level < max_levels; ++level) {
+        auto const number_words = std::max<uint64_t>(
+            1U, static_cast<uint64_t>(gamma * static_cast<double>(keys.size())) / 64U + 1U);
+        auto const number_bits  = 64U * number_words;
+        auto       hits         = std::vector<uint64_t>(number_words);
+        auto       collisions   = std::vector<uint64_t>(number_words);
+#pragma omp parallel for schedule(static) default(none)                                            \
+    firstprivate(level, number_bits) shared(keys, hits, collisions)
+        for (auto i = uint64_t{0}; i < keys.size(); ++i) {
+            auto const p   = reduce(hash_64(keys[i], level), number_bits);
+            auto const bit = uint64_t{1} << (p % 64U);
+            if ((__atomic_fetch_or(&hits[p / 64U], bit, __ATOMIC_RELAXED) & bit) != 0) {
+                __atomic_fetch_or(&collisions[p / 64U], bit, __ATOMIC_RELAXED);
+            }
+        }
+        for (auto w = uint64_t{0}; w < number_words; ++w) {
+            hits[w] &= ~collisions[w];
+        }
+        // Keys which collided are passed on to the next level
+        auto remaining = std::vector<uint64_t>{};
+#pragma omp parallel default(none) firstprivate(level, number_bits) shared(keys, hits, remaining)
+        {
+            auto local = std::vector<uint64_t>{};
+#pragma omp for schedule(static) nowait
+            for (auto i = uint64_t{0}; i < keys.size(); ++i) {
+                auto const p = reduce(hash_64(keys[i], level), number_bits);
+                if (!test_bit(hits[p / 64U], static_cast<unsigned>(p % 64U))) {
+                    local.push_back(keys[i]);
+                }
+            }
+#pragma omp critical
+            remaining.insert(std::end(remaining), std::begin(local), std::end(local));
+        }
+        _bits.insert(std::end(_bits), std::begin(hits), std::end(hits));
+        _levels.push_back(_bits.size());
+        keys = std::move(remaining);
+    }
+    std::sort(std::begin(keys), std::end(keys));
+    _fallback = std::move(keys);
+
+    compute_ranks();
+    LATTICE_SYMMETRIES_CHECK(_ranks.back() + _fallback.size() == states.size(),
+                             "perfect hash is not minimal");
+
+    auto status = true;
+#pragma omp parallel for schedule(static) default(none) shared(states, status)
+    for (auto i = uint64_t{0}; i < states.size(); ++i) {
+        uint64_t s; // NOLINT: initialized by slot
+        if (LATTICE_SYMMETRIES_UNLIKELY(!slot(states[i], &s))) {
+#pragma omp atomic write
+            status = false;
+            continue;
+        }
+        _indices[s] = i;
+    }
+    LATTICE_SYMMETRIES_CHECK(status, "perfect hash lost a key");
+}
+
+auto perfect_hash_t::compute_ranks() -> void
+{
+    // Rank directory over blocks of 8 words
+    _ranks.assign((_bits.size() + 7U) / 8U + 1U, 0U);
+    for (auto b = uint64_t{0}; b + 1U < _ranks.size(); ++b) {
+        auto count = uint64_t{0};
+        for (auto w = 8U * b; w < std::min<uint64_t>(8U * (b + 1U), _bits.size()); ++w) {
+            count += popcount(_bits[w]);
+        }
+        _ranks[b + 1U] = _ranks[b] + count;
+    }
+}
+
+auto perfect_hash_t::to_words() const -> std::vector<uint64_t>
+{
+    auto words = std::vector<uint64_t>{_levels.size(), _bits.size(), _fallback.size()};
+    words.reserve(3U + _levels.size() + _bits.size() + _fallback.size() + _indices.size());
+    words.insert(std::end(words), std::begin(_levels), std::end(_levels));
+    words.insert(std::end(words), std::begin(_bits), std::end(_bits));
+    words.insert(std::end(words), std::begin(_fallback), std::end(_fallback));
+    words.insert(std::end(words), std::begin(_indices), std::end(_indices));
+    return words;
+}
+
+auto perfect_hash_t::from_words(tcb::span<uint64_t const> words, uint64_t const number_states)
+    -> outcome::result<perfect_hash_t>
+{
+    if (words.size() < 3U) { return LS_CACHE_IS_CORRUPT; }
+    auto const number_levels = words[0];
+    auto const number_bits   = words[1];
+    auto const number_keys   = words[2];
+    // Checked one by one such that the sum cannot overflow
+    auto rest = words.size() - 3U;
+    for (auto const n : {number_levels, number_bits, number_keys, number_states}) {
+        if (n > rest) { return LS_CACHE_IS_CORRUPT; }
+        rest -= n;
+    }
+    if (rest != 0 || number_levels == 0 || number_levels > max_levels + 1U) {
+        return LS_CACHE_IS_CORRUPT;
+    }
+
+    auto const* first = words.data() + 3U;
+    auto const  take  = [&first](uint64_t const n) {
+        auto table = std::vector<uint64_t>(first, first + n);
+        first += n;
+        return table;
+    };
+    auto hash      = perfect_hash_t{};
+    hash._levels   = take(number_levels);
+    hash._bits     = take(number_bits);
+    hash._fallback = take(number_keys);
+    hash._indices  = take(number_states);
+    if (hash._levels.front() != 0 || hash._levels.back() != number_bits
+        || !std::is_sorted(std::begin(hash._levels), std::end(hash._levels))
+        || !std::is_sorted(std::begin(hash._fallback), std::end(hash._fallback))
+        || std::any_of(std::begin(hash._indices), std::end(hash._indices),
+                       [number_states](auto const i) { return i >= number_states; })) {
+        return LS_CACHE_IS_CORRUPT;
+    }
+    hash.compute_ranks();
+    if (hash._ranks.back() + number_keys != number_states) { return LS_CACHE_IS_CORRUPT; }
+    return outcome::success(std::move(hash));
+}
+
+auto perfect_hash_t::slot(uint64_t const x, uint64_t* out) const noexcept -> bool
+{
+    for (auto level = 0U; level + 1U < _levels.size(); ++level) {
+        auto const first = _levels[level];
+        auto const p     = 64U * first
+                       + reduce(hash_64(x, level), 64U * (_levels[level + 1U] - first));
+        auto const w     = p / 64U;
+        auto const word  = _bits[w];
+        if (test_bit(word, static_cast<unsigned>(p % 64U))) {
+            auto rank = _ranks[w / 8U];
+            for (auto v = w / 8U * 8U; v < w; ++v) {
+                rank += popcount(_bits[v]);
+            }
+            auto const mask = (uint64_t{1} << (p % 64U)) - 1U;
+            *out            = rank + popcount(word & mask);
+            return true;
+        }
+    }
+    auto const i = std::lower_bound(std::begin(_fallback), std::end(_fallback), x);
+    if (i == std::end(_fallback) || *i != x) { return false; }
+    *out = _ranks.back() + static_cast<uint64_t>(i - std::begin(_fallback));
+    return true;
+}
+
+auto perfect_hash_t::index(uint64_t const x, tcb::span<uint64_t const> states, uint64_t* out) const
+    noexcept -> ls_error_code
+{
+    uint64_t s; // NOLINT: initialized by slot
+    if (!slot(x, &s)) { return LS_NOT_A_REPRESENTATIVE; }
+    auto const i = _indices[s];
+    // Spin configurations which are not representatives are also mapped to some slot
+    if (states[i] != x) { return LS_NOT_A_REPRESENTATIVE; }
+    *out = i;
+    return LS_SUCCESS;
+}
+
+namespace {
+    constexpr auto max_tree_depth = 16U;
+
+    /// Computes the number of nodes in every level of the tree over \p n states (top level
+    /// first) and returns the number of levels.
+    auto tree_levels(uint64_t const n, std::array<uint64_t, max_tree_depth>& sizes) noexcept
+        -> unsigned
+    {
+        constexpr auto fanout = uint64_t{bucket_tree_t::fanout};
+        auto           depth  = 0U;
+        auto           count  = (n + fanout - 1U) / fanout; // number of leaves
+        do {
+            count          = (count + fanout - 1U) / fanout;
+            sizes[depth++] = count;
+        } while (count > 1U);
+        std::reverse(std::begin(sizes), std::begin(sizes) + depth);
+        return depth;
+    }
+} // namespace
+
+bucket_tree_t::bucket_tree_t(tcb::span<uint64_t const> states, tcb::span<uint64_t const> ranges)
+    : _nodes{}, _roots(ranges.size() - 1U, ~uint64_t{0})
+{
+    auto total = uint64_t{0};
+    for (auto i = uint64_t{0}; i < _roots.size(); ++i) {
+        auto const n = ranges[i + 1U] - ranges[i];
+        if (n < min_bucket_size) { continue; }
+        std::array<uint64_t, max_tree_depth> sizes; // NOLINT: initialized by tree_levels
+        auto const depth = tree_levels(n, sizes);
+        _roots[i]        = total;
+        total            = std::accumulate(std::begin(sizes), std::begin(sizes) + depth, total);
+    }
+    _nodes.resize(total);
+
+#pragma omp parallel for schedule(dynamic, 1) default(none) shared(states, ranges)
+    for (auto i = uint64_t{0}; i < _roots.size(); ++i) {
+        if (_roots[i] == ~uint64_t{0}) { continue; }
+        auto const first         = ranges[i];
+        auto const n             = ranges[i + 1U] - first;
+        auto const number_leaves = (n + fanout - 1U) / fanout;
+        std::array<uint64_t, max_tree_depth> sizes; // NOLINT: initialized by tree_levels
+        auto const depth  = tree_levels(n, sizes);
+        auto*      node   = _nodes.data() + _roots[i];
+        // Number of leaves below a child of a node of the current level
+        auto       stride = uint64_t{1};
+        for (auto l = 1U; l < depth; ++l) {
+            stride *= fanout;
+        }
+        for (auto l = 0U; l < depth; ++l, stride /= fanout) {
+            for (auto k = uint64_t{0}; k < sizes[l]; ++k, ++node) {
+                for (auto c = 0U; c < fanout; ++c) {
+                    auto const leaf = (fanout * k + c) * stride;
+                    node->keys[c]   = leaf < number_leaves ? states[first + fanout * leaf]
+                                                           : ~uint64_t{0};
+                }
+            }
+        }
+    }
+}
+
+auto bucket_tree_t::search(uint64_t const x, uint64_t const i, tcb::span<uint64_t const> states,
+                           uint64_t const* ranges) const noexcept -> uint64_t
+{
+    auto const first = ranges[i];
+    auto const n     = ranges[i + 1U] - first;
+    if (_roots[i] == ~uint64_t{0}) { return first + search_sorted(states.data() + first, n, x); }
+
+    std::array<uint64_t, max_tree_depth> sizes; // NOLINT: initialized by tree_levels
+    auto const depth         = tree_levels(n, sizes);
+    auto const number_leaves = (n + fanout - 1U) / fanout;
+    auto const* level        = _nodes.data() + _roots[i];
+    auto        k            = uint64_t{0};
+    for (auto l = 0U; l < depth; ++l) {
+        auto const& node = level[k];
+        // The first key is skipped: if x is smaller, it is not in this bucket at all and the
+        // search in the first leaf will fail
+        auto c = 0U;
+        for (auto j = 1U; j < fanout; ++j) {
+            c += static_cast<unsigned>(node.keys[j] <= x);
+        }
+        level += sizes[l];
+        // Padding keys are ~0, which only matters when x is ~0 itself
+        auto const next_size = l + 1U < depth ? sizes[l + 1U] : number_leaves;
+        k                    = std::min(fanout * k + c, next_size - 1U);
+        auto const* next     = l + 1U < depth ? static_cast<void const*>(level + k)
+                                              : static_cast<void const*>(states.data() + first
+                                                                         + fanout * k);
+        __builtin_prefetch(next);
+        __builtin_prefetch(static_cast<char const*>(next) + 64);
+    }
+    auto const offset = fanout * k;
+    auto const count  = std::min<uint64_t>(fanout, n - offset);
+    auto const j      = search_sorted(states.data() + first + offset, count, x);
+    return j == count ? first + n : first + offset + j;
+}
+
+compressed_states_t::compressed_states_t(tcb::span<uint64_t const> states)
+    : _number_states{states.size()}, _first{}, _offsets{}, _packed{}
+{
+    auto const number_blocks = (states.size() + block_size - 1) / block_size;
+    _first.resize(number_blocks);
+    _offsets.resize(number_blocks + 1);
+    for (auto b = uint64_t{0}; b < number_blocks; ++b) {
+        auto const first = states[b * block_size];
+        auto const last  = states[std::min((b + 1) * block_size, states.size()) - 1];
+        auto const width =
+            last == first ? 0U : 64U - static_cast<unsigned>(__builtin_clzl(last - first));
+        _first[b] = first;
+        // A full block of 64 elements with w bits each occupies w words
+        _offsets[b + 1] = _offsets[b] + width;
+    }
+    // One extra word so that state() can always read two consecutive words
+    _packed.resize(_offsets.back() + 1);
+
+#pragma omp parallel for schedule(static) default(none) firstprivate(number_blocks) shared(states)
+    for (auto b = uint64_t{0}; b < number_blocks; ++b) {
+        auto const width = static_cast<unsigned>(_offsets[b + 1] - _offsets[b]);
+        if (width == 0U) { continue; }
+        auto* const words = _packed.data() + _offsets[b];
+        auto const  count = std::min(block_size, states.size() - b * block_size);
+        for (auto j = uint64_t{0}; j < count; ++j) {
+            auto const x     = states[b * block_size + j] - _first[b];
+            auto const pos   = j * width;
+            auto const shift = pos % 64U;
+            words[pos / 64U] |= x << shift;
+            if (shift + width > 64U) { words[pos / 64U + 1U] |= x >> (64U - shift); }
+        }
+    }
+}
+
+auto compressed_states_t::state(uint64_t const index) const noexcept -> uint64_t
+{
+    LATTICE_SYMMETRIES_ASSERT(index < _number_states, "index out of bounds");
+    auto const b     = index / block_size;
+    auto const width = _offsets[b + 1] - _offsets[b];
+    if (width == 0U) { return _first[b]; }
+    auto const  pos   = (index % block_size) * width;
+    auto const  shift = pos % 64U;
+    auto const* words = _packed.data() + _offsets[b] + pos / 64U;
+    auto        x     = words[0] >> shift;
+    // Branch-free: when shift == 0, the second word is not needed and must not be mixed in
+    x |= (words[1] << (63U - shift)) << 1U;
+    auto const mask = width == 64U ? ~uint64_t{0} : ((uint64_t{1} << width) - 1U);
+    return _first[b] + (x & mask);
+}
+
+auto compressed_states_t::unpack(uint64_t const b, uint64_t* out) const noexcept -> uint64_t
+{
+    auto const count = std::min(block_size, _number_states - b * block_size);
+    auto const width = static_cast<unsigned>(_offsets[b + 1] - _offsets[b]);
+    if (width == 0U) { std::fill(out, out + count, _first[b]); }
     else {
-        auto const n     = static_cast<uint64_t>(last - first);
-        auto const index = search_sorted(first, n, x);
-        if (index == n) { return LS_NOT_A_REPRESENTATIVE; }
-        *out = _ranges_v2[i] + index;
-        return LS_SUCCESS;
+        unpack_block(_packed.data() + _offsets[b], width, _first[b], count, out);
     }
+    return count;
+}
+
+auto compressed_states_t::search(uint64_t const x, uint64_t const first, uint64_t const last) const
+    noexcept -> uint64_t
+{
+    if (first == last) { return last; }
+    // States are sorted, so x can only be in the last block which starts at or before it
+    auto const first_block = first / block_size;
+    auto const last_block  = (last - 1) / block_size + 1;
+    auto const it          = std::upper_bound(_first.data() + first_block,
+                                     _first.data() + last_block, x);
+    if (it == _first.data() + first_block) { return last; }
+    auto const b = static_cast<uint64_t>(it - _first.data()) - 1;
+
+    alignas(64) std::array<uint64_t, block_size> buffer; // NOLINT: initialized by unpack
+    auto const count = unpack(b, buffer.data());
+    auto const begin = std::max(first, b * block_size);
+    auto const end   = std::min(last, b * block_size + count);
+    auto const j     = search_sorted(buffer.data() + (begin - b * block_size), end - begin, x);
+    return j == end - begin ? last : begin + j;
+}
+
+auto compressed_states_t::decode() const -> std::vector<uint64_t>
+{
+    auto       states        = std::vector<uint64_t>(_number_states);
+    auto const number_blocks = _first.size();
+#pragma omp parallel for schedule(static) default(none) firstprivate(number_blocks) shared(states)
+    for (auto b = uint64_t{0}; b < number_blocks; ++b) {
+        unpack(b, states.data() + b * block_size);
+    }
+    return states;
+}
+
+auto is_dense(basis_base_t const& header) noexcept -> bool
+{
+    return !header.has_symmetries
+           && (header.hamming_weight.has_value() || header.number_spins < 64U);
+}
+
+namespace {
+    auto generate_states(combinatorial_index_t const& ranking) -> std::vector<uint64_t>
+    {
+        auto const hamming_weight = ranking.hamming_weight();
+        auto       states         = std::vector<uint64_t>(ranking.number_states());
+        auto const number_chunks  = 100U * static_cast<uint64_t>(omp_get_max_threads());
+        auto const chunk_size     = std::max(states.size() / number_chunks, uint64_t{1});
+#pragma omp parallel for schedule(dynamic, 1) default(none)                                        \
+    firstprivate(hamming_weight, chunk_size) shared(ranking, states)
+        for (auto first = uint64_t{0}; first < states.size(); first += chunk_size) {
+            auto const last = std::min(first + chunk_size, states.size());
+            // Unrank only the first state of the chunk, the rest is cheaper to enumerate
+            auto x        = ranking.unrank(first);
+            states[first] = x;
+            for (auto i = first + 1; i < last; ++i) {
+                x = hamming_weight.has_value() ? next_state<true>(x) : next_state<false>(x);
+                states[i] = x;
+            }
+        }
+        return states;
+    }
+} // namespace
+
+basis_cache_t::basis_cache_t(basis_base_t const& header, small_basis_t const& payload,
+                             states_buffer_t _unsafe_states)
+    : basis_cache_t{header, payload,
+                    cache_file_t{std::move(_unsafe_states), 0U, 0U, {}, {}, std::nullopt}}
+{}
+
+basis_cache_t::basis_cache_t(basis_base_t const& header, small_basis_t const& payload,
+                             cache_file_t file)
+    : _ranking{file.states.empty() && is_dense(header)
+                   ? std::optional{combinatorial_index_t{header.number_spins,
+                                                         header.hamming_weight}}
+                   : std::nullopt}
+    , _lin{}
+    , _compressed{}
+    , _hash{std::move(file.hash)}
+    , _tree{}
+    , _bits{file.bits}
+    , _shift{file.shift}
+    , _states{!file.states.empty() || _ranking.has_value()
+                  ? std::move(file.states)
+                  : states_buffer_t{generate_states(header, payload)}}
+    , _states_are_released{false}
+    , _states_are_ready{}
+    , _ranges{}
+    , _numa_policy{payload.numa_policy}
+    , _replicate_buckets{payload.replicate_buckets}
+    , _ranges_replicas{}
+    , _norms{std::move(file.norms)}
+{
+    if (!_states.is_mapped()) { _states = place(_states.release(), _numa_policy); }
+    if (!file.ranges.empty()) {
+        _ranges = place(std::move(file.ranges), _numa_policy);
+        if (_replicate_buckets) { _ranges_replicas = replicated_table_t{_ranges}; }
+    }
+    set_index_type(header, payload.index_type);
+    // Nobody could have obtained a reference to _states yet, so it is safe to release them
+    if (_compressed.has_value()) {
+        _states              = std::vector<uint64_t>{};
+        _states_are_released = true;
+    }
+}
+
+auto basis_cache_t::set_index_type(basis_base_t const& header, ls_index_type const type) -> void
+{
+    // Other indices need the uncompressed list of representatives
+    if (type != LS_INDEX_COMPRESSED && _states_are_released) { static_cast<void>(states()); }
+    if (type == LS_INDEX_LIN) {
+        _compressed = std::nullopt;
+        _hash       = std::nullopt;
+        _tree       = std::nullopt;
+        _lin        = _ranking.has_value()
+                          ? lin_index_t{header.number_spins, header.hamming_weight}
+                          : lin_index_t{header.number_spins, header.hamming_weight, _states};
+        return;
+    }
+    _lin = std::nullopt;
+    // There is nothing to compress or hash for dense bases
+    if (_ranking.has_value()) { return; }
+    if (type != LS_INDEX_HASH) { _hash = std::nullopt; }
+    else if (!_hash.has_value()) {
+        _hash.emplace(_states);
+    }
+    // The B+tree replaces the search within a bucket, so it wants few large buckets
+    auto const bits =
+        type == LS_INDEX_BTREE
+            ? choose_bucket_bits(header.number_spins, _states.size(), bucket_tree_t::bucket_size)
+            : choose_bucket_bits(header.number_spins, _states.size());
+    // Ranges loaded from a file are kept unless they are too fine for the B+tree
+    if (_ranges.empty() || (type == LS_INDEX_BTREE && bits < _bits)) {
+        _bits   = bits;
+        _shift  = make_shift(header.number_spins, _bits);
+        _ranges = place(generate_ranges(_states, _bits, _shift), _numa_policy);
+        if (_replicate_buckets) { _ranges_replicas = replicated_table_t{_ranges}; }
+        _tree = std::nullopt;
+    }
+    if (type != LS_INDEX_COMPRESSED) { _compressed = std::nullopt; }
+    else if (!_compressed.has_value()) {
+        _compressed.emplace(_states);
+    }
+    if (type != LS_INDEX_BTREE) { _tree = std::nullopt; }
+    else if (!_tree.has_value()) {
+        _tree.emplace(_states, _ranges);
+    }
+}
+
+auto basis_cache_t::states() const noexcept -> tcb::span<uint64_t const>
+{
+    if (_ranking.has_value() || _states_are_released) {
+        // NOTE: this is the only place where a dense or compressed basis allocates memory
+        // proportional to the number of states.
+        std::call_once(_states_are_ready, [this]() {
+            _states = _ranking.has_value() ? generate_states(*_ranking) : _compressed->decode();
+        });
+    }
+    return _states;
+}
+
+auto basis_cache_t::number_states() const noexcept -> uint64_t
+{
+    if (_ranking.has_value()) { return _ranking->number_states(); }
+    return _compressed.has_value() ? _compressed->size() : _states.size();
 }
 
 auto basis_cache_t::index(uint64_t const x, uint64_t* out) const noexcept -> ls_error_code
 {
-    if constexpr (false) {
-        auto const& range = _ranges.at(x >> _shift);
-        auto const* first = _states.data() + range.first;
-        auto const* last  = first + range.second;
-        auto const* i     = std::lower_bound(first, last, x);
-        if (i == last || *i != x) { return LS_NOT_A_REPRESENTATIVE; }
-        *out = static_cast<uint64_t>(i - _states.data());
+    if (_lin.has_value()) {
+        // NOTE: for dense bases _states may be materialized concurrently, but _lin never
+        // searches them
+        auto const states = _ranking.has_value() ? tcb::span<uint64_t const>{}
+                                                 : tcb::span<uint64_t const>{_states};
+        return _lin->index(x, states, out);
+    }
+    if (_ranking.has_value()) { return _ranking->rank(x, out); }
+    if (_hash.has_value()) { return _hash->index(x, _states, out); }
+
+    auto const  mask   = (uint64_t{1} << _bits) - 1U;
+    auto const  i      = (x >> _shift) & mask;
+    auto const* ranges = _ranges_replicas.local_or(_ranges.data());
+    if (_compressed.has_value()) {
+        auto const index = _compressed->search(x, ranges[i], ranges[i + 1]);
+        if (index == ranges[i + 1]) { return LS_NOT_A_REPRESENTATIVE; }
+        *out = index;
         return LS_SUCCESS;
     }
-    else {
-        return index_v2(x, out);
+    if (_tree.has_value()) {
+        auto const index = _tree->search(x, i, _states, ranges);
+        if (index == ranges[i + 1]) { return LS_NOT_A_REPRESENTATIVE; }
+        *out = index;
+        return LS_SUCCESS;
+    }
+
+    auto const* first = _states.data() + ranges[i];
+    auto const  n     = ranges[i + 1] - ranges[i];
+    auto const  index = search_sorted(first, n, x);
+    if (index == n) { return LS_NOT_A_REPRESENTATIVE; }
+    *out = ranges[i] + index;
+    return LS_SUCCESS;
+}
+
+auto basis_cache_t::index(uint64_t const count, uint64_t const* spins, uint64_t const spins_stride,
+                          uint64_t* out, uint64_t const out_stride,
+                          std::optional<uint64_t> const sentinel) const noexcept -> ls_error_code
+{
+    if (_lin.has_value() || _ranking.has_value() || _compressed.has_value() || _hash.has_value()
+        || _tree.has_value()) {
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            auto const status = index(spins[i * spins_stride], out + i * out_stride);
+            if (LATTICE_SYMMETRIES_UNLIKELY(status != LS_SUCCESS)) {
+                if (!sentinel.has_value()) { return status; }
+                out[i * out_stride] = *sentinel;
+            }
+        }
+        return LS_SUCCESS;
+    }
+
+    // Enough independent searches to keep the memory system busy
+    constexpr auto batch_size = 16U;
+    auto const     mask       = (uint64_t{1} << _bits) - 1U;
+    auto const*    ranges     = _ranges_replicas.local_or(_ranges.data());
+    auto const*    states     = _states.data();
+    for (auto offset = uint64_t{0}; offset < count; offset += batch_size) {
+        auto const n = static_cast<unsigned>(std::min<uint64_t>(batch_size, count - offset));
+        std::array<uint64_t, batch_size> keys;  // NOLINT: only the first n are used
+        std::array<uint64_t, batch_size> first; // NOLINT: only the first n are used
+        std::array<uint64_t, batch_size> size;  // NOLINT: only the first n are used
+
+        // Stage 1: compute buckets and fetch their bounds
+        for (auto j = 0U; j < n; ++j) {
+            keys[j]  = spins[(offset + j) * spins_stride];
+            first[j] = (keys[j] >> _shift) & mask;
+            __builtin_prefetch(ranges + first[j]);
+        }
+        // Stage 2: fetch the middle element of every bucket
+        for (auto j = 0U; j < n; ++j) {
+            auto const bucket = first[j];
+            first[j]          = ranges[bucket];
+            size[j]           = ranges[bucket + 1] - ranges[bucket];
+            __builtin_prefetch(states + first[j] + size[j] / 2);
+        }
+        // Stage 3: binary searches in lockstep. Every round halves the remaining range of each
+        // key and prefetches its next probe, so at most n cache misses are in flight at once
+        for (auto active = true; active;) {
+            active = false;
+            for (auto j = 0U; j < n; ++j) {
+                if (size[j] <= 1U) { continue; }
+                auto const half = size[j] / 2;
+                first[j] += states[first[j] + half] <= keys[j] ? half : 0U;
+                size[j] -= half;
+                __builtin_prefetch(states + first[j] + size[j] / 2);
+                active = true;
+            }
+        }
+        for (auto j = 0U; j < n; ++j) {
+            auto* const result = out + (offset + j) * out_stride;
+            if (LATTICE_SYMMETRIES_LIKELY(size[j] == 1U && states[first[j]] == keys[j])) {
+                *result = first[j];
+            }
+            else if (sentinel.has_value()) {
+                *result = *sentinel;
+            }
+            else {
+                return LS_NOT_A_REPRESENTATIVE;
+            }
+        }
     }
+    return LS_SUCCESS;
+}
+
+auto basis_cache_t::index_sorted(uint64_t const count, uint64_t const* spins,
+                                 uint64_t const spins_stride, uint64_t* out,
+                                 uint64_t const out_stride,
+                                 std::optional<uint64_t> const sentinel) const noexcept
+    -> ls_error_code
+{
+    for (auto i = uint64_t{1}; i < count; ++i) {
+        if (spins[i * spins_stride] < spins[(i - 1U) * spins_stride]) {
+            return LS_INVALID_ARGUMENT;
+        }
+    }
+    // There is no sorted list to walk
+    if (_ranking.has_value() || _states_are_released) {
+        return index(count, spins, spins_stride, out, out_stride, sentinel);
+    }
+    if (count == 0) { return LS_SUCCESS; }
+
+    auto const* states = _states.data();
+    auto const  size   = _states.size();
+    // Start at the bucket of the first key if we have buckets (Lin tables do not use them)
+    auto position = uint64_t{0};
+    if (!_ranges.empty()) {
+        auto const mask = (uint64_t{1} << _bits) - 1U;
+        position        = _ranges[(spins[0] >> _shift) & mask];
+    }
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        auto const x = spins[i * spins_stride];
+        // Galloping search for the first state which is not less than x
+        auto step = uint64_t{1};
+        auto last = position;
+        while (last < size && states[last] < x) {
+            position = last + 1U;
+            last     = position + step;
+            step *= 2U;
+        }
+        last     = std::min(last, size);
+        position = static_cast<uint64_t>(
+            std::lower_bound(states + position, states + last, x) - states);
+
+        auto* const result = out + i * out_stride;
+        if (LATTICE_SYMMETRIES_LIKELY(position < size && states[position] == x)) {
+            *result = position;
+        }
+        else if (sentinel.has_value()) {
+            *result = *sentinel;
+        }
+        else {
+            return LS_NOT_A_REPRESENTATIVE;
+        }
+    }
+    return LS_SUCCESS;
+}
+
+auto basis_cache_t::state(uint64_t const index, uint64_t* out) const noexcept -> ls_error_code
+{
+    if (LATTICE_SYMMETRIES_UNLIKELY(index >= number_states())) { return LS_INVALID_ARGUMENT; }
+    *out = _ranking.has_value()      ? _ranking->unrank(index)
+           : _compressed.has_value() ? _compressed->state(index)
+                                     : _states[index];
+    return LS_SUCCESS;
 }
 
 namespace {
-    struct close_file_fn_t {
-        // NOLINTNEXTLINE: we're not using GSL, so no gsl::owner
-        auto operator()(std::FILE* file) noexcept -> void { std::fclose(file); }
-    };
+    /// Calls \p visit for every subset of m elements of [0, n) which has t as its largest element.
+    template <class Visitor>
+    auto visit_subsets(unsigned const n, unsigned const m, unsigned const t, Visitor&& visit)
+        -> void
+    {
+        LATTICE_SYMMETRIES_ASSERT(0 < m && m <= t + 1U && t < n, "invalid subset");
+        // positions[0] < positions[1] < ... < positions[m - 1] == t
+        auto positions = std::vector<unsigned>(m);
+        std::iota(std::begin(positions), std::end(positions), 0U);
+        positions.back() = t;
+        auto const r     = m - 1U;
+        for (;;) {
+            visit(tcb::span<unsigned const>{positions});
+            // Advance the first r positions to the next combination of r elements of [0, t)
+            auto i = r;
+            while (i > 0 && positions[i - 1U] == t - r + i - 1U) {
+                --i;
+            }
+            if (i == 0) { break; }
+            ++positions[i - 1U];
+            for (auto j = i; j < r; ++j) {
+                positions[j] = positions[j - 1U] + 1U;
+            }
+        }
+    }
 
-    auto open_file(char const* filename, char const* mode) noexcept
-        -> outcome::result<std::unique_ptr<std::FILE, close_file_fn_t>>
+    /// Generates the sorted list of representatives of a big basis with a fixed Hamming weight.
+    ///
+    /// Spin configurations are enumerated as subsets of positions of the minority spins, i.e. the
+    /// work is proportional to binomial(number_spins, hamming_weight) rather than 2^number_spins.
+    /// Tasks are determined by the position of the last minority spin.
+    template <unsigned Words>
+    auto generate_big_states(basis_base_t const& header, big_basis_t const& payload)
+        -> std::vector<uint64_t>
     {
-        // NOLINTNEXTLINE: we're not using GSL, so no gsl::owner
-        auto* p = std::fopen(filename, mode);
-        if (p == nullptr) { return LS_COULD_NOT_OPEN_FILE; }
-        return std::unique_ptr<std::FILE, close_file_fn_t>{p};
+        using key_type = std::array<uint64_t, Words>;
+        auto const number_spins   = header.number_spins;
+        auto const hamming_weight = *header.hamming_weight;
+        // When more than half of the spins are up, we enumerate the positions of spins down
+        auto const complement = 2U * hamming_weight > number_spins;
+        auto const m          = complement ? number_spins - hamming_weight : hamming_weight;
+        ls_bits512 initial; // NOLINT: initial is initialized by set_zero
+        set_zero(initial);
+        if (complement) {
+            for (auto i = 0U; i < number_spins; ++i) {
+                set_bit(initial, i);
+            }
+        }
+
+        auto const to_key = [](ls_bits512 const& x) noexcept {
+            key_type key;
+            std::copy(std::begin(x.words), std::begin(x.words) + Words, std::begin(key));
+            return key;
+        };
+        auto keys = std::vector<key_type>{};
+        if (m == 0) {
+            if (is_representative_512(header, payload, initial)) {
+                keys.push_back(to_key(initial));
+            }
+        }
+        else {
+            auto const number_tasks = number_spins - m + 1U;
+            auto       chunks       = std::vector<std::vector<key_type>>(number_tasks);
+#pragma omp parallel for schedule(dynamic, 1) default(none)                                        \
+    firstprivate(number_spins, m, number_tasks, initial) shared(header, payload, to_key, chunks)
+            for (auto task = 0U; task < number_tasks; ++task) {
+                // Larger tasks go first
+                auto const t   = number_spins - 1U - task;
+                auto&      out = chunks[task];
+                visit_subsets(number_spins, m, t, [&](tcb::span<unsigned const> positions) {
+                    auto x = initial;
+                    for (auto const i : positions) {
+                        toggle_bit(x, i);
+                    }
+                    if (is_representative_512(header, payload, x)) { out.push_back(to_key(x)); }
+                });
+            }
+            auto size = size_t{0};
+            for (auto const& chunk : chunks) {
+                size += chunk.size();
+            }
+            keys.reserve(size);
+            for (auto& chunk : chunks) {
+                keys.insert(std::end(keys), std::begin(chunk), std::end(chunk));
+                chunk = std::vector<key_type>{};
+            }
+        }
+        // std::array compares lexicographically, i.e. in the same order as ls_bits512
+        std::sort(std::begin(keys), std::end(keys));
+
+        auto states = std::vector<uint64_t>(keys.size() * Words);
+        for (auto i = size_t{0}; i < keys.size(); ++i) {
+            std::copy(std::begin(keys[i]), std::end(keys[i]), states.data() + i * Words);
+        }
+        return states;
+    }
+
+    auto number_words(unsigned const number_spins) noexcept -> unsigned
+    {
+        // NOLINTNEXTLINE: 128 and 256 are the supported key widths
+        return number_spins <= 128U ? 2U : number_spins <= 256U ? 4U : 8U;
+    }
+
+    auto generate_big_states(basis_base_t const& header, big_basis_t const& payload)
+        -> std::vector<uint64_t>
+    {
+        switch (number_words(header.number_spins)) {
+        case 2U: return generate_big_states<2U>(header, payload);
+        case 4U: return generate_big_states<4U>(header, payload);
+        default: return generate_big_states<8U>(header, payload);
+        }
     }
 
+    /// Number of leading bits which \p x and \p y have in common.
+    auto common_prefix(uint64_t const* x, uint64_t const* y, unsigned const words) noexcept
+        -> unsigned
+    {
+        for (auto w = 0U; w < words; ++w) {
+            if (x[w] != y[w]) {
+                return 64U * w + static_cast<unsigned>(__builtin_clzl(x[w] ^ y[w]));
+            }
+        }
+        return 64U * words;
+    }
+} // namespace
+
+big_basis_cache_t::big_basis_cache_t(basis_base_t const& header, big_basis_t const& payload)
+    : _words{number_words(header.number_spins)}
+    , _states{generate_big_states(header, payload)}
+    , _prefix{}
+    , _bits{}
+    , _ranges{}
+{
+    auto const total_bits = 64U * _words;
+    auto const count      = number_states();
+    if (count != 0) {
+        // States are sorted, so the prefix shared by the first and the last one is shared by all
+        auto const* last = _states.data() + (count - 1) * _words;
+        _prefix = std::min(common_prefix(_states.data(), last, _words), total_bits - 1U);
+    }
+    _bits = choose_bucket_bits(total_bits - _prefix, count);
+    _ranges.resize((uint64_t{1} << _bits) + 1U);
+    for (auto i = uint64_t{0}; i < count; ++i) {
+        ++_ranges[bucket(_states.data() + i * _words) + 1U];
+    }
+    std::partial_sum(std::begin(_ranges), std::end(_ranges), std::begin(_ranges));
+}
+
+auto big_basis_cache_t::bucket(uint64_t const* x) const noexcept -> uint64_t
+{
+    // Bits [_prefix, _prefix + _bits) of the key counting from the most significant bit of x[0].
+    // Since _prefix + _bits <= 64 * _words, we never need to look past the last word.
+    auto const word  = _prefix / 64U;
+    auto const shift = _prefix % 64U;
+    auto       high  = x[word] << shift;
+    if (shift != 0U && word + 1U < _words) { high |= x[word + 1U] >> (64U - shift); }
+    return high >> (64U - _bits);
+}
+
+auto big_basis_cache_t::index(ls_bits512 const& x, uint64_t* out) const noexcept -> ls_error_code
+{
+    auto const count = number_states();
+    if (count == 0) { return LS_NOT_A_REPRESENTATIVE; }
+    // Spins beyond the key width are never set in representatives
+    for (auto w = _words; w < std::size(x.words); ++w) {
+        if (x.words[w] != 0) { return LS_NOT_A_REPRESENTATIVE; }
+    }
+    auto const* key  = x.words;
+    auto const  less = [words = _words](uint64_t const* a, uint64_t const* b) noexcept {
+        return std::lexicographical_compare(a, a + words, b, b + words);
+    };
+    // x is guaranteed to share _prefix with all representatives only if it lies between them
+    if (less(key, _states.data()) || less(_states.data() + (count - 1) * _words, key)) {
+        return LS_NOT_A_REPRESENTATIVE;
+    }
+
+    auto const i     = bucket(key);
+    auto       first = _ranges[i];
+    auto const last  = _ranges[i + 1];
+    auto       n     = last - first;
+    while (n > 0) {
+        auto const step = n / 2;
+        if (less(_states.data() + (first + step) * _words, key)) {
+            first += step + 1;
+            n -= step + 1;
+        }
+        else {
+            n = step;
+        }
+    }
+    if (first == last || !std::equal(key, key + _words, _states.data() + first * _words)) {
+        return LS_NOT_A_REPRESENTATIVE;
+    }
+    *out = first;
+    return LS_SUCCESS;
+}
+
+auto big_basis_cache_t::state(uint64_t const index, ls_bits512& out) const noexcept
+    -> ls_error_code
+{
+    if (LATTICE_SYMMETRIES_UNLIKELY(index >= number_states())) { return LS_INVALID_ARGUMENT; }
+    set_zero(out);
+    std::copy(_states.data() + index * _words, _states.data() + (index + 1) * _words,
+              std::begin(out.words));
+    return LS_SUCCESS;
+}
+
+namespace {
     auto file_size(char const* filename) noexcept -> uint64_t
     {
         struct stat buf; // NOLINT: buf is initialized by stat
         stat(filename, &buf);
         return static_cast<uint64_t>(buf.st_size);
     }
+
+    constexpr auto cache_header_size = 16U;
+    // NOLINTNEXTLINE: 42 is indeed a magic number, that's why it's used here
+    constexpr auto cache_header_word = uint64_t{0x2A2A2A2A2A2A2A2AULL};
 } // namespace
 
+cache_loader_t::cache_loader_t(std::function<ls_error_code()> task)
+    : _thread{}, _mutex{}, _finished{}, _done{false}, _status{LS_SUCCESS}
+{
+    _thread = std::thread{[this, f = std::move(task)]() {
+        auto const status = f();
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            _status = status;
+            _done.store(true, std::memory_order_release);
+        }
+        _finished.notify_all();
+    }};
+}
+
+cache_loader_t::~cache_loader_t() { _thread.join(); }
+
+auto cache_loader_t::wait_slow() const noexcept -> ls_error_code
+{
+    std::unique_lock<std::mutex> lock{_mutex};
+    _finished.wait(lock, [this]() { return _done.load(std::memory_order_relaxed); });
+    return _status;
+}
+
 auto save_states(tcb::span<uint64_t const> states, char const* filename) -> outcome::result<void>
 {
-    constexpr auto                 chunk_size = uint64_t{4096};
-    constexpr std::array<char, 16> header     = {42, 42, 42, 42, 42, 42, 42, 42,
-                                             42, 42, 42, 42, 42, 42, 42, 42};
-    OUTCOME_TRY(stream, open_file(filename, "wb"));
-    if (std::fwrite(header.data(), sizeof(char), std::size(header), stream.get())
-        != std::size(header)) {
+    auto const temporary = std::string{filename} + ".tmp";
+    auto const write     = [states, &temporary]() -> outcome::result<void> {
+        // The header makes offsets unaligned, so O_DIRECT cannot be used
+        OUTCOME_TRY(file, raw_file_t::create(temporary.c_str(), false));
+        auto const header = std::array<uint64_t, 2>{cache_header_word, cache_header_word};
+        OUTCOME_TRY(file.write(0, header));
+        OUTCOME_TRY(file.write(cache_header_size, states));
+        return file.close();
+    };
+    // If filename exists, it is complete
+    auto const r = write();
+    if (r && std::rename(temporary.c_str(), filename) == 0) { return outcome::success(); }
+    std::remove(temporary.c_str());
+    if (!r) { return r; }
+    return LS_FILE_IO_FAILED;
+}
+
+auto save_states(basis_base_t const& header, small_basis_t const& payload, char const* filename)
+    -> outcome::result<void>
+{
+    OUTCOME_TRY(writer, cache_writer_t::create(filename));
+    OUTCOME_TRY(writer.begin_section(cache_writer_t::states));
+
+    auto const  ranges = make_tasks(header);
+    auto const  pruner = make_pruner(header, payload);
+    auto const* skip   = pruner.has_value() ? &*pruner : nullptr;
+    auto        status = LS_SUCCESS;
+    auto        count  = uint64_t{0};
+#pragma omp parallel default(none) shared(header, payload, ranges, skip, status, writer, count)
+    {
+        // Every thread reuses its own buffer, so at most omp_get_num_threads() chunks are kept in
+        // memory at any point in time.
+        auto states = std::vector<uint64_t>{};
+#pragma omp for ordered schedule(dynamic, 1)
+        for (auto i = size_t{0}; i < ranges.size(); ++i) {
+            auto const [current, bound] = ranges[i];
+            states.clear();
+            generate_states_task(current, bound, header, payload, skip,
+                                 [&states](uint64_t const x) { states.push_back(x); });
+            // Chunks are written in the same order as they appear in ranges, i.e. the file ends
+            // up sorted
+#pragma omp ordered
+            if (status == LS_SUCCESS) {
+                if (writer.append(states)) { count += states.size(); }
+                else {
+                    status = LS_FILE_IO_FAILED;
+                }
+            }
+        }
+    }
+    if (status != LS_SUCCESS) { return status; }
+    // Bucket ranges are not known until all states are generated, so they are recomputed by
+    // load_cache
+    return writer.finish(header, payload, count, 0U, 0U);
+}
+
+mapped_file_t::mapped_file_t(mapped_file_t&& other) noexcept
+    : _data{std::exchange(other._data, nullptr)}, _size{std::exchange(other._size, 0)}
+{}
+
+auto mapped_file_t::operator=(mapped_file_t&& other) noexcept -> mapped_file_t&
+{
+    if (this != &other) {
+        if (_data != nullptr) { ::munmap(_data, _size); }
+        _data = std::exchange(other._data, nullptr);
+        _size = std::exchange(other._size, 0);
+    }
+    return *this;
+}
+
+mapped_file_t::~mapped_file_t()
+{
+    if (_data != nullptr) { ::munmap(_data, _size); }
+}
+
+auto mapped_file_t::open(char const* filename, ls_map_mode const mode)
+    -> outcome::result<mapped_file_t>
+{
+    auto const fd = ::open(filename, O_RDONLY | O_CLOEXEC); // NOLINT: vararg function
+    if (fd < 0) { return LS_COULD_NOT_OPEN_FILE; }
+    struct stat buf; // NOLINT: buf is initialized by fstat
+    if (::fstat(fd, &buf) != 0) {
+        ::close(fd);
         return LS_FILE_IO_FAILED;
     }
-    auto buffer = std::vector<uint64_t>(chunk_size);
-    for (auto first = std::begin(states), last = std::end(states); first != last;) {
-        auto const  count = std::min(chunk_size, static_cast<uint64_t>(std::distance(first, last)));
-        auto const* next  = std::next(first, static_cast<int64_t>(count));
-        std::transform(first, next, std::begin(buffer), [](auto const x) { return htole64(x); });
-        if (std::fwrite(buffer.data(), sizeof(uint64_t), count, stream.get()) != count) {
-            return LS_FILE_IO_FAILED;
-        }
-        // Move forward
-        first = next;
+    auto file = mapped_file_t{};
+    file._size = static_cast<uint64_t>(buf.st_size);
+    // mmap does not support empty mappings
+    if (file._size == 0) {
+        ::close(fd);
+        return LS_CACHE_IS_CORRUPT;
     }
-    return LS_SUCCESS;
+    auto flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+    if (mode == LS_MAP_POPULATE) { flags |= MAP_POPULATE; }
+#endif
+    auto* p = ::mmap(nullptr, file._size, PROT_READ, flags, fd, 0);
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+    if (p == MAP_FAILED) { return LS_FILE_IO_FAILED; }
+    file._data = p;
+    if (mode == LS_MAP_WILLNEED) { ::madvise(p, file._size, MADV_WILLNEED); }
+    return outcome::success(std::move(file));
 }
 
-auto load_states(char const* filename) -> outcome::result<std::vector<uint64_t>>
+states_buffer_t::states_buffer_t(std::vector<uint64_t> states) noexcept
+    : _owned{std::move(states)}, _mapping{}, _data{_owned.data()}, _size{_owned.size()}
+{}
+
+states_buffer_t::states_buffer_t(mapped_file_t mapping, uint64_t const offset) noexcept
+    : _owned{}
+    , _mapping{std::move(mapping)}
+    // NOLINTNEXTLINE: the file contains uint64_t's, and mmap returns page-aligned memory
+    , _data{reinterpret_cast<uint64_t const*>(_mapping.data() + offset)}
+    , _size{(_mapping.size() - offset) / sizeof(uint64_t)}
+{}
+
+states_buffer_t::states_buffer_t(mapped_file_t mapping, uint64_t const offset,
+                                 uint64_t const count) noexcept
+    : states_buffer_t{std::move(mapping), offset}
 {
-    OUTCOME_TRY(stream, open_file(filename, "rb"));
+    _size = std::min(_size, count);
+}
+
+states_buffer_t::states_buffer_t(states_buffer_t&& other) noexcept
+    : _owned{std::move(other._owned)}
+    , _mapping{std::move(other._mapping)}
+    , _data{std::exchange(other._data, nullptr)}
+    , _size{std::exchange(other._size, 0)}
+{}
+
+auto states_buffer_t::operator=(states_buffer_t&& other) noexcept -> states_buffer_t&
+{
+    if (this != &other) {
+        _owned   = std::move(other._owned);
+        _mapping = std::move(other._mapping);
+        _data    = std::exchange(other._data, nullptr);
+        _size    = std::exchange(other._size, 0);
+    }
+    return *this;
+}
+
+auto states_buffer_t::release() -> std::vector<uint64_t>
+{
+    auto states =
+        is_mapped() ? std::vector<uint64_t>(_data, _data + _size) : std::move(_owned);
+    *this = states_buffer_t{};
+    return states;
+}
+
+auto load_states(char const* filename, ls_map_mode const mode)
+    -> outcome::result<states_buffer_t>
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    constexpr auto can_map = true;
+#else
+    constexpr auto can_map = false;
+#endif
+    if (!can_map || mode == LS_MAP_COPY) {
+        OUTCOME_TRY(states, load_states(filename));
+        return outcome::success(states_buffer_t{std::move(states)});
+    }
+    OUTCOME_TRY(file, mapped_file_t::open(filename, mode));
+    constexpr auto header_size = cache_header_size;
+    if (file.size() < header_size || (file.size() - header_size) % sizeof(uint64_t) != 0) {
+        return LS_CACHE_IS_CORRUPT;
+    }
+    // NOLINTNEXTLINE: 42 is indeed a magic number, that's why it's used here
+    if (!std::all_of(file.data(), file.data() + header_size, [](auto const c) { return c == 42; })) {
+        return LS_CACHE_IS_CORRUPT;
+    }
+    return outcome::success(states_buffer_t{std::move(file), header_size});
+}
 
-    auto           size        = file_size(filename);
-    constexpr auto header_size = 16U;
+auto load_states(char const* filename) -> outcome::result<std::vector<uint64_t>>
+{
+    OUTCOME_TRY(file, raw_file_t::open(filename, is_direct_io_enabled()));
+    OUTCOME_TRY(size, file.size());
+    constexpr auto header_size = cache_header_size;
     if (size < header_size) { return LS_CACHE_IS_CORRUPT; }
     size -= header_size;
     if (size % sizeof(uint64_t) != 0) { return LS_CACHE_IS_CORRUPT; }
 
-    std::array<char, header_size> header; // NOLINT: header is initialized by fread
-    if (std::fread(header.data(), sizeof(char), header_size, stream.get()) != std::size(header)) {
-        return LS_FILE_IO_FAILED;
-    }
-    // NOLINTNEXTLINE: 42 is indeed a magic number, that's why it's used here
-    if (!std::all_of(std::begin(header), std::end(header), [](auto const c) { return c == 42; })) {
+    auto header = std::array<uint64_t, 2>{};
+    OUTCOME_TRY(file.read(0, header));
+    if (header[0] != cache_header_word || header[1] != cache_header_word) {
         return LS_CACHE_IS_CORRUPT;
     }
     auto states = std::vector<uint64_t>(size / sizeof(uint64_t));
-    if (std::fread(states.data(), sizeof(uint64_t), states.size(), stream.get()) != states.size()) {
-        return LS_FILE_IO_FAILED;
+    OUTCOME_TRY(file.read(header_size, states));
+    return outcome::success(std::move(states));
+}
+
+namespace {
+    auto file_exists(std::string const& filename) noexcept -> bool
+    {
+        return ::access(filename.c_str(), F_OK) == 0;
+    }
+
+    /// Reads the list of tasks from the manifest or creates a new one. Tasks are stored rather
+    /// than recomputed, because make_tasks depends on the number of threads which may differ
+    /// between runs.
+    auto checkpoint_tasks(basis_base_t const& header, small_basis_t const& payload,
+                          std::string const& filename)
+        -> outcome::result<std::vector<std::pair<uint64_t, uint64_t>>>
+    {
+        auto const hash = fingerprint(header, payload);
+        if (!file_exists(filename)) {
+            auto ranges = make_tasks(header);
+            auto words  = std::vector<uint64_t>{hash};
+            words.reserve(1 + 2 * ranges.size());
+            for (auto const& [first, last] : ranges) {
+                words.push_back(first);
+                words.push_back(last);
+            }
+            OUTCOME_TRY(save_states(words, filename.c_str()));
+            return outcome::success(std::move(ranges));
+        }
+
+        OUTCOME_TRY(words, load_states(filename.c_str()));
+        // Checkpoint belongs to a different basis
+        if (words.size() % 2 != 1 || words[0] != hash) { return LS_CACHE_IS_CORRUPT; }
+        auto ranges = std::vector<std::pair<uint64_t, uint64_t>>{};
+        ranges.reserve(words.size() / 2);
+        for (auto i = size_t{1}; i < words.size(); i += 2) {
+            ranges.emplace_back(words[i], words[i + 1]);
+        }
+        return outcome::success(std::move(ranges));
+    }
+} // namespace
+
+auto generate_states(basis_base_t const& header, small_basis_t const& payload,
+                     char const* directory) -> outcome::result<std::vector<uint64_t>>
+{
+    if (::mkdir(directory, 0755) != 0 && errno != EEXIST) { return LS_COULD_NOT_OPEN_FILE; }
+    auto const prefix = std::string{directory} + '/';
+    OUTCOME_TRY(ranges, checkpoint_tasks(header, payload, prefix + "manifest"));
+    auto const chunk_filename = [&prefix](size_t const i) {
+        return prefix + "chunk_" + std::to_string(i);
+    };
+
+    auto const  pruner = make_pruner(header, payload);
+    auto const* skip   = pruner.has_value() ? &*pruner : nullptr;
+    auto        status = LS_SUCCESS;
+#pragma omp parallel for schedule(dynamic, 1) default(none)                                        \
+    shared(header, payload, ranges, skip, chunk_filename, status)
+    for (auto i = size_t{0}; i < ranges.size(); ++i) {
+        auto const filename = chunk_filename(i);
+        // Finished by a previous run
+        if (file_exists(filename)) { continue; }
+        auto const [current, bound] = ranges[i];
+        auto states                 = std::vector<uint64_t>{};
+        generate_states_task(current, bound, header, payload, skip,
+                             [&states](uint64_t const x) { states.push_back(x); });
+        if (!save_states(states, filename.c_str())) {
+#pragma omp critical
+            status = LS_FILE_IO_FAILED;
+        }
+    }
+    if (status != LS_SUCCESS) { return status; }
+
+    // Merge the chunks
+    auto total = uint64_t{0};
+    for (auto i = size_t{0}; i < ranges.size(); ++i) {
+        auto const size = file_size(chunk_filename(i).c_str());
+        if (size < cache_header_size) { return LS_CACHE_IS_CORRUPT; }
+        total += (size - cache_header_size) / sizeof(uint64_t);
+    }
+    auto states = std::vector<uint64_t>{};
+    states.reserve(total);
+    for (auto i = size_t{0}; i < ranges.size(); ++i) {
+        OUTCOME_TRY(chunk, load_states(chunk_filename(i).c_str()));
+        states.insert(std::end(states), std::begin(chunk), std::end(chunk));
     }
-    std::transform(std::begin(states), std::end(states), std::begin(states),
-                   [](auto const x) { return le64toh(x); });
     return outcome::success(std::move(states));
 }
 
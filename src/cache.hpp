@@ -29,28 +29,277 @@
 #pragma once
 
 #include "basis.hpp"
+#include "numa.hpp"
 #include "symmetry.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <thread>
 #include <vector>
 
 namespace lattice_symmetries {
 
+class progress_t;
+
 auto closest_hamming(uint64_t x, unsigned hamming_weight) noexcept -> uint64_t;
 auto split_into_tasks(unsigned number_spins, std::optional<unsigned> hamming_weight,
                       uint64_t chunk_size) -> std::vector<std::pair<uint64_t, uint64_t>>;
+/// Generates lists of representatives for a family of bases which only differ in their sectors
+/// (i.e. characters of symmetries and sign of spin inversion) in a single pass.
+auto generate_states(tcb::span<basis_base_t const* const>  headers,
+                     tcb::span<small_basis_t const* const> payloads)
+    -> std::vector<std::vector<uint64_t>>;
 // auto generate_states(tcb::span<batched_small_symmetry_t const> batched,
 //                      tcb::span<small_symmetry_t const> other, unsigned number_spins,
 //                      std::optional<unsigned> hamming_weight) -> std::vector<std::vector<uint64_t>>;
 
-struct basis_cache_t {
+/// Index of a basis without symmetries.
+///
+/// Every spin configuration (with the right Hamming weight) is a representative, so the index of
+/// a state is simply its rank in the combinatorial number system and the state with a given index
+/// can be obtained by unranking. Neither a list of representatives nor a search is needed.
+class combinatorial_index_t {
+    unsigned                _number_spins;
+    std::optional<unsigned> _hamming_weight;
+    uint64_t                _number_states;
+    std::vector<uint64_t>   _binomials; // _binomials[k * 65 + n] == binomial(n, k)
+
+    [[nodiscard]] auto binomial(unsigned n, unsigned k) const noexcept -> uint64_t;
+
+  public:
+    combinatorial_index_t(unsigned number_spins, std::optional<unsigned> hamming_weight);
+
+    [[nodiscard]] auto number_states() const noexcept -> uint64_t { return _number_states; }
+    [[nodiscard]] auto hamming_weight() const noexcept -> std::optional<unsigned>
+    {
+        return _hamming_weight;
+    }
+    [[nodiscard]] auto rank(uint64_t x, uint64_t* out) const noexcept -> ls_error_code;
+    [[nodiscard]] auto unrank(uint64_t index) const noexcept -> uint64_t;
+};
+
+/// Two-level (Lin) table index.
+///
+/// Spin configurations are split into high and low halves. `_offsets[high]` is the index of the
+/// first representative with the given high half. When all low halves (with the right Hamming
+/// weight) are present in the block, index of x is `_offsets[high] + _ranks[low]` where
+/// `_ranks[low]` is the rank of low among all low halves with the same Hamming weight. Otherwise
+/// (i.e. when symmetries remove some states from the block), we search within the block.
+class lin_index_t {
+    unsigned                _low_bits;
+    std::optional<unsigned> _hamming_weight;
+    std::vector<uint64_t>   _offsets;    // 2^(number_spins - _low_bits) + 1 elements
+    std::vector<uint32_t>   _ranks;      // 2^_low_bits elements
+    std::vector<uint64_t>   _capacities; // _capacities[w] == binomial(_low_bits, w)
+
+    [[nodiscard]] auto capacity(uint64_t high) const noexcept -> uint64_t;
+
+  public:
+    /// Both halves have at most 24 bits
+    static constexpr auto max_number_spins = 48U;
+
+    /// Index of a basis without symmetries; no list of representatives is needed
+    lin_index_t(unsigned number_spins, std::optional<unsigned> hamming_weight);
+    lin_index_t(unsigned number_spins, std::optional<unsigned> hamming_weight,
+                tcb::span<uint64_t const> states);
+
+    [[nodiscard]] auto index(uint64_t x, tcb::span<uint64_t const> states, uint64_t* out) const
+        noexcept -> ls_error_code;
+};
+
+/// Minimal perfect hash (BBHash) over a list of representatives.
+///
+/// Keys are hashed into a bit array of about `gamma` bits per key. Positions hit by exactly one
+/// key are kept, and keys which collide move on to the next (smaller) level. The slot of a key
+/// is the rank of its bit among all kept bits, and the few keys left after `max_levels` levels are
+/// stored in a sorted array. Slots form a permutation of [0, number of states), so `_indices` maps
+/// them back to positions in the sorted list. Lookup costs about two random accesses plus one
+/// more to verify that the state is actually there.
+class perfect_hash_t {
+    std::vector<uint64_t> _bits;     // all levels one after another
+    std::vector<uint64_t> _levels;   // level l occupies _bits[_levels[l] .. _levels[l + 1])
+    std::vector<uint64_t> _ranks;    // _ranks[b] == number of set bits in the first 8 * b words
+    std::vector<uint64_t> _fallback; // sorted keys which were not placed in any level
+    std::vector<uint64_t> _indices;  // _indices[slot] == index of the state
+
+    perfect_hash_t() noexcept = default;
+    /// Fills _ranks from _bits.
+    auto compute_ranks() -> void;
+    [[nodiscard]] auto slot(uint64_t x, uint64_t* out) const noexcept -> bool;
+
+  public:
+    static constexpr auto max_levels = 32U;
+    static constexpr auto gamma      = 2.0;
+
+    explicit perfect_hash_t(tcb::span<uint64_t const> states);
+
+    /// Stores the hash as sizes of the tables followed by _levels, _bits, _fallback, and
+    /// _indices. The rank directory is not stored, because it is cheap to recompute.
+    [[nodiscard]] auto to_words() const -> std::vector<uint64_t>;
+    /// Inverse of #to_words for a list of \p number_states states. LS_CACHE_IS_CORRUPT is
+    /// returned if \p words do not describe a valid hash.
+    static auto from_words(tcb::span<uint64_t const> words, uint64_t number_states)
+        -> outcome::result<perfect_hash_t>;
+
+    [[nodiscard]] auto index(uint64_t x, tcb::span<uint64_t const> states, uint64_t* out) const
+        noexcept -> ls_error_code;
+};
+
+/// Static B+tree layout of buckets of sorted representatives.
+///
+/// Leaves are the blocks of 16 consecutive states of a bucket, i.e. the sorted list itself, so no
+/// permutation is needed to map the result back to an index. Inner nodes store the first key of
+/// each of their 16 children and occupy two cache lines. Levels of a bucket are stored top-down
+/// one after another, and the children of node k of a level are nodes 16k .. 16k + 15 of the next
+/// one. A lookup thus touches about log16(n) + 1 pairs of cache lines instead of log2(n) lines,
+/// and the next node is prefetched as soon as it is known. Small buckets have no tree.
+///
+/// With LS_INDEX_BTREE, buckets are chosen to hold 2048-4096 states on average (instead of 8-16
+/// for the default index), i.e. trees of three levels and a much smaller bucket table.
+class bucket_tree_t {
+  public:
+    static constexpr auto fanout          = 16U;
+    static constexpr auto min_bucket_size = uint64_t{256};
+    static constexpr auto bucket_size     = uint64_t{4096};
+
   private:
-    static constexpr auto bits = 22U;
+    struct alignas(64) node_t {
+        std::array<uint64_t, fanout> keys;
+    };
 
-    unsigned                                   _shift;
-    std::vector<uint64_t>                      _states;
-    std::vector<std::pair<uint64_t, uint64_t>> _ranges;
-    std::vector<uint64_t>                      _ranges_v2;
+    std::vector<node_t>   _nodes;
+    std::vector<uint64_t> _roots; // tree of bucket i starts at _nodes[_roots[i]]
+
+  public:
+    bucket_tree_t(tcb::span<uint64_t const> states, tcb::span<uint64_t const> ranges);
+
+    /// Returns the index of \p x in [ranges[i], ranges[i + 1]) or ranges[i + 1] if x is not there.
+    [[nodiscard]] auto search(uint64_t x, uint64_t i, tcb::span<uint64_t const> states,
+                              uint64_t const* ranges) const noexcept -> uint64_t;
+};
+
+/// Whether the basis can use #combinatorial_index_t instead of a list of representatives.
+auto is_dense(basis_base_t const& header) noexcept -> bool;
+
+/// Compressed sorted list of representatives.
+///
+/// States are split into blocks of 64. For every block we store its first state, and all states
+/// of the block are stored as offsets from it using the smallest width w which fits the last
+/// one. A block thus occupies exactly w 64-bit words and any state can be decoded in O(1) without
+/// touching its neighbours. Whole blocks are decoded by the vectorized #unpack_block kernel.
+class compressed_states_t {
+    static constexpr auto block_size = uint64_t{64};
+
+    uint64_t              _number_states;
+    std::vector<uint64_t> _first;   // first state of every block
+    std::vector<uint64_t> _offsets; // block b occupies _packed[_offsets[b] .. _offsets[b + 1])
+    std::vector<uint64_t> _packed;
+
+    /// Decodes block \p b into \p out and returns the number of states in it.
+    auto unpack(uint64_t b, uint64_t* out) const noexcept -> uint64_t;
+
+  public:
+    explicit compressed_states_t(tcb::span<uint64_t const> states);
+
+    [[nodiscard]] auto size() const noexcept -> uint64_t { return _number_states; }
+    [[nodiscard]] auto state(uint64_t index) const noexcept -> uint64_t;
+    /// Returns the index of \p x in [first, last) or last if x is not there.
+    [[nodiscard]] auto search(uint64_t x, uint64_t first, uint64_t last) const noexcept
+        -> uint64_t;
+    [[nodiscard]] auto decode() const -> std::vector<uint64_t>;
+};
+
+/// Read-only private memory mapping of a whole file.
+class mapped_file_t {
+    void*    _data;
+    uint64_t _size;
+
+  public:
+    mapped_file_t() noexcept : _data{nullptr}, _size{0} {}
+    mapped_file_t(mapped_file_t&& other) noexcept;
+    mapped_file_t(mapped_file_t const&) = delete;
+    auto operator=(mapped_file_t&& other) noexcept -> mapped_file_t&;
+    auto operator=(mapped_file_t const&) -> mapped_file_t& = delete;
+    ~mapped_file_t();
+
+    static auto open(char const* filename, ls_map_mode mode) -> outcome::result<mapped_file_t>;
+
+    [[nodiscard]] auto data() const noexcept -> char const*
+    {
+        return static_cast<char const*>(_data);
+    }
+    [[nodiscard]] auto size() const noexcept -> uint64_t { return _size; }
+};
+
+/// Sorted list of representatives which is either owned or points into a mapped cache file.
+class states_buffer_t {
+    std::vector<uint64_t> _owned;
+    mapped_file_t         _mapping;
+    uint64_t const*       _data;
+    uint64_t              _size;
+
+  public:
+    states_buffer_t() noexcept : _owned{}, _mapping{}, _data{nullptr}, _size{0} {}
+    // NOLINTNEXTLINE: implicit conversion is intended
+    states_buffer_t(std::vector<uint64_t> states) noexcept;
+    /// \p mapping must contain little-endian states starting at byte \p offset.
+    states_buffer_t(mapped_file_t mapping, uint64_t offset) noexcept;
+    /// Same as above, but only \p count states are used.
+    states_buffer_t(mapped_file_t mapping, uint64_t offset, uint64_t count) noexcept;
+    states_buffer_t(states_buffer_t&& other) noexcept;
+    states_buffer_t(states_buffer_t const&) = delete;
+    auto operator=(states_buffer_t&& other) noexcept -> states_buffer_t&;
+    auto operator=(states_buffer_t const&) -> states_buffer_t& = delete;
+    ~states_buffer_t() noexcept = default;
+
+    [[nodiscard]] auto data() const noexcept -> uint64_t const* { return _data; }
+    [[nodiscard]] auto size() const noexcept -> uint64_t { return _size; }
+    [[nodiscard]] auto empty() const noexcept -> bool { return _size == 0; }
+    [[nodiscard]] auto is_mapped() const noexcept -> bool { return _mapping.data() != nullptr; }
+    auto operator[](uint64_t const i) const noexcept -> uint64_t { return _data[i]; }
+    // NOLINTNEXTLINE: implicit conversion is intended
+    operator tcb::span<uint64_t const>() const noexcept { return {_data, _size}; }
+    /// Returns the owned states (a copy if they are mapped) and leaves the buffer empty.
+    auto release() -> std::vector<uint64_t>;
+};
+
+/// Contents of a cache file (see cache_file.hpp). ranges and norms are empty and hash is
+/// std::nullopt if the file does not contain them.
+struct cache_file_t {
+    states_buffer_t               states;
+    unsigned                      bits;
+    unsigned                      shift;
+    std::vector<uint64_t>         ranges;
+    std::vector<double>           norms;
+    std::optional<perfect_hash_t> hash;
+};
+
+struct basis_cache_t {
+  private:
+    std::optional<combinatorial_index_t> _ranking;
+    std::optional<lin_index_t>           _lin;
+    std::optional<compressed_states_t>   _compressed;
+    std::optional<perfect_hash_t>        _hash;
+    std::optional<bucket_tree_t>         _tree;
+    // States are split into 2^_bits buckets by their topmost bits
+    unsigned                             _bits;
+    unsigned                             _shift;
+    // When _ranking is used or when the states were released after compression, _states is only
+    // filled when someone explicitly asks for it
+    mutable states_buffer_t              _states;
+    bool                                 _states_are_released;
+    mutable std::once_flag               _states_are_ready;
+    // _states[_ranges[i]] is the first state in bucket i
+    std::vector<uint64_t>                _ranges;
+    ls_numa_policy                       _numa_policy;
+    bool                                 _replicate_buckets;
+    // Copies of _ranges on every NUMA node (only when _replicate_buckets is set)
+    replicated_table_t                   _ranges_replicas;
+    // Norms of all states if they were loaded from a cache file
+    std::vector<double>                  _norms;
 
   public:
     // basis_cache_t(tcb::span<batched_small_symmetry_t const> batched,
@@ -58,16 +307,131 @@ struct basis_cache_t {
     //               std::optional<unsigned> hamming_weight,
     //               std::vector<uint64_t>   _unsafe_states = {});
 
+    /// If \p _unsafe_states are mapped from a file, they are used as is (i.e. the NUMA policy
+    /// does not apply to them).
     basis_cache_t(basis_base_t const& header, small_basis_t const& payload,
-                  std::vector<uint64_t> _unsafe_states = {});
+                  states_buffer_t _unsafe_states = {});
+    /// Bucket ranges stored in \p file are used instead of being recomputed.
+    basis_cache_t(basis_base_t const& header, small_basis_t const& payload, cache_file_t file);
 
     [[nodiscard]] auto states() const noexcept -> tcb::span<uint64_t const>;
     [[nodiscard]] auto number_states() const noexcept -> uint64_t;
-    [[nodiscard]] auto index_v2(uint64_t x, uint64_t* out) const noexcept -> ls_error_code;
+    /// Bucketing parameters and bucket ranges. ranges() is empty if the index does not use them.
+    [[nodiscard]] auto bucket_bits() const noexcept -> unsigned { return _bits; }
+    [[nodiscard]] auto bucket_shift() const noexcept -> unsigned { return _shift; }
+    [[nodiscard]] auto ranges() const noexcept -> tcb::span<uint64_t const> { return _ranges; }
+    /// Empty unless the norms were loaded from a cache file.
+    [[nodiscard]] auto norms() const noexcept -> tcb::span<double const> { return _norms; }
+    /// The perfect hash if the index is LS_INDEX_HASH and nullptr otherwise.
+    [[nodiscard]] auto hash() const noexcept -> perfect_hash_t const*
+    {
+        return _hash.has_value() ? &*_hash : nullptr;
+    }
     [[nodiscard]] auto index(uint64_t x, uint64_t* out) const noexcept -> ls_error_code;
+    /// Computes indices of \p count spin configurations at once.
+    ///
+    /// For the default index, binary searches of a batch of keys are advanced in lockstep with
+    /// the next probes being prefetched, such that memory latencies of different keys overlap.
+    /// If \p sentinel is given, it is written for spin configurations which are not
+    /// representatives. Otherwise, LS_NOT_A_REPRESENTATIVE is returned.
+    [[nodiscard]] auto index(uint64_t count, uint64_t const* spins, uint64_t spins_stride,
+                             uint64_t* out, uint64_t out_stride,
+                             std::optional<uint64_t> sentinel) const noexcept -> ls_error_code;
+    /// Same as above, but \p spins must be sorted (LS_INVALID_ARGUMENT is returned otherwise).
+    ///
+    /// Instead of independent searches, the list of representatives is walked from the bucket of
+    /// the first key with galloping (exponential) search, i.e. it is read mostly sequentially.
+    [[nodiscard]] auto index_sorted(uint64_t count, uint64_t const* spins, uint64_t spins_stride,
+                                    uint64_t* out, uint64_t out_stride,
+                                    std::optional<uint64_t> sentinel) const noexcept
+        -> ls_error_code;
+    [[nodiscard]] auto state(uint64_t index, uint64_t* out) const noexcept -> ls_error_code;
+
+    /// Rebuilds the index (but not the list of representatives). The uncompressed list of
+    /// representatives is kept, because it might be referenced by ls_states.
+    auto set_index_type(basis_base_t const& header, ls_index_type type) -> void;
+};
+
+/// List of representatives of a basis with more than 64 spins.
+///
+/// Every state occupies `words()` 64-bit words (i.e. 128-, 256- or 512-bit keys depending on the
+/// number of spins) and states are sorted in the order of `ls_bits512` (words[0] is the most
+/// significant word). Buckets are determined by the topmost bits of the key which are not shared
+/// by all representatives. Since representatives minimize words[0], for sparse sectors it is
+/// often zero for every state and looking at the top bits of words[0] alone would put all states
+/// into a single bucket.
+struct big_basis_cache_t {
+  private:
+    unsigned              _words;
+    std::vector<uint64_t> _states; // state i occupies _states[i * _words .. (i + 1) * _words)
+    // Number of leading bits of the key which are the same for all states
+    unsigned              _prefix;
+    unsigned              _bits;
+    // _states[_ranges[i] * _words] is the first state in bucket i
+    std::vector<uint64_t> _ranges;
+
+    [[nodiscard]] auto bucket(uint64_t const* x) const noexcept -> uint64_t;
+
+  public:
+    /// Enumerates all spin configurations with the right Hamming weight (i.e. \p header must
+    /// have one) and keeps those for which is_representative_512 returns true.
+    big_basis_cache_t(basis_base_t const& header, big_basis_t const& payload);
+
+    [[nodiscard]] auto words() const noexcept -> unsigned { return _words; }
+    [[nodiscard]] auto states() const noexcept -> tcb::span<uint64_t const> { return _states; }
+    [[nodiscard]] auto number_states() const noexcept -> uint64_t
+    {
+        return _states.size() / _words;
+    }
+    [[nodiscard]] auto index(ls_bits512 const& x, uint64_t* out) const noexcept -> ls_error_code;
+    [[nodiscard]] auto state(uint64_t index, ls_bits512& out) const noexcept -> ls_error_code;
+};
+
+/// Runs a task (loading of a cache by ls_load_cache_async) on a background thread.
+///
+/// Any number of threads may wait for the task concurrently. Once it has finished, wait() is a
+/// single atomic load. The destructor blocks until the task is done.
+class cache_loader_t {
+    std::thread                     _thread;
+    mutable std::mutex              _mutex;
+    mutable std::condition_variable _finished;
+    std::atomic<bool>               _done;
+    ls_error_code                   _status;
+
+    [[nodiscard]] auto wait_slow() const noexcept -> ls_error_code;
+
+  public:
+    explicit cache_loader_t(std::function<ls_error_code()> task);
+    cache_loader_t(cache_loader_t const&) = delete;
+    cache_loader_t(cache_loader_t&&)      = delete;
+    auto operator=(cache_loader_t const&) -> cache_loader_t& = delete;
+    auto operator=(cache_loader_t&&) -> cache_loader_t& = delete;
+    ~cache_loader_t();
+
+    /// Blocks until the task has finished and returns its status.
+    [[nodiscard]] auto wait() const noexcept -> ls_error_code
+    {
+        if (LATTICE_SYMMETRIES_LIKELY(_done.load(std::memory_order_acquire))) { return _status; }
+        return wait_slow();
+    }
 };
 
 auto save_states(tcb::span<uint64_t const> states, char const* filename) -> outcome::result<void>;
+/// Generates the list of representatives and streams it into \p filename without ever keeping
+/// the full list in memory. The resulting file can be read back using #load_states.
+auto save_states(basis_base_t const& header, small_basis_t const& payload, char const* filename)
+    -> outcome::result<void>;
 auto load_states(char const* filename) -> outcome::result<std::vector<uint64_t>>;
+/// Maps \p filename into memory instead of reading it. On big-endian systems or with
+/// LS_MAP_COPY the states are read into memory like #load_states does.
+auto load_states(char const* filename, ls_map_mode mode) -> outcome::result<states_buffer_t>;
+/// Generates the list of representatives saving every finished task to \p directory. If the
+/// build is interrupted, calling this function again only processes the remaining tasks.
+auto generate_states(basis_base_t const& header, small_basis_t const& payload,
+                     char const* directory) -> outcome::result<std::vector<uint64_t>>;
+/// Generates the list of representatives reporting the progress to \p progress. Returns
+/// LS_CANCELLED if the callback asks to stop.
+auto generate_states(basis_base_t const& header, small_basis_t const& payload,
+                     progress_t& progress) -> outcome::result<std::vector<uint64_t>>;
 
 } // namespace lattice_symmetries
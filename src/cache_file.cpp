@@ -0,0 +1,833 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "cache_file.hpp"
+#include "byte_order.hpp"
+#include "cpu/state_info.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <omp.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+namespace lattice_symmetries {
+
+namespace {
+    constexpr auto magic       = uint64_t{0x004548434143534CULL}; // "LSCACHE\0"
+    constexpr auto version     = uint64_t{1};
+    constexpr auto page_size   = uint64_t{4096};
+    // Number of words at the beginning of the header before the table of sections
+    constexpr auto fixed_words = uint64_t{10};
+    constexpr auto max_sections = uint64_t{4};
+    // Section kinds are 1, 2, ..., number_kinds - 1
+    constexpr auto number_kinds = uint64_t{6};
+    // Fixed part, sections, and the checksum of all preceding words
+    constexpr auto header_words = fixed_words + 4U * max_sections + 1U;
+    static_assert(header_words * sizeof(uint64_t) <= page_size);
+
+    constexpr auto legacy_header_size = uint64_t{16};
+
+    constexpr auto compressed_block_size = uint64_t{256};
+
+    constexpr auto mix(uint64_t x) noexcept -> uint64_t
+    {
+        // Finalizer of MurmurHash3
+        x ^= x >> 33U;
+        x *= uint64_t{0xFF51AFD7ED558CCDULL};
+        x ^= x >> 33U;
+        x *= uint64_t{0xC4CEB9FE1A85EC53ULL};
+        x ^= x >> 33U;
+        return x;
+    }
+
+    constexpr auto round_up(uint64_t const x, uint64_t const alignment) noexcept -> uint64_t
+    {
+        return (x + alignment - 1U) / alignment * alignment;
+    }
+
+    auto encode_hamming_weight(std::optional<unsigned> const hamming_weight) noexcept -> uint64_t
+    {
+        return hamming_weight.has_value() ? *hamming_weight : ~uint64_t{0};
+    }
+
+    auto to_words(tcb::span<double const> xs) -> std::vector<uint64_t>
+    {
+        auto words = std::vector<uint64_t>(xs.size());
+        if (!xs.empty()) { std::memcpy(words.data(), xs.data(), xs.size() * sizeof(double)); }
+        return words;
+    }
+} // namespace
+
+auto fingerprint(basis_base_t const& header, small_basis_t const& payload) noexcept -> uint64_t
+{
+    auto       hash    = uint64_t{14695981039346656037ULL}; // NOLINT: FNV offset basis
+    auto const combine = [&hash](uint64_t const x) {
+        for (auto i = 0U; i < 64U; i += 8U) {
+            hash ^= (x >> i) & 0xFFU;
+            hash *= uint64_t{1099511628211ULL}; // NOLINT: FNV prime
+        }
+    };
+    combine(header.number_spins);
+    combine(encode_hamming_weight(header.hamming_weight));
+    combine(static_cast<uint64_t>(header.spin_inversion));
+    for (auto const& symmetry : payload.symmetries) {
+        combine(symmetry.sector);
+        combine(symmetry.periodicity);
+        for (auto i = 0U; i < header.number_spins; ++i) {
+            combine(symmetry.network(uint64_t{1} << i));
+        }
+    }
+    return hash;
+}
+
+auto checksum(tcb::span<uint64_t const> words, uint64_t const offset) noexcept -> uint64_t
+{
+    // Small tables such as the header are not worth waking up other threads
+    constexpr auto parallel_threshold = uint64_t{1} << 16U;
+    auto const     size               = words.size();
+    auto const*    data               = words.data();
+    auto           sum                = uint64_t{0};
+#pragma omp parallel for schedule(static) default(none) if (size >= parallel_threshold)           \
+    firstprivate(size, data, offset) reduction(+ : sum)
+    for (auto i = uint64_t{0}; i < size; ++i) {
+        // Mixing in the position makes the checksum sensitive to reordering
+        sum += mix(data[i] ^ ((offset + i) * uint64_t{0x9E3779B97F4A7C15ULL}));
+    }
+    return sum;
+}
+
+// NOLINTNEXTLINE: toggled by ls_enable_direct_io and ls_disable_direct_io
+std::atomic<bool> direct_io_enabled{false};
+
+namespace {
+    constexpr auto page_words = page_size / sizeof(uint64_t);
+    // Reads and writes are split into chunks of this many words
+    constexpr auto io_chunk_words = uint64_t{1} << 20U;
+
+    constexpr auto round_down(uint64_t const x, uint64_t const alignment) noexcept -> uint64_t
+    {
+        return x / alignment * alignment;
+    }
+
+    struct free_fn_t {
+        auto operator()(void* p) const noexcept -> void { std::free(p); } // NOLINT
+    };
+
+    /// Page-aligned buffer as required by O_DIRECT.
+    auto allocate_io_buffer(uint64_t const size)
+        -> outcome::result<std::unique_ptr<char, free_fn_t>>
+    {
+        // NOLINTNEXTLINE: aligned_alloc needs the size to be a multiple of the alignment
+        auto* p = static_cast<char*>(std::aligned_alloc(page_size, round_up(size, page_size)));
+        if (p == nullptr) { return LS_OUT_OF_MEMORY; }
+        return outcome::success(std::unique_ptr<char, free_fn_t>{p});
+    }
+
+    auto write_all(int const fd, char const* data, uint64_t size, uint64_t offset) noexcept
+        -> bool
+    {
+        while (size > 0) {
+            auto const n = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) { continue; }
+            if (n <= 0) { return false; }
+            data += n;
+            size -= static_cast<uint64_t>(n);
+            offset += static_cast<uint64_t>(n);
+        }
+        return true;
+    }
+
+    /// Returns the number of bytes read, which is less than \p size only at the end of the file.
+    auto read_all(int const fd, char* data, uint64_t const size, uint64_t const offset) noexcept
+        -> std::optional<uint64_t>
+    {
+        auto done = uint64_t{0};
+        while (done < size) {
+            auto const n = ::pread(fd, data + done, size - done, static_cast<off_t>(offset + done));
+            if (n < 0 && errno == EINTR) { continue; }
+            if (n < 0) { return std::nullopt; }
+            if (n == 0) { break; }
+            done += static_cast<uint64_t>(n);
+        }
+        return done;
+    }
+
+    auto open_file(char const* filename, int const flags, bool const direct) noexcept
+        -> std::pair<int, bool>
+    {
+#if defined(O_DIRECT)
+        if (direct) {
+            auto const fd = ::open(filename, flags | O_DIRECT, 0644); // NOLINT: vararg function
+            // E.g. tmpfs does not support O_DIRECT
+            if (fd >= 0 || errno != EINVAL) { return {fd, true}; }
+        }
+#endif
+        return {::open(filename, flags, 0644), false}; // NOLINT: vararg function
+    }
+} // namespace
+
+auto is_direct_io_enabled() noexcept -> bool
+{
+    return direct_io_enabled.load(std::memory_order_acquire);
+}
+
+raw_file_t::raw_file_t(raw_file_t&& other) noexcept
+    : _fd{std::exchange(other._fd, -1)}, _direct{other._direct}
+{}
+
+auto raw_file_t::operator=(raw_file_t&& other) noexcept -> raw_file_t&
+{
+    if (this != &other) {
+        if (_fd >= 0) { ::close(_fd); }
+        _fd     = std::exchange(other._fd, -1);
+        _direct = other._direct;
+    }
+    return *this;
+}
+
+raw_file_t::~raw_file_t()
+{
+    if (_fd >= 0) { ::close(_fd); }
+}
+
+auto raw_file_t::create(char const* filename, bool const direct) -> outcome::result<raw_file_t>
+{
+    auto const [fd, is_direct] =
+        open_file(filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, direct);
+    if (fd < 0) { return LS_COULD_NOT_OPEN_FILE; }
+    return outcome::success(raw_file_t{fd, is_direct});
+}
+
+auto raw_file_t::open(char const* filename, bool const direct) -> outcome::result<raw_file_t>
+{
+    auto const [fd, is_direct] = open_file(filename, O_RDONLY | O_CLOEXEC, direct);
+    if (fd < 0) { return LS_COULD_NOT_OPEN_FILE; }
+    return outcome::success(raw_file_t{fd, is_direct});
+}
+
+auto raw_file_t::size() const -> outcome::result<uint64_t>
+{
+    struct stat buf; // NOLINT: buf is initialized by fstat
+    if (::fstat(_fd, &buf) != 0) { return outcome::failure(LS_FILE_IO_FAILED); }
+    return static_cast<uint64_t>(buf.st_size);
+}
+
+auto raw_file_t::write(uint64_t const offset, tcb::span<uint64_t const> words)
+    -> outcome::result<void>
+{
+    LATTICE_SYMMETRIES_CHECK(!_direct || offset % page_size == 0, "unaligned offset");
+    auto const  count         = words.size();
+    auto const  number_chunks = (count + io_chunk_words - 1U) / io_chunk_words;
+    auto const* data          = words.data();
+    auto const  fd            = _fd;
+    auto const  direct        = _direct;
+    auto        status        = LS_SUCCESS;
+#pragma omp parallel default(none) if (number_chunks > 1)                                         \
+    firstprivate(offset, count, number_chunks, data, fd, direct, io_chunk_words) shared(status)
+    {
+        // Every thread converts its chunks to little-endian in its own buffer
+        auto buffer = std::unique_ptr<char, free_fn_t>{};
+        if (auto r = allocate_io_buffer(io_chunk_words * sizeof(uint64_t)); r) {
+            buffer = std::move(r).value();
+        }
+        else {
+#pragma omp atomic write
+            status = LS_OUT_OF_MEMORY;
+        }
+#pragma omp for schedule(dynamic, 1)
+        for (auto k = uint64_t{0}; k < number_chunks; ++k) {
+            // All threads have to take part in the loop, but without a buffer they cannot write
+            if (buffer == nullptr) { continue; }
+            auto const first = k * io_chunk_words;
+            auto const n     = std::min(io_chunk_words, count - first);
+            auto*      out   = reinterpret_cast<uint64_t*>(buffer.get()); // NOLINT
+            std::transform(data + first, data + first + n, out,
+                           [](auto const x) { return htole64(x); });
+            auto size = n * sizeof(uint64_t);
+            if (direct) {
+                std::fill(out + n, out + round_up(n, page_words), uint64_t{0});
+                size = round_up(size, page_size);
+            }
+            if (!write_all(fd, buffer.get(), size, offset + first * sizeof(uint64_t))) {
+#pragma omp atomic write
+                status = LS_FILE_IO_FAILED;
+            }
+        }
+    }
+    if (status != LS_SUCCESS) { return status; }
+    return outcome::success();
+}
+
+auto raw_file_t::read(uint64_t const offset, tcb::span<uint64_t> words) const
+    -> outcome::result<void>
+{
+    auto const count         = words.size();
+    auto const number_chunks = (count + io_chunk_words - 1U) / io_chunk_words;
+    auto*      data          = words.data();
+    auto const fd            = _fd;
+    auto const direct        = _direct;
+    auto       status        = LS_SUCCESS;
+#pragma omp parallel default(none) if (number_chunks > 1)                                         \
+    firstprivate(offset, count, number_chunks, data, fd, direct, io_chunk_words) shared(status)
+    {
+        // O_DIRECT needs aligned buffers, offsets, and sizes, so the chunk is extended to page
+        // boundaries and read into a separate buffer. Otherwise, it is read in place.
+        auto buffer = std::unique_ptr<char, free_fn_t>{};
+        if (direct) {
+            auto r = allocate_io_buffer(io_chunk_words * sizeof(uint64_t) + 2 * page_size);
+            if (r) { buffer = std::move(r).value(); }
+            else {
+#pragma omp atomic write
+                status = LS_OUT_OF_MEMORY;
+            }
+        }
+#pragma omp for schedule(dynamic, 1)
+        for (auto k = uint64_t{0}; k < number_chunks; ++k) {
+            if (direct && buffer == nullptr) { continue; }
+            auto const first = k * io_chunk_words;
+            auto const n     = std::min(io_chunk_words, count - first);
+            auto const begin = offset + first * sizeof(uint64_t);
+            auto const end   = begin + n * sizeof(uint64_t);
+            auto*      out   = data + first;
+            auto       ok    = false;
+            if (direct) {
+                auto const aligned = round_down(begin, page_size);
+                auto const done    = read_all(fd, buffer.get(), round_up(end, page_size) - aligned,
+                                              aligned);
+                ok = done.has_value() && *done >= end - aligned;
+                if (ok) { std::memcpy(out, buffer.get() + (begin - aligned), end - begin); }
+            }
+            else {
+                auto const done = read_all(fd, reinterpret_cast<char*>(out), end - begin, begin);
+                ok              = done.has_value() && *done == end - begin;
+            }
+            if (!ok) {
+#pragma omp atomic write
+                status = LS_FILE_IO_FAILED;
+                continue;
+            }
+            std::transform(out, out + n, out, [](auto const x) { return le64toh(x); });
+        }
+    }
+    if (status != LS_SUCCESS) { return status; }
+    return outcome::success();
+}
+
+auto raw_file_t::truncate(uint64_t const size) -> outcome::result<void>
+{
+    if (::ftruncate(_fd, static_cast<off_t>(size)) != 0) { return LS_FILE_IO_FAILED; }
+    return outcome::success();
+}
+
+auto raw_file_t::close() -> outcome::result<void>
+{
+    // close is where write errors of network file systems usually show up
+    if (::close(std::exchange(_fd, -1)) != 0) { return LS_FILE_IO_FAILED; }
+    return outcome::success();
+}
+
+cache_writer_t::cache_writer_t(raw_file_t file, std::string filename,
+                               std::string temporary) noexcept
+    : _file{std::move(file)}
+    , _filename{std::move(filename)}
+    , _temporary{std::move(temporary)}
+    , _sections{}
+    , _position{0}
+    , _flushed{0}
+    , _pending{}
+    , _finished{false}
+{}
+
+cache_writer_t::cache_writer_t(cache_writer_t&& other) noexcept
+    : _file{std::move(other._file)}
+    , _filename{std::move(other._filename)}
+    , _temporary{std::move(other._temporary)}
+    , _sections{std::move(other._sections)}
+    , _position{other._position}
+    , _flushed{other._flushed}
+    , _pending{std::move(other._pending)}
+    , _finished{std::exchange(other._finished, true)}
+{}
+
+cache_writer_t::~cache_writer_t()
+{
+    if (!_finished) {
+        _file = raw_file_t{};
+        std::remove(_temporary.c_str());
+    }
+}
+
+auto cache_writer_t::create(char const* filename) -> outcome::result<cache_writer_t>
+{
+    auto temporary = std::string{filename} + ".tmp";
+    OUTCOME_TRY(file, raw_file_t::create(temporary.c_str(), is_direct_io_enabled()));
+    auto writer = cache_writer_t{std::move(file), filename, std::move(temporary)};
+    // The header is written by finish(). Until then the space is reserved
+    writer._position = page_size;
+    writer._flushed  = page_size;
+    return outcome::success(std::move(writer));
+}
+
+auto cache_writer_t::flush() -> outcome::result<void>
+{
+    _pending.resize(round_up(_pending.size(), page_words), 0);
+    OUTCOME_TRY(_file.write(_flushed, _pending));
+    _flushed += _pending.size() * sizeof(uint64_t);
+    _position = _flushed;
+    _pending.clear();
+    return outcome::success();
+}
+
+auto cache_writer_t::begin_section(section_kind const kind) -> outcome::result<void>
+{
+    LATTICE_SYMMETRIES_CHECK(_sections.size() < max_sections, "too many sections");
+    // Sections are page-aligned such that they can be mapped directly
+    OUTCOME_TRY(flush());
+    _sections.push_back(section_t{kind, _position, 0, 0});
+    return outcome::success();
+}
+
+auto cache_writer_t::append(tcb::span<uint64_t const> words) -> outcome::result<void>
+{
+    LATTICE_SYMMETRIES_CHECK(!_sections.empty(), "no section is open");
+    auto& section = _sections.back();
+    section.checksum += checksum(words, section.size);
+    section.size += words.size();
+    _position += words.size() * sizeof(uint64_t);
+    while (!words.empty()) {
+        // Large blocks are written directly
+        if (_pending.empty() && words.size() >= io_chunk_words) {
+            auto const n = round_down(words.size(), page_words);
+            OUTCOME_TRY(_file.write(_flushed, words.first(n)));
+            _flushed += n * sizeof(uint64_t);
+            words = words.subspan(n);
+            continue;
+        }
+        auto const n = std::min<uint64_t>(words.size(), io_chunk_words - _pending.size());
+        _pending.insert(std::end(_pending), std::begin(words), std::begin(words) + n);
+        words = words.subspan(n);
+        if (_pending.size() == io_chunk_words) {
+            OUTCOME_TRY(_file.write(_flushed, _pending));
+            _flushed += _pending.size() * sizeof(uint64_t);
+            _pending.clear();
+        }
+    }
+    return outcome::success();
+}
+
+auto cache_writer_t::finish(basis_base_t const& header, small_basis_t const& payload,
+                            uint64_t const number_states, unsigned const bits,
+                            unsigned const shift) -> outcome::result<void>
+{
+    auto words = std::vector<uint64_t>(page_words);
+    words[0]   = magic;
+    words[1]   = version;
+    words[2]   = header.number_spins;
+    words[3]   = encode_hamming_weight(header.hamming_weight);
+    words[4]   = static_cast<uint64_t>(static_cast<int64_t>(header.spin_inversion));
+    words[5]   = fingerprint(header, payload);
+    words[6]   = number_states;
+    words[7]   = bits;
+    words[8]   = shift;
+    words[9]   = _sections.size();
+    for (auto i = size_t{0}; i < _sections.size(); ++i) {
+        auto* const out = words.data() + fixed_words + 4U * i;
+        out[0]          = _sections[i].kind;
+        out[1]          = _sections[i].offset;
+        out[2]          = _sections[i].size;
+        out[3]          = _sections[i].checksum;
+    }
+    words[header_words - 1U] =
+        checksum(tcb::span<uint64_t const>{words.data(), header_words - 1U});
+
+    auto const size = _position;
+    OUTCOME_TRY(flush());
+    OUTCOME_TRY(_file.write(0, words));
+    // Remove the padding of the last page
+    OUTCOME_TRY(_file.truncate(size));
+    OUTCOME_TRY(_file.close());
+    if (std::rename(_temporary.c_str(), _filename.c_str()) != 0) { return LS_FILE_IO_FAILED; }
+    _finished = true;
+    return outcome::success();
+}
+
+namespace {
+    struct compressed_layout_t {
+        uint64_t number_blocks;
+        uint64_t widths_offset; // widths start at this word
+        uint64_t data_offset;   // packed differences start at this word
+    };
+
+    constexpr auto compressed_layout(uint64_t const number_states) noexcept -> compressed_layout_t
+    {
+        auto const number_blocks =
+            (number_states + compressed_block_size - 1U) / compressed_block_size;
+        return {number_blocks, number_blocks, number_blocks + (number_blocks + 7U) / 8U};
+    }
+
+    constexpr auto block_count(uint64_t const number_states, uint64_t const b) noexcept
+        -> uint64_t
+    {
+        return std::min(compressed_block_size, number_states - b * compressed_block_size);
+    }
+
+    /// Number of words occupied by the packed differences of a block of \p count states.
+    constexpr auto packed_size(uint64_t const count, unsigned const width) noexcept -> uint64_t
+    {
+        return count == 0 ? 0U : ((count - 1U) * width + 63U) / 64U;
+    }
+
+    /// Reads bits [pos, pos + width) of \p words (0 < width <= 64).
+    auto read_bits(uint64_t const* words, uint64_t const pos, unsigned const width) noexcept
+        -> uint64_t
+    {
+        auto const shift = static_cast<unsigned>(pos % 64U);
+        auto const i     = pos / 64U;
+        auto       x     = words[i] >> shift;
+        if (shift + width > 64U) { x |= words[i + 1U] << (64U - shift); }
+        return width == 64U ? x : (x & ((uint64_t{1} << width) - 1U));
+    }
+
+    /// Writes \p x to bits [pos, pos + width) of \p words which must be zero.
+    auto write_bits(uint64_t* words, uint64_t const pos, unsigned const width,
+                    uint64_t const x) noexcept -> void
+    {
+        auto const shift = static_cast<unsigned>(pos % 64U);
+        auto const i     = pos / 64U;
+        words[i] |= x << shift;
+        if (shift + width > 64U) { words[i + 1U] |= x >> (64U - shift); }
+    }
+
+    auto block_width(uint64_t const* words, compressed_layout_t const& layout,
+                     uint64_t const b) noexcept -> unsigned
+    {
+        return static_cast<unsigned>((words[layout.widths_offset + b / 8U] >> (8U * (b % 8U)))
+                                     & 0xFFU);
+    }
+} // namespace
+
+auto compress_states(tcb::span<uint64_t const> states) -> std::vector<uint64_t>
+{
+    auto const number_states = states.size();
+    auto const layout        = compressed_layout(number_states);
+    auto       widths        = std::vector<unsigned>(layout.number_blocks);
+#pragma omp parallel for schedule(static) default(none) firstprivate(number_states, layout)      \
+    shared(states, widths)
+    for (auto b = uint64_t{0}; b < layout.number_blocks; ++b) {
+        auto const first = b * compressed_block_size;
+        auto const last  = first + block_count(number_states, b);
+        auto       delta = uint64_t{0};
+        for (auto i = first + 1U; i < last; ++i) {
+            delta = std::max(delta, states[i] - states[i - 1U]);
+        }
+        widths[b] = delta == 0 ? 0U : 64U - static_cast<unsigned>(__builtin_clzl(delta));
+    }
+    // Block offsets are a prefix sum, but there are only number_states / 256 blocks
+    auto offsets = std::vector<uint64_t>(layout.number_blocks + 1U);
+    for (auto b = uint64_t{0}; b < layout.number_blocks; ++b) {
+        offsets[b + 1U] = offsets[b] + packed_size(block_count(number_states, b), widths[b]);
+    }
+
+    auto  out   = std::vector<uint64_t>(layout.data_offset + offsets.back());
+    auto* words = out.data();
+    for (auto b = uint64_t{0}; b < layout.number_blocks; ++b) {
+        words[layout.widths_offset + b / 8U] |= uint64_t{widths[b]} << (8U * (b % 8U));
+    }
+#pragma omp parallel for schedule(static) default(none)                                          \
+    firstprivate(number_states, layout, words) shared(states, widths, offsets)
+    for (auto b = uint64_t{0}; b < layout.number_blocks; ++b) {
+        auto const first = b * compressed_block_size;
+        auto const count = block_count(number_states, b);
+        auto const width = widths[b];
+        auto* const packed = words + layout.data_offset + offsets[b];
+        words[b]           = states[first];
+        if (width == 0U) { continue; }
+        for (auto j = uint64_t{1}; j < count; ++j) {
+            write_bits(packed, (j - 1U) * width, width, states[first + j] - states[first + j - 1U]);
+        }
+    }
+    return out;
+}
+
+auto decompress_states(tcb::span<uint64_t const> words, uint64_t const number_states)
+    -> outcome::result<std::vector<uint64_t>>
+{
+    auto const layout = compressed_layout(number_states);
+    if (words.size() < layout.data_offset) { return LS_CACHE_IS_CORRUPT; }
+    auto offsets = std::vector<uint64_t>(layout.number_blocks + 1U);
+    for (auto b = uint64_t{0}; b < layout.number_blocks; ++b) {
+        auto const width = block_width(words.data(), layout, b);
+        if (width > 64U) { return LS_CACHE_IS_CORRUPT; }
+        offsets[b + 1U] = offsets[b] + packed_size(block_count(number_states, b), width);
+    }
+    if (words.size() != layout.data_offset + offsets.back()) { return LS_CACHE_IS_CORRUPT; }
+
+    // Blocks are independent, so they are decoded in parallel
+    auto        states = std::vector<uint64_t>(number_states);
+    auto const* data   = words.data();
+#pragma omp parallel for schedule(static) default(none)                                          \
+    firstprivate(number_states, layout, data) shared(states, offsets)
+    for (auto b = uint64_t{0}; b < layout.number_blocks; ++b) {
+        auto const  first  = b * compressed_block_size;
+        auto const  count  = block_count(number_states, b);
+        auto const  width  = block_width(data, layout, b);
+        auto const* packed = data + layout.data_offset + offsets[b];
+        auto        x      = data[b];
+        states[first]      = x;
+        for (auto j = uint64_t{1}; j < count; ++j) {
+            x += width == 0U ? 0U : read_bits(packed, (j - 1U) * width, width);
+            states[first + j] = x;
+        }
+    }
+    return outcome::success(std::move(states));
+}
+
+namespace {
+    auto compute_norms(basis_base_t const& header, small_basis_t const& payload,
+                       tcb::span<uint64_t const> states) -> std::vector<double>
+    {
+        auto norms = std::vector<double>(states.size());
+#pragma omp parallel for schedule(static) default(none) shared(header, payload, states, norms)
+        for (auto i = uint64_t{0}; i < states.size(); ++i) {
+            auto representative = uint64_t{0};
+            auto character      = std::complex<double>{};
+            get_state_info_64(header, payload, states[i], representative, character, norms[i]);
+        }
+        return norms;
+    }
+} // namespace
+
+auto save_cache(basis_base_t const& header, small_basis_t const& payload,
+                basis_cache_t const& cache, bool const with_norms, bool const compress,
+                char const* filename)
+    -> outcome::result<void>
+{
+    auto const states = cache.states();
+    OUTCOME_TRY(writer, cache_writer_t::create(filename));
+    if (compress) {
+        OUTCOME_TRY(writer.begin_section(cache_writer_t::compressed_states));
+        OUTCOME_TRY(writer.append(compress_states(states)));
+    }
+    else {
+        OUTCOME_TRY(writer.begin_section(cache_writer_t::states));
+        OUTCOME_TRY(writer.append(states));
+    }
+    if (!cache.ranges().empty()) {
+        OUTCOME_TRY(writer.begin_section(cache_writer_t::ranges));
+        OUTCOME_TRY(writer.append(cache.ranges()));
+    }
+    if (with_norms) {
+        auto const norms = cache.norms().empty() ? compute_norms(header, payload, states)
+                                                 : std::vector<double>(std::begin(cache.norms()),
+                                                                       std::end(cache.norms()));
+        OUTCOME_TRY(writer.begin_section(cache_writer_t::norms));
+        OUTCOME_TRY(writer.append(to_words(norms)));
+    }
+    if (auto const* hash = cache.hash(); hash != nullptr) {
+        OUTCOME_TRY(writer.begin_section(cache_writer_t::hash));
+        OUTCOME_TRY(writer.append(hash->to_words()));
+    }
+    auto const has_ranges = !cache.ranges().empty();
+    return writer.finish(header, payload, states.size(), has_ranges ? cache.bucket_bits() : 0U,
+                         has_ranges ? cache.bucket_shift() : 0U);
+}
+
+namespace {
+    struct section_view_t {
+        uint64_t offset; // in bytes
+        uint64_t size;   // in words
+        uint64_t checksum;
+    };
+
+    /// Reads a section and verifies its checksum.
+    auto read_section(raw_file_t const& file, section_view_t const& section)
+        -> outcome::result<std::vector<uint64_t>>
+    {
+        auto words = std::vector<uint64_t>(section.size);
+        OUTCOME_TRY(file.read(section.offset, words));
+        if (checksum(words) != section.checksum) { return LS_CACHE_IS_CORRUPT; }
+        return outcome::success(std::move(words));
+    }
+
+    auto is_valid_ranges(tcb::span<uint64_t const> ranges, unsigned const bits,
+                         uint64_t const number_states) noexcept -> bool
+    {
+        return ranges.size() == (uint64_t{1} << bits) + 1U && ranges.front() == 0
+               && ranges.back() == number_states
+               && std::is_sorted(std::begin(ranges), std::end(ranges));
+    }
+} // namespace
+
+auto load_cache(basis_base_t const& header, small_basis_t const& payload, char const* filename,
+                ls_map_mode const mode) -> outcome::result<cache_file_t>
+{
+    // Everything except for the states is read with pread. States are either read the same way
+    // or mapped
+    OUTCOME_TRY(file, raw_file_t::open(filename, is_direct_io_enabled()));
+    OUTCOME_TRY(file_size, file.size());
+    // Files written by earlier versions contain no metadata, so there is nothing to validate
+    if (file_size >= legacy_header_size) {
+        auto legacy = std::array<uint64_t, legacy_header_size / sizeof(uint64_t)>{};
+        OUTCOME_TRY(file.read(0, legacy));
+        // NOLINTNEXTLINE: 42 is indeed a magic number, that's why it's used here
+        if (std::all_of(std::begin(legacy), std::end(legacy),
+                        [](auto const x) { return x == 0x2A2A2A2A2A2A2A2AULL; })) {
+            file = raw_file_t{};
+            OUTCOME_TRY(states, load_states(filename, mode));
+            return outcome::success(
+                cache_file_t{std::move(states), 0U, 0U, {}, {}, std::nullopt});
+        }
+    }
+
+    if (file_size < page_size) { return LS_CACHE_IS_CORRUPT; }
+    auto words = std::array<uint64_t, header_words>{};
+    OUTCOME_TRY(file.read(0, words));
+    if (words[0] != magic || words[1] != version
+        || words.back() != checksum(tcb::span<uint64_t const>{words.data(), header_words - 1U})) {
+        return LS_CACHE_IS_CORRUPT;
+    }
+    if (words[2] != header.number_spins || words[3] != encode_hamming_weight(header.hamming_weight)
+        || words[4] != static_cast<uint64_t>(static_cast<int64_t>(header.spin_inversion))
+        || words[5] != fingerprint(header, payload)) {
+        return LS_CACHE_MISMATCH;
+    }
+    auto const number_states   = words[6];
+    auto const bits            = words[7];
+    auto const shift           = words[8];
+    auto const number_sections = words[9];
+    if (number_sections > max_sections) { return LS_CACHE_IS_CORRUPT; }
+
+    auto sections = std::array<std::optional<section_view_t>, number_kinds>{};
+    for (auto i = uint64_t{0}; i < number_sections; ++i) {
+        auto const* const in     = words.data() + fixed_words + 4U * i;
+        auto const        kind   = in[0];
+        auto const        offset = in[1];
+        auto const        size   = in[2];
+        if (kind == 0 || kind >= number_kinds || sections[kind].has_value()
+            || offset % page_size != 0 || offset > file_size
+            || size > (file_size - offset) / sizeof(uint64_t)) {
+            return LS_CACHE_IS_CORRUPT;
+        }
+        sections[kind] = section_view_t{offset, size, in[3]};
+    }
+    auto const& states     = sections[cache_writer_t::states];
+    auto const& compressed = sections[cache_writer_t::compressed_states];
+    // Exactly one of them must be present
+    if (states.has_value() == compressed.has_value()
+        || (states.has_value() && states->size != number_states)) {
+        return LS_CACHE_IS_CORRUPT;
+    }
+
+    auto result = cache_file_t{{}, 0U, 0U, {}, {}, std::nullopt};
+    if (auto const& ranges = sections[cache_writer_t::ranges]; ranges.has_value()) {
+        auto const expected_shift = bits >= header.number_spins ? 0U : header.number_spins - bits;
+        if (bits == 0 || bits >= 64U || shift != expected_shift) { return LS_CACHE_IS_CORRUPT; }
+        OUTCOME_TRY(table, read_section(file, *ranges));
+        if (!is_valid_ranges(table, static_cast<unsigned>(bits), number_states)) {
+            return LS_CACHE_IS_CORRUPT;
+        }
+        result.bits   = static_cast<unsigned>(bits);
+        result.shift  = static_cast<unsigned>(shift);
+        result.ranges = std::move(table);
+    }
+    if (auto const& norms = sections[cache_writer_t::norms]; norms.has_value()) {
+        if (norms->size != number_states) { return LS_CACHE_IS_CORRUPT; }
+        OUTCOME_TRY(table, read_section(file, *norms));
+        result.norms.resize(table.size());
+        if (!table.empty()) {
+            std::memcpy(result.norms.data(), table.data(), table.size() * sizeof(double));
+        }
+    }
+    if (auto const& hash = sections[cache_writer_t::hash]; hash.has_value()) {
+        OUTCOME_TRY(table, read_section(file, *hash));
+        OUTCOME_TRY(restored, perfect_hash_t::from_words(table, number_states));
+        result.hash = std::move(restored);
+    }
+
+    if (compressed.has_value()) {
+        OUTCOME_TRY(packed, read_section(file, *compressed));
+        OUTCOME_TRY(decoded, decompress_states(packed, number_states));
+        result.states = std::move(decoded);
+        return outcome::success(std::move(result));
+    }
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    constexpr auto can_map = true;
+#else
+    constexpr auto can_map = false;
+#endif
+    if (!can_map || mode == LS_MAP_COPY) {
+        OUTCOME_TRY(copy, read_section(file, *states));
+        result.states = std::move(copy);
+        return outcome::success(std::move(result));
+    }
+    file = raw_file_t{};
+    OUTCOME_TRY(mapping, mapped_file_t::open(filename, mode));
+    // The file was replaced in between
+    if (mapping.size() != file_size) { return LS_CACHE_IS_CORRUPT; }
+    // Verifying the checksum touches every page, which defeats the purpose of lazy mapping
+    if (mode == LS_MAP_POPULATE) {
+        // NOLINTNEXTLINE: sections are page-aligned and mmap returns page-aligned memory
+        auto const* data = reinterpret_cast<uint64_t const*>(mapping.data() + states->offset);
+        if (checksum(tcb::span<uint64_t const>{data, states->size}) != states->checksum) {
+            return LS_CACHE_IS_CORRUPT;
+        }
+    }
+    result.states = states_buffer_t{std::move(mapping), states->offset, number_states};
+    return outcome::success(std::move(result));
+}
+
+} // namespace lattice_symmetries
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT void ls_enable_direct_io()
+{
+    lattice_symmetries::direct_io_enabled.store(true, std::memory_order_release);
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT void ls_disable_direct_io()
+{
+    lattice_symmetries::direct_io_enabled.store(false, std::memory_order_release);
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT bool ls_is_direct_io_enabled()
+{
+    return lattice_symmetries::is_direct_io_enabled();
+}
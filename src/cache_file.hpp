@@ -0,0 +1,180 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include "cache.hpp"
+#include <string>
+
+/// Versioned cache file format.
+///
+/// A file starts with a page-sized header which consists of little-endian 64-bit words: magic,
+/// version, properties of the basis (number of spins, Hamming weight, spin inversion, and a
+/// fingerprint of the symmetry group), number of states, bucketing parameters, and a table of
+/// sections. Every section (states, bucket ranges, norms, perfect hash) starts at a page boundary
+/// and has its own checksum, and the header is protected by a checksum of all preceding words.
+/// Instead of plain states, a file may contain a compressed_states section (see
+/// #compress_states).
+///
+/// Files consisting of 16 bytes with value 42 followed by the states (i.e. those written by
+/// earlier versions) are still accepted by #load_cache.
+
+namespace lattice_symmetries {
+
+/// FNV-1a hash of everything which determines the list of representatives.
+auto fingerprint(basis_base_t const& header, small_basis_t const& payload) noexcept -> uint64_t;
+
+/// Checksum of \p words which are located at position \p offset of a section. The checksum of a
+/// section is the sum of checksums of its parts, so it can be computed incrementally.
+auto checksum(tcb::span<uint64_t const> words, uint64_t offset = 0) noexcept -> uint64_t;
+
+/// File descriptor for positional I/O of 64-bit words from multiple threads.
+///
+/// Words are stored in little-endian byte order. Large reads and writes are split into chunks of
+/// 8 MiB which are transferred by different OpenMP threads using pread/pwrite, and byte order is
+/// converted by the same threads. With O_DIRECT (see ls_enable_direct_io) the page cache is
+/// bypassed: transfers then go through page-aligned buffers, and regions are extended to page
+/// boundaries. If the file system does not support O_DIRECT, normal I/O is used.
+class raw_file_t {
+    int  _fd;
+    bool _direct;
+
+    raw_file_t(int fd, bool direct) noexcept : _fd{fd}, _direct{direct} {}
+
+  public:
+    raw_file_t() noexcept : _fd{-1}, _direct{false} {}
+    raw_file_t(raw_file_t&& other) noexcept;
+    raw_file_t(raw_file_t const&) = delete;
+    auto operator=(raw_file_t&& other) noexcept -> raw_file_t&;
+    auto operator=(raw_file_t const&) -> raw_file_t& = delete;
+    ~raw_file_t();
+
+    /// Truncates or creates \p filename for writing.
+    static auto create(char const* filename, bool direct) -> outcome::result<raw_file_t>;
+    static auto open(char const* filename, bool direct) -> outcome::result<raw_file_t>;
+
+    [[nodiscard]] auto is_direct() const noexcept -> bool { return _direct; }
+    [[nodiscard]] auto size() const -> outcome::result<uint64_t>;
+    /// Writes \p words (in host byte order) at byte \p offset. With O_DIRECT \p offset must be
+    /// page-aligned, and the last page is padded with zeros.
+    auto write(uint64_t offset, tcb::span<uint64_t const> words) -> outcome::result<void>;
+    /// Reads \p words starting at byte \p offset and converts them to host byte order.
+    auto read(uint64_t offset, tcb::span<uint64_t> words) const -> outcome::result<void>;
+    auto truncate(uint64_t size) -> outcome::result<void>;
+    auto close() -> outcome::result<void>;
+};
+
+/// Writes a cache file section by section.
+///
+/// Everything is written to a temporary file which is renamed to the final name by #finish, so
+/// a cache file either does not exist or is complete. Small appends are collected in a buffer,
+/// such that all writes are large and page-aligned.
+class cache_writer_t {
+    struct section_t {
+        uint64_t kind;
+        uint64_t offset; // in bytes from the beginning of the file
+        uint64_t size;   // in words
+        uint64_t checksum;
+    };
+
+    raw_file_t             _file;
+    std::string            _filename;
+    std::string            _temporary;
+    std::vector<section_t> _sections;
+    uint64_t               _position; // in bytes, including _pending
+    uint64_t               _flushed;  // in bytes
+    std::vector<uint64_t>  _pending;
+    bool                   _finished;
+
+    cache_writer_t(raw_file_t file, std::string filename, std::string temporary) noexcept;
+    /// Writes _pending padded with zeros to a page boundary.
+    auto flush() -> outcome::result<void>;
+
+  public:
+    enum section_kind : uint64_t {
+        states            = 1,
+        ranges            = 2,
+        norms             = 3,
+        compressed_states = 4,
+        hash              = 5,
+    };
+
+    cache_writer_t(cache_writer_t&& other) noexcept;
+    cache_writer_t(cache_writer_t const&) = delete;
+    auto operator=(cache_writer_t&& other) noexcept -> cache_writer_t& = delete;
+    auto operator=(cache_writer_t const&) -> cache_writer_t& = delete;
+    /// Removes the temporary file unless #finish succeeded.
+    ~cache_writer_t();
+
+    static auto create(char const* filename) -> outcome::result<cache_writer_t>;
+
+    auto begin_section(section_kind kind) -> outcome::result<void>;
+    /// Appends \p words (in host byte order) to the current section.
+    auto append(tcb::span<uint64_t const> words) -> outcome::result<void>;
+    auto finish(basis_base_t const& header, small_basis_t const& payload, uint64_t number_states,
+                unsigned bits, unsigned shift) -> outcome::result<void>;
+};
+
+/// Delta encoding and bit-packing of a sorted list of states.
+///
+/// States are split into blocks of 256 which are encoded independently: the first state of a
+/// block is stored as is, and the differences between consecutive states are packed using the
+/// smallest width which fits the largest of them. The result consists of three tables: first
+/// states of all blocks, widths (one byte per block, eight per word), and packed differences
+/// (every block starts at a word boundary).
+auto compress_states(tcb::span<uint64_t const> states) -> std::vector<uint64_t>;
+/// Inverse of #compress_states. Blocks are decoded in parallel. LS_CACHE_IS_CORRUPT is returned
+/// if \p words do not describe exactly \p number_states states.
+auto decompress_states(tcb::span<uint64_t const> words, uint64_t number_states)
+    -> outcome::result<std::vector<uint64_t>>;
+
+/// Whether cache files are read and written with O_DIRECT.
+auto is_direct_io_enabled() noexcept -> bool;
+
+/// Writes \p cache to \p filename. Bucket ranges and the perfect hash are stored if the cache has
+/// them, and the norms of all states are computed and stored if \p with_norms is true. If
+/// \p compress is true, states are stored using #compress_states.
+auto save_cache(basis_base_t const& header, small_basis_t const& payload,
+                basis_cache_t const& cache, bool with_norms, bool compress, char const* filename)
+    -> outcome::result<void>;
+
+/// Reads a cache file and checks that it belongs to the basis described by \p header and
+/// \p payload. LS_CACHE_MISMATCH is returned if it was written for a different basis and
+/// LS_CACHE_IS_CORRUPT if the file is damaged.
+///
+/// The header checksum is always verified, and so are the checksums of all sections which are
+/// read into memory: bucket ranges, norms, the perfect hash, compressed states (which are always
+/// decoded), and plain states with LS_MAP_COPY or on big-endian hosts. Plain states which are
+/// mapped are verified only with LS_MAP_POPULATE. With LS_MAP_DEFAULT and LS_MAP_WILLNEED their
+/// checksum is not checked at all, because hashing them would read every page. Legacy files have
+/// no checksums.
+auto load_cache(basis_base_t const& header, small_basis_t const& payload, char const* filename,
+                ls_map_mode mode) -> outcome::result<cache_file_t>;
+
+} // namespace lattice_symmetries
@@ -150,6 +150,7 @@ auto benes_forward_512(ls_bits512& x, big_network_t const& network) noexcept ->
 } // namespace lattice_symmetries::ARCH
 
 #if defined(LATTICE_SYMMETRIES_ADD_DISPATCH_CODE)
+#    include "../dispatch.hpp"
 namespace lattice_symmetries {
 auto benes_forward_512(ls_bits512& x, lattice_symmetries::big_network_t const& network) noexcept
     -> void
@@ -97,6 +97,7 @@ auto benes_forward_64(uint64_t x[batch_size], batched_small_network_t const& net
 } // namespace lattice_symmetries::ARCH
 
 #if defined(LATTICE_SYMMETRIES_ADD_DISPATCH_CODE)
+#    include "../dispatch.hpp"
 namespace lattice_symmetries {
 constexpr auto bit_permute_step_64(uint64_t const x, uint64_t const m, unsigned const d) noexcept
     -> uint64_t
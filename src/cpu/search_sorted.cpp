@@ -143,6 +143,7 @@ auto search_sorted(uint64_t const* data, uint64_t size, uint64_t const key) noex
 } // namespace lattice_symmetries::ARCH
 
 #if defined(LATTICE_SYMMETRIES_ADD_DISPATCH_CODE)
+#    include "../dispatch.hpp"
 namespace lattice_symmetries {
 LATTICE_SYMMETRIES_EXPORT
 auto search_sorted(uint64_t const* data, uint64_t size, uint64_t key) noexcept -> uint64_t
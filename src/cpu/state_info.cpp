@@ -3,6 +3,7 @@
 #include "benes_forward_512.hpp"
 #include "benes_forward_64.hpp"
 #include <vectorclass.h>
+#include <algorithm>
 
 #if LATTICE_SYMMETRIES_HAS_AVX2()
 #    define ARCH avx2
@@ -170,6 +171,19 @@ apply_symmetry(vcl::Vec8uq& x, batched_small_symmetry_t const& symmetry) noexcep
 #endif
 }
 
+/// Applies one symmetry to batch_size different spin configurations at once.
+LATTICE_SYMMETRIES_FORCEINLINE auto apply_symmetry(vcl::Vec8uq&            x,
+                                                   small_symmetry_t const& symmetry) noexcept
+    -> void
+{
+    auto const& network = symmetry.network;
+    for (auto i = 0U; i < network.depth; ++i) {
+        auto const d = static_cast<int>(network.deltas[i]);
+        auto       y = ((x >> d) ^ x) & vcl::Vec8uq{network.masks[i]};
+        x ^= y ^ (y << d);
+    }
+}
+
 LATTICE_SYMMETRIES_FORCEINLINE auto apply_symmetry(ls_bits512&           x,
                                                    big_symmetry_t const& symmetry) noexcept -> void
 {
@@ -297,6 +311,48 @@ auto is_representative_64(basis_base_t const& basis_header, small_basis_t const&
     return n > 0.0;
 }
 
+auto batched_is_representative_64(basis_base_t const&  basis_header,
+                                  small_basis_t const& basis_body, uint64_t const bits[],
+                                  uint8_t out[]) noexcept -> void
+{
+    constexpr auto batch_size = batched_small_symmetry_t::batch_size;
+    // Lanes with out[i] == 0 have already been rejected by the caller
+    if (!basis_header.has_symmetries) { return; }
+
+    auto const flip_mask  = vcl::Vec8uq{get_flip_mask_64(basis_header.number_spins)};
+    auto const flip_coeff = static_cast<double>(basis_header.spin_inversion);
+
+    // Unlike is_representative_64 which applies 8 symmetries to one state, here every lane holds
+    // a different state and symmetries are applied one by one
+    vcl::Vec8uq original;
+    original.load(bits);
+    auto alive = vcl::Vec8uq{out[0], out[1], out[2], out[3], out[4], out[5], out[6], out[7]}
+                 != vcl::Vec8uq{0};
+    auto n     = vcl::Vec8d{0.0};
+    for (auto const& symmetry : basis_body.symmetries) {
+        auto x = original;
+        apply_symmetry(x, symmetry);
+        auto const real = symmetry.eigenvalue.real();
+        alive           = alive && (x >= original);
+        n               = vcl::if_add(x == original, n, vcl::Vec8d{real});
+        if (basis_header.spin_inversion != 0) {
+            x ^= flip_mask;
+            alive = alive && (x >= original);
+            n     = vcl::if_add(x == original, n, vcl::Vec8d{flip_coeff * real});
+        }
+        // Every state in the batch has been rejected
+        if (!vcl::horizontal_or(alive)) { break; }
+    }
+
+    alignas(required_alignment) std::array<double, batch_size> norms;
+    n.store_a(norms.data());
+    // Same threshold as in is_representative_64
+    constexpr auto norm_threshold = 1.0e-5;
+    for (auto i = 0U; i < batch_size; ++i) {
+        out[i] = static_cast<uint8_t>(alive[static_cast<int>(i)] && norms[i] > norm_threshold);
+    }
+}
+
 auto get_state_info_512(basis_base_t const& basis_header, big_basis_t const& basis_body,
                         ls_bits512 const& bits, ls_bits512& representative,
                         std::complex<double>& character, double& norm) noexcept -> void
@@ -351,14 +407,49 @@ auto get_state_info_512(basis_base_t const& basis_header, big_basis_t const& bas
     character      = e;
     norm           = n;
 }
+
+auto is_representative_512(basis_base_t const& basis_header, big_basis_t const& basis_body,
+                           ls_bits512 const& bits) noexcept -> bool
+{
+    if (!basis_header.has_symmetries) { return true; }
+    auto const flip_mask  = get_flip_mask_512(basis_header.number_spins);
+    auto const flip_coeff = static_cast<double>(basis_header.spin_inversion);
+
+    ls_bits512 buffer; // NOLINT: buffer is initialized inside the loop before it is used
+    auto       n = 0.0;
+    for (auto const& symmetry : basis_body.symmetries) {
+        buffer = bits;
+        symmetry.network(buffer);
+        // Unlike get_state_info_512, we can stop as soon as a smaller state is found
+        if (buffer < bits) { return false; }
+        if (buffer == bits) { n += symmetry.eigenvalue.real(); }
+        if (basis_header.spin_inversion != 0) {
+            buffer ^= flip_mask;
+            if (buffer < bits) { return false; }
+            if (buffer == bits) { n += flip_coeff * symmetry.eigenvalue.real(); }
+        }
+    }
+
+    // We need to detect the case when norm is not zero, but only because of
+    // inaccurate arithmetics
+    constexpr auto norm_threshold = 1.0e-5;
+    if (std::abs(n) <= norm_threshold) { n = 0.0; }
+    LATTICE_SYMMETRIES_ASSERT(n >= 0.0, "");
+    return n > 0.0;
+}
 } // namespace lattice_symmetries::ARCH
 
 #if defined(LATTICE_SYMMETRIES_ADD_DISPATCH_CODE)
+#    include "../dispatch.hpp"
+#    include "../sublattice.hpp"
 namespace lattice_symmetries {
 auto get_state_info_64(basis_base_t const& basis_header, small_basis_t const& basis_body,
                        uint64_t bits, uint64_t& representative, std::complex<double>& character,
                        double& norm) noexcept -> void
 {
+    if (basis_body.sublattice != nullptr) {
+        return basis_body.sublattice->get_state_info(bits, representative, character, norm);
+    }
     LATTICE_SYMMETRIES_DISPATCH(get_state_info_64, basis_header, basis_body, bits, representative,
                                 character, norm);
 }
@@ -366,9 +457,51 @@ auto get_state_info_64(basis_base_t const& basis_header, small_basis_t const& ba
 auto is_representative_64(basis_base_t const& basis_header, small_basis_t const& basis_body,
                           uint64_t bits) noexcept -> bool
 {
+    if (basis_body.fast_reject != nullptr && basis_body.fast_reject->rejects(bits)) {
+        return false;
+    }
+    if (basis_body.sublattice != nullptr) { return basis_body.sublattice->is_representative(bits); }
     LATTICE_SYMMETRIES_DISPATCH(is_representative_64, basis_header, basis_body, bits);
 }
 
+auto batched_is_representative_64(basis_base_t const&  basis_header,
+                                  small_basis_t const& basis_body, uint64_t const bits[],
+                                  uint8_t out[]) noexcept -> void
+{
+    auto counts = fast_reject_t::counts_t{0, 0};
+    batched_is_representative_64(basis_header, basis_body, bits, out, counts);
+    if (basis_body.fast_reject != nullptr) { basis_body.fast_reject->record(counts); }
+}
+
+auto batched_is_representative_64(basis_base_t const&  basis_header,
+                                  small_basis_t const& basis_body, uint64_t const bits[],
+                                  uint8_t out[], fast_reject_t::counts_t& counts) noexcept -> void
+{
+    constexpr auto batch_size = batched_small_symmetry_t::batch_size;
+    if (basis_body.fast_reject != nullptr) {
+        auto rejected = uint64_t{0};
+        for (auto i = 0U; i < batch_size; ++i) {
+            out[i] = static_cast<uint8_t>(!basis_body.fast_reject->rejects(bits[i]));
+            rejected += static_cast<uint64_t>(out[i] == 0);
+        }
+        counts.checked += batch_size;
+        counts.rejected += rejected;
+        if (rejected == batch_size) { return; }
+    }
+    else {
+        std::fill(out, out + batch_size, uint8_t{1});
+    }
+    if (basis_body.sublattice != nullptr) {
+        for (auto i = 0U; i < batch_size; ++i) {
+            if (out[i] != 0) {
+                out[i] = static_cast<uint8_t>(basis_body.sublattice->is_representative(bits[i]));
+            }
+        }
+        return;
+    }
+    LATTICE_SYMMETRIES_DISPATCH(batched_is_representative_64, basis_header, basis_body, bits, out);
+}
+
 auto get_state_info_512(basis_base_t const& basis_header, big_basis_t const& basis_body,
                         ls_bits512 const& bits, ls_bits512& representative,
                         std::complex<double>& character, double& norm) noexcept -> void
@@ -376,5 +509,11 @@ auto get_state_info_512(basis_base_t const& basis_header, big_basis_t const& bas
     LATTICE_SYMMETRIES_DISPATCH(get_state_info_512, basis_header, basis_body, bits, representative,
                                 character, norm);
 }
+
+auto is_representative_512(basis_base_t const& basis_header, big_basis_t const& basis_body,
+                           ls_bits512 const& bits) noexcept -> bool
+{
+    LATTICE_SYMMETRIES_DISPATCH(is_representative_512, basis_header, basis_body, bits);
+}
 } // namespace lattice_symmetries
 #endif
@@ -8,9 +8,14 @@ namespace lattice_symmetries {
                            std::complex<double>& character, double& norm) noexcept->void;          \
     auto is_representative_64(basis_base_t const& basis_header, small_basis_t const& basis_body,   \
                               uint64_t bits) noexcept->bool;                                       \
+    auto batched_is_representative_64(basis_base_t const&  basis_header,                           \
+                                      small_basis_t const& basis_body, uint64_t const bits[],      \
+                                      uint8_t out[]) noexcept->void;                               \
     auto get_state_info_512(basis_base_t const& basis_header, big_basis_t const& basis_body,       \
                             ls_bits512 const& bits, ls_bits512& representative,                    \
-                            std::complex<double>& character, double& norm) noexcept->void;
+                            std::complex<double>& character, double& norm) noexcept->void;         \
+    auto is_representative_512(basis_base_t const& basis_header, big_basis_t const& basis_body,    \
+                               ls_bits512 const& bits) noexcept->bool;
 
 #define LATTICE_SYMMETRIES_DECLARE_FOR_ARCH(arch)                                                  \
     namespace arch {                                                                               \
@@ -19,6 +24,12 @@ namespace lattice_symmetries {
 
 LATTICE_SYMMETRIES_DECLARE()
 
+/// Same as batched_is_representative_64 above, but fast_reject_t statistics are added to \p counts
+/// instead of being recorded right away.
+auto batched_is_representative_64(basis_base_t const& basis_header, small_basis_t const& basis_body,
+                                  uint64_t const bits[], uint8_t out[],
+                                  fast_reject_t::counts_t& counts) noexcept -> void;
+
 LATTICE_SYMMETRIES_DECLARE_FOR_ARCH(avx2)
 LATTICE_SYMMETRIES_DECLARE_FOR_ARCH(avx)
 LATTICE_SYMMETRIES_DECLARE_FOR_ARCH(sse4)
@@ -0,0 +1,105 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "unpack_block.hpp"
+#include "lattice_symmetries/lattice_symmetries.h"
+#include <immintrin.h>
+
+#if LATTICE_SYMMETRIES_HAS_AVX2()
+#    define ARCH avx2
+#elif LATTICE_SYMMETRIES_HAS_AVX()
+#    define ARCH avx
+#elif LATTICE_SYMMETRIES_HAS_SSE4()
+#    define ARCH sse4
+#else
+#    define ARCH sse2
+#endif
+
+namespace lattice_symmetries::ARCH {
+
+LATTICE_SYMMETRIES_FORCEINLINE
+auto unpack_one(uint64_t const* words, unsigned const width, uint64_t const mask,
+                uint64_t const j) noexcept -> uint64_t
+{
+    auto const pos   = j * width;
+    auto const shift = pos % 64U;
+    auto const i     = pos / 64U;
+    // Branch-free: when shift == 0, the second word must not be mixed in
+    auto const x = (words[i] >> shift) | ((words[i + 1U] << (63U - shift)) << 1U);
+    return x & mask;
+}
+
+auto unpack_block(uint64_t const* words, unsigned const width, uint64_t const base,
+                  uint64_t const count, uint64_t* out) noexcept -> void
+{
+    auto const mask = width == 64U ? ~uint64_t{0} : ((uint64_t{1} << width) - 1U);
+    auto       j    = uint64_t{0};
+#if LATTICE_SYMMETRIES_HAS_AVX2()
+    // Four elements at a time: both words an element may span are gathered, and the variable
+    // shifts give 0 for shift counts of 64, i.e. there is no special case for aligned elements
+    auto const width_v = _mm256_set1_epi64x(static_cast<long long>(width));
+    auto const mask_v  = _mm256_set1_epi64x(static_cast<long long>(mask));
+    auto const base_v  = _mm256_set1_epi64x(static_cast<long long>(base));
+    auto const low_v   = _mm256_set1_epi64x(63);
+    auto const full_v  = _mm256_set1_epi64x(64);
+    auto       j_v     = _mm256_setr_epi64x(0, 1, 2, 3);
+    auto const step_v  = _mm256_set1_epi64x(4);
+    // NOLINTNEXTLINE: gathers take long long const*
+    auto const* table = reinterpret_cast<long long const*>(words);
+    for (; j + 4U <= count; j += 4U) {
+        auto const pos_v   = _mm256_mul_epu32(j_v, width_v);
+        auto const i_v     = _mm256_srli_epi64(pos_v, 6);
+        auto const shift_v = _mm256_and_si256(pos_v, low_v);
+        auto const lo_v    = _mm256_i64gather_epi64(table, i_v, 8);
+        auto const hi_v    = _mm256_i64gather_epi64(table + 1, i_v, 8);
+        auto const high_v  = _mm256_sllv_epi64(hi_v, _mm256_sub_epi64(full_v, shift_v));
+        auto const x_v     = _mm256_or_si256(_mm256_srlv_epi64(lo_v, shift_v), high_v);
+        auto const y_v     = _mm256_add_epi64(_mm256_and_si256(x_v, mask_v), base_v);
+        // NOLINTNEXTLINE: storeu takes __m256i*
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j), y_v);
+        j_v = _mm256_add_epi64(j_v, step_v);
+    }
+#endif
+    for (; j < count; ++j) {
+        out[j] = base + unpack_one(words, width, mask, j);
+    }
+}
+
+} // namespace lattice_symmetries::ARCH
+
+#if defined(LATTICE_SYMMETRIES_ADD_DISPATCH_CODE)
+#    include "../dispatch.hpp"
+namespace lattice_symmetries {
+LATTICE_SYMMETRIES_EXPORT
+auto unpack_block(uint64_t const* words, unsigned const width, uint64_t const base,
+                  uint64_t const count, uint64_t* out) noexcept -> void
+{
+    LATTICE_SYMMETRIES_DISPATCH(unpack_block, words, width, base, count, out);
+}
+} // namespace lattice_symmetries
+#endif
@@ -0,0 +1,55 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstdint>
+
+#define LATTICE_SYMMETRIES_DECLARE()                                                               \
+    auto unpack_block(uint64_t const* words, unsigned width, uint64_t base, uint64_t count,        \
+                      uint64_t* out) noexcept->void;
+#define LATTICE_SYMMETRIES_DECLARE_FOR_ARCH(arch)                                                  \
+    namespace arch {                                                                               \
+    LATTICE_SYMMETRIES_DECLARE()                                                                   \
+    } /*namespace arch*/
+
+namespace lattice_symmetries {
+
+/// Decodes a block of #compressed_states_t: element j (j < \p count) occupies bits
+/// [j * width, (j + 1) * width) of \p words and out[j] = base + element j. \p words must be
+/// readable up to and including word (count * width) / 64 + 1, and 0 < width <= 64.
+LATTICE_SYMMETRIES_DECLARE()
+LATTICE_SYMMETRIES_DECLARE_FOR_ARCH(avx2)
+LATTICE_SYMMETRIES_DECLARE_FOR_ARCH(avx)
+LATTICE_SYMMETRIES_DECLARE_FOR_ARCH(sse4)
+LATTICE_SYMMETRIES_DECLARE_FOR_ARCH(sse2)
+
+} // namespace lattice_symmetries
+
+#undef LATTICE_SYMMETRIES_DECLARE
+#undef LATTICE_SYMMETRIES_DECLARE_FOR_ARCH
@@ -0,0 +1,203 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "dispatch.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+namespace lattice_symmetries {
+
+namespace {
+#define LATTICE_SYMMETRIES_KERNEL_TABLE(arch_name, arch)                                           \
+    kernel_table_t                                                                                 \
+    {                                                                                              \
+        arch_name, &arch::search_sorted, &arch::benes_forward_64, &arch::benes_forward_512,        \
+            &arch::get_state_info_64, &arch::is_representative_64,                                 \
+            &arch::batched_is_representative_64, &arch::get_state_info_512,                        \
+            &arch::is_representative_512, &arch::unpack_block                                      \
+    }
+
+    constexpr auto make_kernel_table(ls_arch const arch) noexcept -> kernel_table_t
+    {
+        switch (arch) {
+        case LS_ARCH_AVX2: return LATTICE_SYMMETRIES_KERNEL_TABLE(LS_ARCH_AVX2, avx2);
+        case LS_ARCH_AVX: return LATTICE_SYMMETRIES_KERNEL_TABLE(LS_ARCH_AVX, avx);
+        case LS_ARCH_SSE4: return LATTICE_SYMMETRIES_KERNEL_TABLE(LS_ARCH_SSE4, sse4);
+        default: return LATTICE_SYMMETRIES_KERNEL_TABLE(LS_ARCH_SSE2, sse2);
+        }
+    }
+
+#undef LATTICE_SYMMETRIES_KERNEL_TABLE
+
+    constexpr kernel_table_t kernel_tables[] = {
+        make_kernel_table(LS_ARCH_SSE2), make_kernel_table(LS_ARCH_SSE4),
+        make_kernel_table(LS_ARCH_AVX), make_kernel_table(LS_ARCH_AVX2)};
+
+    constexpr auto kernel_table(ls_arch const arch) noexcept -> kernel_table_t const*
+    {
+        for (auto const& table : kernel_tables) {
+            if (table.arch == arch) { return &table; }
+        }
+        return &kernel_tables[0];
+    }
+
+    auto is_supported(ls_arch const arch) noexcept -> bool
+    {
+        switch (arch) {
+        case LS_ARCH_AVX2: return ls_has_avx2();
+        case LS_ARCH_AVX: return ls_has_avx();
+        case LS_ARCH_SSE4: return ls_has_sse4();
+        case LS_ARCH_SSE2: return true;
+        default: return false;
+        }
+    }
+
+    auto best_supported_arch() noexcept -> ls_arch
+    {
+        for (auto const arch : {LS_ARCH_AVX2, LS_ARCH_AVX, LS_ARCH_SSE4}) {
+            if (is_supported(arch)) { return arch; }
+        }
+        return LS_ARCH_SSE2;
+    }
+
+    /// Parses LATTICE_SYMMETRIES_ARCH. Names used by the Halide kernels are accepted as well.
+    auto arch_from_environment(ls_arch* out) noexcept -> bool
+    {
+        auto const* name = std::getenv("LATTICE_SYMMETRIES_ARCH");
+        if (name == nullptr) { return false; }
+        constexpr std::pair<char const*, ls_arch> names[] = {
+            {"sse2", LS_ARCH_SSE2}, {"generic", LS_ARCH_SSE2}, {"sse4", LS_ARCH_SSE4},
+            {"sse4_1", LS_ARCH_SSE4}, {"avx", LS_ARCH_AVX},    {"avx2", LS_ARCH_AVX2}};
+        for (auto const& [key, arch] : names) {
+            if (std::strcmp(name, key) == 0) {
+                *out = arch;
+                return true;
+            }
+        }
+        LATTICE_SYMMETRIES_LOG_DEBUG("Ignoring unknown LATTICE_SYMMETRIES_ARCH=%s\n", name);
+        return false;
+    }
+
+    constexpr auto arch_name(ls_arch const arch) noexcept -> char const*
+    {
+        switch (arch) {
+        case LS_ARCH_AVX2: return "avx2";
+        case LS_ARCH_AVX: return "avx";
+        case LS_ARCH_SSE4: return "sse4";
+        default: return "sse2";
+        }
+    }
+
+    /// Halide kernels are generated for a slightly different set of targets
+    constexpr auto halide_arch_name(ls_arch const arch) noexcept -> char const*
+    {
+        switch (arch) {
+        case LS_ARCH_AVX2: return "avx2";
+        case LS_ARCH_AVX: return "avx";
+        case LS_ARCH_SSE4: return "sse41";
+        default: return "generic";
+        }
+    }
+
+    /// Instruction set of the implementation of \p kernel which \p table points to.
+    template <class Pointer>
+    auto variant_of(kernel_table_t const& table, Pointer kernel_table_t::*kernel) noexcept
+        -> char const*
+    {
+        for (auto const& candidate : kernel_tables) {
+            if (candidate.*kernel == table.*kernel) { return arch_name(candidate.arch); }
+        }
+        return "unknown";
+    }
+
+    __attribute__((constructor)) auto init_dispatch_table() noexcept -> void
+    {
+        auto arch = best_supported_arch();
+        if (ls_arch requested; arch_from_environment(&requested)) {
+            if (is_supported(requested)) { arch = requested; }
+            else {
+                LATTICE_SYMMETRIES_LOG_DEBUG("LATTICE_SYMMETRIES_ARCH=%s is not supported by this "
+                                             "CPU, using %s\n",
+                                             arch_name(requested), arch_name(arch));
+            }
+        }
+        dispatch_table.store(kernel_table(arch), std::memory_order_relaxed);
+    }
+} // namespace
+
+// The baseline is constant-initialized, so kernels are usable even before init_dispatch_table
+std::atomic<kernel_table_t const*> dispatch_table{kernel_table(LS_ARCH_SSE2)}; // NOLINT
+
+} // namespace lattice_symmetries
+
+using namespace lattice_symmetries;
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_arch ls_get_kernel_arch()
+{
+    return dispatch_table.load(std::memory_order_relaxed)->arch;
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_set_kernel_arch(ls_arch const arch)
+{
+    if (!is_supported(arch)) { return LS_INVALID_ARGUMENT; }
+    dispatch_table.store(kernel_table(arch), std::memory_order_relaxed);
+    return LS_SUCCESS;
+}
+
+// cppcheck-suppress unusedFunction
+extern "C" LATTICE_SYMMETRIES_EXPORT uint64_t ls_get_kernel_info(ls_kernel_info info[],
+                                                                 uint64_t const size)
+{
+    auto const& table = *dispatch_table.load(std::memory_order_relaxed);
+    // clang-format off
+    ls_kernel_info const kernels[] = {
+        {"search_sorted", variant_of(table, &kernel_table_t::search_sorted)},
+        {"benes_forward_64", variant_of(table, &kernel_table_t::benes_forward_64)},
+        {"benes_forward_512", variant_of(table, &kernel_table_t::benes_forward_512)},
+        {"get_state_info_64", variant_of(table, &kernel_table_t::get_state_info_64)},
+        {"is_representative_64", variant_of(table, &kernel_table_t::is_representative_64)},
+        {"batched_is_representative_64",
+         variant_of(table, &kernel_table_t::batched_is_representative_64)},
+        {"get_state_info_512", variant_of(table, &kernel_table_t::get_state_info_512)},
+        {"is_representative_512", variant_of(table, &kernel_table_t::is_representative_512)},
+        {"unpack_block", variant_of(table, &kernel_table_t::unpack_block)},
+        // Halide kernels are not part of the table, but follow its choice of architecture
+        {"halide_state_info", halide_arch_name(table.arch)},
+        {"halide_is_representative", halide_arch_name(table.arch)},
+    };
+    // clang-format on
+    auto const count = std::size(kernels);
+    if (info != nullptr) { std::copy(kernels, kernels + std::min(count, size), info); }
+    return count;
+}
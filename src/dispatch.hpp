@@ -0,0 +1,65 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include "cpu/benes_forward_512.hpp"
+#include "cpu/benes_forward_64.hpp"
+#include "cpu/search_sorted.hpp"
+#include "cpu/state_info.hpp"
+#include "cpu/unpack_block.hpp"
+#include <atomic>
+
+namespace lattice_symmetries {
+
+/// Pointers to the implementations of hot kernels for one instruction set.
+///
+/// #dispatch_table is set once when the library is loaded (and again by ls_set_kernel_arch), so
+/// LATTICE_SYMMETRIES_DISPATCH is a single indirect call rather than a chain of CPU feature
+/// checks.
+struct kernel_table_t {
+    ls_arch arch;
+    decltype(&sse2::search_sorted)                search_sorted;
+    decltype(&sse2::benes_forward_64)             benes_forward_64;
+    decltype(&sse2::benes_forward_512)            benes_forward_512;
+    decltype(&sse2::get_state_info_64)            get_state_info_64;
+    decltype(&sse2::is_representative_64)         is_representative_64;
+    decltype(&sse2::batched_is_representative_64) batched_is_representative_64;
+    decltype(&sse2::get_state_info_512)           get_state_info_512;
+    decltype(&sse2::is_representative_512)        is_representative_512;
+    decltype(&sse2::unpack_block)                 unpack_block;
+};
+
+/// Points to one of the constant tables. Switching tables is a single atomic store, so
+/// ls_set_kernel_arch may race with kernels running on other threads: every call uses either the
+/// old or the new implementation.
+// NOLINTNEXTLINE: the pointer is only changed when the library is loaded or reconfigured
+extern std::atomic<kernel_table_t const*> dispatch_table;
+
+} // namespace lattice_symmetries
@@ -58,12 +58,12 @@ LATTICE_SYMMETRIES_EXPORT bool ls_has_avx2()
 LATTICE_SYMMETRIES_EXPORT bool ls_has_avx()
 {
     pthread_once(&cpu_info_once_control, &init_cpu_info);
-    return cpu_info.has_avx2;
+    return cpu_info.has_avx;
 }
 
 // cppcheck-suppress unusedFunction
 LATTICE_SYMMETRIES_EXPORT bool ls_has_sse4()
 {
     pthread_once(&cpu_info_once_control, &init_cpu_info);
-    return cpu_info.has_avx2;
+    return cpu_info.has_sse4;
 }
@@ -154,6 +154,10 @@ LATTICE_SYMMETRIES_EXPORT char const* ls_error_to_string(ls_error_code code)
         return "operator is complex. Are you trying to apply a complex operator to a real vector?";
     case LS_DIMENSION_MISMATCH:
         return "dimension of the operator does not match dimension of the vector";
+    case LS_CANCELLED: return "operation was cancelled by the progress callback";
+    case LS_CACHE_MISMATCH:
+        return "file contains a list of representatives of a different basis. Do the number of "
+               "spins, Hamming weight, spin inversion, and symmetry sectors match?";
     case LS_SYSTEM_ERROR:
     default: return "unknown error";
     }
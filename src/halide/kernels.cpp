@@ -39,56 +39,17 @@
 
 namespace lattice_symmetries {
 
-typedef int (*ls_internal_state_info_general_kernel_t)(
-    struct halide_buffer_t* _x_buffer, uint64_t _flip_mask, struct halide_buffer_t* _masks_buffer,
-    struct halide_buffer_t* _eigvals_re_buffer, struct halide_buffer_t* _eigvals_im_buffer,
-    struct halide_buffer_t* _shifts_buffer, struct halide_buffer_t* _representative_buffer,
-    struct halide_buffer_t* _character_buffer, struct halide_buffer_t* _norm_buffer);
-
-struct halide_kernels_list_t {
-    ls_internal_state_info_general_kernel_t general;
-    ls_internal_state_info_general_kernel_t symmetric;
-    ls_internal_state_info_general_kernel_t antisymmetric;
-};
-
 enum class proc_arch { generic, sse4_1, avx, avx2 };
 
+/// Follows the choice of the CPU kernels (i.e. LATTICE_SYMMETRIES_ARCH and ls_set_kernel_arch)
 inline auto current_architecture() -> proc_arch
 {
-    if (auto const* arch = std::getenv("LATTICE_SYMMETRIES_ARCH")) {
-        if (std::strcmp(arch, "generic") == 0) {
-            LATTICE_SYMMETRIES_LOG_DEBUG("%s\n", "Kernels will use no special instructions...");
-            return proc_arch::generic;
-        }
-        if (std::strcmp(arch, "sse4_1") == 0) {
-            LATTICE_SYMMETRIES_LOG_DEBUG("%s\n", "Kernels will use SSE4.1 instructions...");
-            return proc_arch::sse4_1;
-        }
-        if (std::strcmp(arch, "avx") == 0) {
-            LATTICE_SYMMETRIES_LOG_DEBUG("%s\n", "Kernels will use AVX instructions...");
-            return proc_arch::avx;
-        }
-        if (std::strcmp(arch, "avx2") == 0) {
-            LATTICE_SYMMETRIES_LOG_DEBUG("%s\n", "Kernels will use AVX2 instructions...");
-            return proc_arch::avx2;
-        }
-    }
-
-    __builtin_cpu_init();
-    if (__builtin_cpu_supports("avx2") > 0) {
-        LATTICE_SYMMETRIES_LOG_DEBUG("%s\n", "Kernels will use AVX2 instructions...");
-        return proc_arch::avx2;
-    }
-    if (__builtin_cpu_supports("avx") > 0) {
-        LATTICE_SYMMETRIES_LOG_DEBUG("%s\n", "Kernels will use AVX instructions...");
-        return proc_arch::avx;
+    switch (ls_get_kernel_arch()) {
+    case LS_ARCH_AVX2: return proc_arch::avx2;
+    case LS_ARCH_AVX: return proc_arch::avx;
+    case LS_ARCH_SSE4: return proc_arch::sse4_1;
+    default: return proc_arch::generic;
     }
-    if (__builtin_cpu_supports("sse4.1") > 0) {
-        LATTICE_SYMMETRIES_LOG_DEBUG("%s\n", "Kernels will use SSE4.1 instructions...");
-        return proc_arch::sse4_1;
-    }
-    LATTICE_SYMMETRIES_LOG_DEBUG("%s\n", "Kernels will use no special instructions...");
-    return proc_arch::generic;
 }
 
 #if IS_X86_64
@@ -112,33 +73,6 @@ inline auto current_architecture() -> proc_arch
         }(current_arch)
 #endif
 
-namespace {
-    halide_kernels_list_t init_halide_kernels()
-    {
-        __builtin_cpu_init();
-#if IS_X86_64
-        if (__builtin_cpu_supports("avx2") > 0) {
-            return {&ls_internal_state_info_general_kernel_64_avx2,
-                    &ls_internal_state_info_symmetric_kernel_64_avx2,
-                    &ls_internal_state_info_antisymmetric_kernel_64_avx2};
-        }
-        if (__builtin_cpu_supports("avx") > 0) {
-            return {&ls_internal_state_info_general_kernel_64_avx,
-                    &ls_internal_state_info_symmetric_kernel_64_avx,
-                    &ls_internal_state_info_antisymmetric_kernel_64_avx};
-        }
-        if (__builtin_cpu_supports("sse4.1") > 0) {
-            return {&ls_internal_state_info_general_kernel_64_sse41,
-                    &ls_internal_state_info_symmetric_kernel_64_sse41,
-                    &ls_internal_state_info_antisymmetric_kernel_64_sse41};
-        }
-#endif
-        return {&ls_internal_state_info_general_kernel_64,
-                &ls_internal_state_info_symmetric_kernel_64,
-                &ls_internal_state_info_antisymmetric_kernel_64};
-    }
-} // namespace
-
 struct halide_kernel_state {
     mutable halide_buffer_t _masks;
     mutable halide_buffer_t _eigvals_re;
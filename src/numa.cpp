@@ -0,0 +1,155 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "numa.hpp"
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <omp.h>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+namespace lattice_symmetries {
+
+auto number_numa_nodes() noexcept -> unsigned
+{
+    static auto const count = []() noexcept {
+        // The file contains a list of ranges such as "0-1" or "0,2-3"
+        auto in   = std::ifstream{"/sys/devices/system/node/possible"};
+        auto line = std::string{};
+        if (!in || !std::getline(in, line)) { return 1U; }
+        auto const  i     = line.find_last_of(",-");
+        auto const* begin = line.c_str() + (i == std::string::npos ? 0 : i + 1);
+        char*       end   = nullptr;
+        auto const  last  = std::strtoul(begin, &end, 10);
+        if (end == begin) { return 1U; }
+        return static_cast<unsigned>(last) + 1U;
+    }();
+    return count;
+}
+
+auto current_numa_node() noexcept -> unsigned
+{
+    thread_local auto const node = []() noexcept {
+        unsigned cpu       = 0;
+        unsigned numa_node = 0;
+        if (syscall(SYS_getcpu, &cpu, &numa_node, nullptr) != 0) { return 0U; }
+        return numa_node;
+    }();
+    return node;
+}
+
+namespace {
+    /// Sets the MPOL_INTERLEAVE policy for the pages in [address, address + size) and migrates
+    /// the pages which have already been touched. Returns false if the kernel refuses (e.g. when
+    /// mbind is blocked in a container).
+    auto interleave(void* address, uint64_t const size) -> bool
+    {
+        constexpr auto bits_per_word = 8U * sizeof(unsigned long);
+        auto const     nodes         = number_numa_nodes();
+        // Nodes which have no memory or are not in our cpuset are ignored by the kernel
+        auto mask = std::vector<unsigned long>((nodes + bits_per_word - 1U) / bits_per_word, ~0UL);
+        // maxnode is the number of bits in the mask plus one
+        return syscall(SYS_mbind, address, size, MPOL_INTERLEAVE, mask.data(),
+                       static_cast<unsigned long>(nodes) + 1UL, MPOL_MF_MOVE)
+               == 0;
+    }
+} // namespace
+
+auto place(std::vector<uint64_t> data, ls_numa_policy const policy) -> std::vector<uint64_t>
+{
+    if (policy == LS_NUMA_FIRST_TOUCH || data.empty()) { return data; }
+
+    // data has been touched by the calling thread. Whole pages are moved one by one: a thread
+    // copies the page into a buffer, returns the page to the kernel, and copies the contents back
+    // such that the page is allocated anew on its node. Compared to copying everything into a new
+    // vector, this needs one extra page per thread rather than twice the memory. Partial pages at
+    // the ends stay where they are.
+    auto const page_size      = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    auto const words_per_page = page_size / sizeof(uint64_t);
+    auto const address        = reinterpret_cast<uintptr_t>(data.data());
+    auto const first          = (address + page_size - 1U) / page_size * page_size;
+    auto const last = (address + data.size() * sizeof(uint64_t)) / page_size * page_size;
+    if (first >= last) { return data; }
+
+    auto const  number_pages = (last - first) / page_size;
+    auto* const pages        = data.data() + (first - address) / sizeof(uint64_t);
+    auto const  move_page = [pages, page_size, words_per_page](uint64_t const k, uint64_t* buffer) {
+        auto* const page = pages + k * words_per_page;
+        std::copy(page, page + words_per_page, buffer);
+        // If madvise fails, the page simply stays where it is
+        static_cast<void>(madvise(page, page_size, MADV_DONTNEED));
+        std::copy(buffer, buffer + words_per_page, page);
+    };
+    if (policy == LS_NUMA_INTERLEAVE) {
+        // The kernel distributes the pages over nodes round-robin, regardless of where the
+        // OpenMP threads run
+        if (interleave(pages, number_pages * page_size)) { return data; }
+        // Otherwise pages are spread over threads, which only spreads them over nodes when the
+        // threads are pinned
+#pragma omp parallel default(none) firstprivate(number_pages, words_per_page, move_page)
+        {
+            auto buffer = std::vector<uint64_t>(words_per_page);
+#pragma omp for schedule(static, 1)
+            for (auto k = uint64_t{0}; k < number_pages; ++k) {
+                move_page(k, buffer.data());
+            }
+        }
+    }
+    else {
+#pragma omp parallel default(none) firstprivate(number_pages, words_per_page, move_page)
+        {
+            auto buffer = std::vector<uint64_t>(words_per_page);
+#pragma omp for schedule(static)
+            for (auto k = uint64_t{0}; k < number_pages; ++k) {
+                move_page(k, buffer.data());
+            }
+        }
+    }
+    return data;
+}
+
+replicated_table_t::replicated_table_t(std::vector<uint64_t> const& table) : _replicas{}
+{
+    if (number_numa_nodes() <= 1U) { return; }
+    _replicas.resize(number_numa_nodes());
+#pragma omp parallel default(none) shared(table)
+    {
+        auto const node = current_numa_node();
+#pragma omp critical
+        if (node < _replicas.size() && _replicas[node].empty()) {
+            // Allocated and first touched by a thread running on node
+            _replicas[node] = table;
+        }
+    }
+}
+
+} // namespace lattice_symmetries
@@ -0,0 +1,72 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "lattice_symmetries/lattice_symmetries.h"
+#include <cstdint>
+#include <vector>
+
+namespace lattice_symmetries {
+
+/// Number of NUMA nodes in the system (1 if it cannot be determined).
+auto number_numa_nodes() noexcept -> unsigned;
+/// NUMA node of the CPU on which the calling thread ran when it first called this function.
+///
+/// The value is cached, so it is only meaningful when threads are pinned (e.g. with
+/// OMP_PROC_BIND=spread).
+auto current_numa_node() noexcept -> unsigned;
+
+/// Moves the pages of \p data (in place) according to \p policy. For LS_NUMA_INTERLEAVE the
+/// pages are interleaved over NUMA nodes with mbind. For LS_NUMA_PARTITION they are moved to the
+/// nodes of OpenMP threads by first touch. For LS_NUMA_FIRST_TOUCH \p data is returned
+/// unchanged.
+auto place(std::vector<uint64_t> data, ls_numa_policy policy) -> std::vector<uint64_t>;
+
+/// Per-node copies of a small read-only table (e.g. bucket offsets of #basis_cache_t).
+///
+/// Every copy is made by a thread running on the corresponding node such that the memory is
+/// allocated there. Nodes on which no OpenMP thread runs do not get a copy.
+class replicated_table_t {
+    std::vector<std::vector<uint64_t>> _replicas; // indexed by NUMA node
+
+  public:
+    replicated_table_t() noexcept = default;
+    explicit replicated_table_t(std::vector<uint64_t> const& table);
+
+    /// Returns the copy on the node of the calling thread or \p fallback if there is none.
+    [[nodiscard]] auto local_or(uint64_t const* fallback) const noexcept -> uint64_t const*
+    {
+        if (_replicas.empty()) { return fallback; }
+        auto const node = current_numa_node();
+        if (node >= _replicas.size() || _replicas[node].empty()) { return fallback; }
+        return _replicas[node].data();
+    }
+};
+
+} // namespace lattice_symmetries
@@ -1,12 +1,15 @@
 #include "operator.hpp"
 #include "basis.hpp"
 #include "bits.hpp"
+#include "cache.hpp"
+#include "progress.hpp"
 #include "lattice_symmetries/lattice_symmetries.h"
 #include <omp.h>
 #include <algorithm>
 #include <complex>
 #include <cstdlib>
 #include <cstring>
+#include <limits>
 #include <memory>
 #include <numeric>
 #include <span.hpp>
@@ -16,6 +19,8 @@
 namespace lattice_symmetries {
 
 inline constexpr auto l1_cache_size = 64;
+// How many states a thread processes between updates of the shared progress counter
+inline constexpr auto progress_batch_size = uint64_t{1024};
 
 template <class T, class = void> struct is_complex : std::false_type {};
 template <class T>
@@ -496,64 +501,137 @@ template <class T> struct block_acc_t {
 };
 
 namespace {
-    auto get_basis_representatives(ls_spin_basis const& basis) noexcept
-        -> outcome::result<tcb::span<uint64_t const>>
+    auto get_number_states(ls_spin_basis const& basis) noexcept -> outcome::result<uint64_t>
     {
-        ls_states* states = nullptr;
-        auto const status = ls_get_states(&states, &basis);
-        if (status != LS_SUCCESS) { return status; }
-        auto const representatives =
-            tcb::span<uint64_t const>{ls_states_get_data(states), ls_states_get_size(states)};
-        ls_destroy_states(states);
-        return representatives;
+        uint64_t   count  = 0;
+        auto const status = ls_get_number_states(&basis, &count);
+        if (status != LS_SUCCESS) { return outcome::failure(status); }
+        return count;
     }
+
+    /// Cache of a basis which is resolved once per matmat or expectation call, such that the inner
+    /// loops call the index directly rather than going through the C API (i.e. visiting the
+    /// variant and checking the cache) for every state.
+    class basis_lookup_t {
+        basis_cache_t const*     _small;
+        big_basis_cache_t const* _big;
+
+      public:
+        /// The cache must have been built or loaded (i.e. get_number_states must have succeeded).
+        explicit basis_lookup_t(ls_spin_basis const& basis) noexcept
+            : _small{get_small_cache(basis)}, _big{get_big_cache(basis)}
+        {
+            LATTICE_SYMMETRIES_ASSERT(_small != nullptr || _big != nullptr, "cache is not built");
+        }
+
+        [[nodiscard]] auto state(uint64_t const index, ls_bits512& out) const noexcept
+            -> ls_error_code
+        {
+            if (_small != nullptr) {
+                set_zero(out);
+                return _small->state(index, &out.words[0]);
+            }
+            return _big->state(index, out);
+        }
+
+        [[nodiscard]] auto index(ls_bits512 const& spin, uint64_t* out) const noexcept
+            -> ls_error_code
+        {
+            // Spin configurations of small bases only occupy the first word
+            if (_small != nullptr) { return _small->index(spin.words[0], out); }
+            return _big->index(spin, out);
+        }
+    };
+
+    /// Sets the schedule of `schedule(runtime)` loops and restores the previous one afterwards.
+    ///
+    /// With LS_NUMA_PARTITION rows are distributed statically such that thread i processes the
+    /// part of the list of representatives (and of x and y) which was first touched by it.
+    /// Otherwise, dynamic scheduling is used to balance the load.
+    class scoped_schedule_t {
+        omp_sched_t _kind;
+        int         _chunk_size;
+
+      public:
+        scoped_schedule_t(ls_spin_basis const& basis, uint64_t const number_states) noexcept
+            : _kind{}, _chunk_size{}
+        {
+            omp_get_schedule(&_kind, &_chunk_size);
+            if (ls_get_numa_policy(&basis) == LS_NUMA_PARTITION) {
+                omp_set_schedule(omp_sched_static, 0);
+                return;
+            }
+            constexpr auto max_chunk_size = static_cast<uint64_t>(std::numeric_limits<int>::max());
+            auto const     chunk_size     = std::clamp<uint64_t>(
+                number_states / (100U * static_cast<unsigned>(omp_get_max_threads())), 500U,
+                max_chunk_size);
+            omp_set_schedule(omp_sched_dynamic, static_cast<int>(chunk_size));
+        }
+        scoped_schedule_t(scoped_schedule_t const&) = delete;
+        scoped_schedule_t(scoped_schedule_t&&)      = delete;
+        auto operator=(scoped_schedule_t const&) -> scoped_schedule_t& = delete;
+        auto operator=(scoped_schedule_t&&) -> scoped_schedule_t& = delete;
+        ~scoped_schedule_t() noexcept { omp_set_schedule(_kind, _chunk_size); }
+    };
 } // namespace
 
 template <class T>
 auto matmat_helper(ls_operator const& op, uint64_t const size, uint64_t const block_size,
-                   T const* x, uint64_t const x_stride, T* y, uint64_t const y_stride) noexcept
-    -> outcome::result<void>
+                   T const* x, uint64_t const x_stride, T* y, uint64_t const y_stride,
+                   progress_t* progress) noexcept -> outcome::result<void>
 {
     if (!is_complex_v<T> && !op.is_real) { return LS_OPERATOR_IS_COMPLEX; }
     // gcc-7.3 gets confused by OUTCOME_TRY here (because of auto&&), so we expand it manually
-    auto&& _r = get_basis_representatives(*op.basis);
+    auto&& _r = get_number_states(*op.basis);
     if (!_r) { return _r.as_failure(); }
-    auto const representatives = _r.value(); // OUTCOME_TRY uses auto&& here
-    if (size != representatives.size()) { return LS_DIMENSION_MISMATCH; }
+    auto const number_states = _r.value(); // OUTCOME_TRY uses auto&& here
+    if (size != number_states) { return LS_DIMENSION_MISMATCH; }
 
     alignas(l1_cache_size) auto status    = LS_SUCCESS;
     alignas(l1_cache_size) auto block_acc = block_acc_t<T>{block_size};
     using acc_t                           = typename block_acc_t<T>::acc_t;
 
-    auto const chunk_size = std::max<uint64_t>(
-        500U, representatives.size() / (100U * static_cast<unsigned>(omp_get_max_threads())));
-#pragma omp parallel for default(none) schedule(dynamic, chunk_size)                               \
-    firstprivate(x, x_stride, y, y_stride, chunk_size, representatives)                            \
-        shared(status, block_acc, op)
-    for (auto i = uint64_t{0}; i < representatives.size(); ++i) {
+    auto const lookup   = basis_lookup_t{*op.basis};
+    auto const schedule = scoped_schedule_t{*op.basis, number_states};
+    if (progress != nullptr) { progress->start(number_states); }
+#pragma omp parallel for default(none) schedule(runtime)                                           \
+    firstprivate(x, x_stride, y, y_stride, number_states, progress)                               \
+        shared(status, block_acc, op, lookup)
+    for (auto i = uint64_t{0}; i < number_states; ++i) {
         ls_error_code local_status; // NOLINT: initialized by atomic read
 #pragma omp atomic read
         local_status = status;
         if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) { continue; }
-        // Load the representative into ls_bits512
-        ls_bits512 local_state; // NOLINT: initialized by set_zero
-        set_zero(local_state);
-        local_state.words[0] = representatives[i];
+        if (progress != nullptr) {
+            if (LATTICE_SYMMETRIES_UNLIKELY(progress->cancelled())) { continue; }
+            // Every index is visited exactly once, so this counts all states up to
+            // progress_batch_size per thread without touching the shared counter on every step
+            if (i % progress_batch_size == 0) { progress->advance(progress_batch_size); }
+        }
+        // Load the representative into ls_bits512. For bases without symmetries this computes the
+        // state from its index rather than reading it from memory.
+        ls_bits512 local_state; // NOLINT: initialized by basis_lookup_t::state
+        local_status = lookup.state(i, local_state);
+        if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) {
+#pragma omp atomic write
+            status = local_status;
+            continue;
+        }
         // Reset the accumulator
         auto const thread_num = static_cast<unsigned>(omp_get_thread_num());
         block_acc.set_zero(thread_num);
         // Define a callback function
         struct cxt_t {
-            tcb::span<acc_t> const     acc;
-            ls_spin_basis const* const basis;
-            T const* const             x;
-            uint64_t const             x_stride;
+            tcb::span<acc_t> const      acc;
+            basis_lookup_t const* const basis;
+            T const* const              x;
+            uint64_t const              x_stride;
         };
-        auto cxt  = cxt_t{block_acc[thread_num], op.basis.get(), x, x_stride};
+        auto cxt  = cxt_t{block_acc[thread_num], &lookup, x, x_stride};
         auto func = [](ls_bits512 const* spin, void const* coeff, void* raw_cxt) noexcept {
             auto const& _cxt = *static_cast<cxt_t*>(raw_cxt);
-            uint64_t    index; // NOLINT: index is initialized by ls_get_index
-            auto const  _status = ls_get_index(_cxt.basis, spin->words[0], &index);
+            uint64_t    index; // NOLINT: index is initialized by basis_lookup_t::index
+            auto const  _status = _cxt.basis->index(*spin, &index);
             if (LATTICE_SYMMETRIES_LIKELY(_status == LS_SUCCESS)) {
                 for (auto j = uint64_t{0}; j < _cxt.acc.size(); ++j) {
                     if constexpr (is_complex_v<T>) {
@@ -581,6 +659,10 @@ auto matmat_helper(ls_operator const& op, uint64_t const size, uint64_t const bl
             }
         }
     }
+    if (progress != nullptr && status == LS_SUCCESS) {
+        if (!progress->cancelled()) { progress->finish(); }
+        if (progress->cancelled()) { return LS_CANCELLED; }
+    }
     return status;
 }
 
@@ -590,44 +672,49 @@ auto expectation_helper(ls_operator const& op, uint64_t const size, uint64_t con
     -> outcome::result<void>
 {
     // gcc-7.3 gets confused by OUTCOME_TRY here (because of auto&&), so we expand it manually
-    auto&& _r = get_basis_representatives(*op.basis);
+    auto&& _r = get_number_states(*op.basis);
     if (!_r) { return _r.as_failure(); }
-    auto const representatives = _r.value(); // OUTCOME_TRY uses auto&& here
-    if (size != representatives.size()) { return LS_DIMENSION_MISMATCH; }
+    auto const number_states = _r.value(); // OUTCOME_TRY uses auto&& here
+    if (size != number_states) { return LS_DIMENSION_MISMATCH; }
 
     alignas(l1_cache_size) auto status    = LS_SUCCESS;
     alignas(l1_cache_size) auto block_acc = block_acc_t<std::complex<double>>{block_size};
     alignas(l1_cache_size) auto sum_acc   = block_acc_t<std::complex<double>>{block_size};
     using acc_t                           = std::complex<double>;
 
-    auto const chunk_size = std::max<uint64_t>(
-        500U, representatives.size() / (100U * static_cast<unsigned>(omp_get_max_threads())));
-#pragma omp parallel for default(none) schedule(dynamic, chunk_size)                               \
-    firstprivate(x, x_stride, chunk_size, representatives) shared(status, block_acc, sum_acc, op)
-    for (auto i = uint64_t{0}; i < representatives.size(); ++i) {
+    auto const lookup   = basis_lookup_t{*op.basis};
+    auto const schedule = scoped_schedule_t{*op.basis, number_states};
+#pragma omp parallel for default(none) schedule(runtime)                                           \
+    firstprivate(x, x_stride, number_states) shared(status, block_acc, sum_acc, op, lookup)
+    for (auto i = uint64_t{0}; i < number_states; ++i) {
         ls_error_code local_status; // NOLINT: initialized by atomic read
 #pragma omp atomic read
         local_status = status;
         if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) { continue; }
-        // Load the representative into ls_bits512
-        ls_bits512 local_state; // NOLINT: initialized by set_zero
-        set_zero(local_state);
-        local_state.words[0] = representatives[i];
+        // Load the representative into ls_bits512. For bases without symmetries this computes the
+        // state from its index rather than reading it from memory.
+        ls_bits512 local_state; // NOLINT: initialized by basis_lookup_t::state
+        local_status = lookup.state(i, local_state);
+        if (LATTICE_SYMMETRIES_UNLIKELY(local_status != LS_SUCCESS)) {
+#pragma omp atomic write
+            status = local_status;
+            continue;
+        }
         // Reset the accumulator
         auto const thread_num = static_cast<unsigned>(omp_get_thread_num());
         block_acc.set_zero(thread_num);
         // Define a callback function
         struct cxt_t { // NOLINT: we don't care about constructors here
-            tcb::span<acc_t> const     acc;
-            ls_spin_basis const* const basis;
-            T const* const             x;
-            uint64_t const             x_stride;
+            tcb::span<acc_t> const      acc;
+            basis_lookup_t const* const basis;
+            T const* const              x;
+            uint64_t const              x_stride;
         };
-        auto cxt  = cxt_t{block_acc[thread_num], op.basis.get(), x, x_stride};
+        auto cxt  = cxt_t{block_acc[thread_num], &lookup, x, x_stride};
         auto func = [](ls_bits512 const* spin, void const* coeff, void* raw_cxt) noexcept {
             auto const& _cxt = *static_cast<cxt_t*>(raw_cxt);
-            uint64_t    index; // NOLINT: index is initialized by ls_get_index
-            auto const  _status = ls_get_index(_cxt.basis, spin->words[0], &index);
+            uint64_t    index; // NOLINT: index is initialized by basis_lookup_t::index
+            auto const  _status = _cxt.basis->index(*spin, &index);
             if (LATTICE_SYMMETRIES_LIKELY(_status == LS_SUCCESS)) {
                 for (auto j = uint64_t{0}; j < _cxt.acc.size(); ++j) {
                     using T_ = typename block_acc_t<T>::acc_t;
@@ -685,12 +772,23 @@ extern "C" LATTICE_SYMMETRIES_EXPORT uint64_t ls_operator_max_buffer_size(ls_ope
 // NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
 #define LS_CALL_MATMAT_HELPER(dtype)                                                               \
     matmat_helper<dtype>(*op, size, block_size, static_cast<dtype const*>(x), x_stride,            \
-                         static_cast<dtype*>(y), y_stride) // NOLINT(bugprone-macro-parentheses)
+                         static_cast<dtype*>(y), y_stride,                                         \
+                         progress.get()) // NOLINT(bugprone-macro-parentheses)
 
 extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code
 ls_operator_matmat(ls_operator const* op, ls_datatype dtype, uint64_t size, uint64_t block_size,
                    void const* x, uint64_t x_stride, void* y, uint64_t y_stride)
 {
+    return ls_operator_matmat_with_progress(op, dtype, size, block_size, x, x_stride, y, y_stride,
+                                            nullptr, nullptr);
+}
+
+extern "C" LATTICE_SYMMETRIES_EXPORT ls_error_code ls_operator_matmat_with_progress(
+    ls_operator const* op, ls_datatype dtype, uint64_t size, uint64_t block_size, void const* x,
+    uint64_t x_stride, void* y, uint64_t y_stride, ls_progress_callback callback, void* cxt)
+{
+    auto progress =
+        callback != nullptr ? std::make_unique<progress_t>(callback, cxt) : nullptr;
     auto r = [&]() noexcept -> outcome::result<void> {
         switch (dtype) {
         case LS_FLOAT32: return LS_CALL_MATMAT_HELPER(float);
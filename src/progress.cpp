@@ -0,0 +1,89 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "progress.hpp"
+#include <algorithm>
+
+namespace lattice_symmetries {
+
+progress_t::progress_t(ls_progress_callback const callback, void* cxt) noexcept
+    : _callback{callback}
+    , _cxt{cxt}
+    , _total{0}
+    , _start{clock_type::now()}
+    , _processed{0}
+    , _last_report{0}
+    , _cancelled{false}
+    , _mutex{}
+{}
+
+auto progress_t::start(uint64_t const total) noexcept -> void
+{
+    _total = total;
+    _start = clock_type::now();
+    _processed.store(0, std::memory_order_relaxed);
+    _last_report.store(0, std::memory_order_relaxed);
+    _cancelled.store(false, std::memory_order_relaxed);
+}
+
+auto progress_t::report(uint64_t processed, clock_type::duration const elapsed) noexcept -> void
+{
+    // Counters are updated in batches and may slightly overshoot
+    processed = std::min(processed, _total);
+    auto const seconds = std::chrono::duration<double>{elapsed}.count();
+    auto const eta =
+        processed == 0
+            ? -1.0
+            : seconds * static_cast<double>(_total - processed) / static_cast<double>(processed);
+    auto const info = ls_progress{processed, _total, seconds, eta};
+    if (!(*_callback)(&info, _cxt)) { _cancelled.store(true, std::memory_order_relaxed); }
+}
+
+auto progress_t::advance(uint64_t const count) noexcept -> void
+{
+    auto const processed = _processed.fetch_add(count, std::memory_order_relaxed) + count;
+    auto const elapsed   = clock_type::now() - _start;
+    auto const nanoseconds =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    auto last = _last_report.load(std::memory_order_relaxed);
+    if (nanoseconds - last < std::chrono::nanoseconds{report_interval}.count()) { return; }
+    // Only one thread gets to call the callback; others simply carry on
+    if (!_last_report.compare_exchange_strong(last, nanoseconds, std::memory_order_relaxed)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock{_mutex};
+    if (!cancelled()) { report(processed, elapsed); }
+}
+
+auto progress_t::finish() noexcept -> void
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    if (!cancelled()) { report(_total, clock_type::now() - _start); }
+}
+
+} // namespace lattice_symmetries
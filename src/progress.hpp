@@ -0,0 +1,76 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "lattice_symmetries/lattice_symmetries.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace lattice_symmetries {
+
+/// Counts processed states in long-running parallel loops and reports them to a user-supplied
+/// callback.
+///
+/// #advance may be called concurrently from multiple threads. The callback is invoked by at most
+/// one thread at a time and not more often than once per `report_interval`. Once it returns
+/// false, #cancelled becomes true and loops are expected to skip their remaining work.
+class progress_t {
+    using clock_type = std::chrono::steady_clock;
+
+    ls_progress_callback   _callback;
+    void*                  _cxt;
+    uint64_t               _total;
+    clock_type::time_point _start;
+    std::atomic<uint64_t>  _processed;
+    std::atomic<int64_t>   _last_report; // nanoseconds since _start
+    std::atomic<bool>      _cancelled;
+    std::mutex             _mutex;
+
+    auto report(uint64_t processed, clock_type::duration elapsed) noexcept -> void;
+
+  public:
+    static constexpr auto report_interval = std::chrono::milliseconds{100};
+
+    progress_t(ls_progress_callback callback, void* cxt) noexcept;
+
+    /// Resets the counter and the clock.
+    auto start(uint64_t total) noexcept -> void;
+    auto advance(uint64_t count) noexcept -> void;
+    /// Unconditionally reports that all states have been processed (the callback may still
+    /// cancel the operation at this point).
+    auto finish() noexcept -> void;
+    [[nodiscard]] auto cancelled() const noexcept -> bool
+    {
+        return _cancelled.load(std::memory_order_relaxed);
+    }
+};
+
+} // namespace lattice_symmetries
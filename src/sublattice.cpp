@@ -0,0 +1,329 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "sublattice.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <map>
+
+namespace lattice_symmetries {
+
+namespace {
+    // Upper bound on the total size of lookup tables
+    constexpr auto memory_budget = uint64_t{16} * 1024U * 1024U;
+    // We need to detect the case when norm is not zero, but only because of
+    // inaccurate arithmetics
+    constexpr auto norm_threshold = 1.0e-5;
+
+    auto get_flip_mask(unsigned const n) noexcept -> uint64_t
+    {
+        // NOLINTNEXTLINE: 64 is the number of bits in uint64_t
+        return n == 0U ? uint64_t{0} : ((~uint64_t{0}) >> (64U - n));
+    }
+
+    /// Returns `sources` such that bit `sources[k * number_spins + i]` of x ends up at position i
+    /// in symmetries[k](x).
+    auto compute_sources(tcb::span<small_symmetry_t const> symmetries, unsigned const number_spins)
+        -> std::vector<uint16_t>
+    {
+        std::vector<uint16_t> sources(symmetries.size() * number_spins);
+        for (auto k = uint64_t{0}; k < symmetries.size(); ++k) {
+            for (auto i = 0U; i < number_spins; ++i) {
+                auto const y = symmetries[k].network(uint64_t{1} << i);
+                LATTICE_SYMMETRIES_CHECK(y != 0, "network is not a permutation");
+                auto const j = static_cast<unsigned>(__builtin_ctzl(y));
+                sources[k * number_spins + j] = static_cast<uint16_t>(i);
+            }
+        }
+        return sources;
+    }
+
+    auto group_by_sources(tcb::span<uint16_t const> sources, unsigned const number_spins,
+                          unsigned const chunk_bits) -> std::map<uint64_t, std::vector<uint32_t>>
+    {
+        std::map<uint64_t, std::vector<uint32_t>> groups;
+        auto const number_networks = sources.size() / number_spins;
+        for (auto k = uint64_t{0}; k < number_networks; ++k) {
+            auto mask = uint64_t{0};
+            for (auto i = number_spins - chunk_bits; i < number_spins; ++i) {
+                mask |= uint64_t{1} << sources[k * number_spins + i];
+            }
+            groups[mask].push_back(static_cast<uint32_t>(k));
+        }
+        return groups;
+    }
+
+    /// Splits groups into blocks such that candidates in every block fit into a uint64_t.
+    auto split_into_blocks(std::map<uint64_t, std::vector<uint32_t>> const& groups,
+                           unsigned const elements_per_network)
+        -> std::vector<std::pair<uint64_t, std::vector<uint32_t>>>
+    {
+        auto const max_networks = 64U / elements_per_network;
+        std::vector<std::pair<uint64_t, std::vector<uint32_t>>> blocks;
+        for (auto const& [mask, group] : groups) {
+            for (auto i = uint64_t{0}; i < group.size(); i += max_networks) {
+                auto const last = std::min<uint64_t>(i + max_networks, group.size());
+                auto const first = std::next(std::begin(group), static_cast<std::ptrdiff_t>(i));
+                auto const bound = std::next(std::begin(group), static_cast<std::ptrdiff_t>(last));
+                blocks.emplace_back(mask, std::vector<uint32_t>{first, bound});
+            }
+        }
+        return blocks;
+    }
+
+    auto table_bytes(uint64_t const mask, unsigned const chunk_bits) noexcept -> uint64_t
+    {
+        auto const first_byte = static_cast<unsigned>(__builtin_ctzl(mask)) / 8U;
+        auto const last_byte  = (63U - static_cast<unsigned>(__builtin_clzl(mask))) / 8U;
+        auto const size       = uint64_t{1} << chunk_bits;
+        return (last_byte - first_byte + 1U) * 256U * sizeof(uint16_t)
+               + size * (sizeof(uint16_t) + sizeof(uint64_t));
+    }
+} // namespace
+
+sublattice_engine_t::sublattice_engine_t(basis_base_t const& header, small_basis_t const& payload)
+    : _chunk_bits{}, _shift{}, _networks{}, _elements{}, _blocks{}
+{
+    auto const number_spins  = header.number_spins;
+    auto const sources       = compute_sources(payload.symmetries, number_spins);
+    auto const elements_each = header.spin_inversion != 0 ? 2U : 1U;
+
+    // Choose the chunk size. Fewer blocks means fewer lookups per query and larger chunks mean
+    // fewer candidates to check using full networks.
+    auto best_blocks    = std::vector<std::pair<uint64_t, std::vector<uint32_t>>>{};
+    auto const max_bits = std::min(number_spins, 16U);
+    auto const min_bits = std::min(number_spins, 8U);
+    for (auto bits = max_bits; bits >= min_bits; --bits) {
+        auto blocks = split_into_blocks(group_by_sources(sources, number_spins, bits), elements_each);
+        auto memory = uint64_t{0};
+        for (auto const& [mask, _] : blocks) {
+            memory += table_bytes(mask, bits);
+        }
+        if ((best_blocks.empty() || blocks.size() < best_blocks.size())
+            && (memory <= memory_budget || bits == min_bits)) {
+            best_blocks = std::move(blocks);
+            _chunk_bits = bits;
+        }
+    }
+    _shift = number_spins - _chunk_bits;
+
+    _networks.reserve(payload.symmetries.size());
+    _elements.reserve(elements_each * payload.symmetries.size());
+    auto const flip_mask = get_flip_mask(number_spins);
+    for (auto k = uint32_t{0}; k < payload.symmetries.size(); ++k) {
+        auto const& symmetry = payload.symmetries[k];
+        _networks.push_back(symmetry.network);
+        _elements.push_back({k, uint64_t{0}, symmetry.eigenvalue});
+        if (header.spin_inversion != 0) {
+            _elements.push_back(
+                {k, flip_mask, static_cast<double>(header.spin_inversion) * symmetry.eigenvalue});
+        }
+    }
+
+    _blocks.resize(best_blocks.size());
+    std::vector<uint64_t> masks;
+    masks.reserve(best_blocks.size());
+    for (auto i = uint64_t{0}; i < best_blocks.size(); ++i) {
+        auto const& [mask, group] = best_blocks[i];
+        masks.push_back(mask);
+        for (auto const k : group) {
+            for (auto j = 0U; j < elements_each; ++j) {
+                _blocks[i].elements.push_back(elements_each * k + j);
+            }
+        }
+    }
+
+    auto const chunk_bits = _chunk_bits;
+#pragma omp parallel for schedule(dynamic, 1) default(none)                                        \
+    shared(masks, sources) firstprivate(number_spins, chunk_bits)
+    for (auto i = uint64_t{0}; i < _blocks.size(); ++i) {
+        auto&      block = _blocks[i];
+        auto const mask  = masks[i];
+
+        // Position of every spin of the source set within the extracted chunk
+        std::array<unsigned, 64> rank{};
+        for (auto j = 0U, r = 0U; j < 64U; ++j) {
+            if (((mask >> j) & 1U) != 0U) { rank[j] = r++; }
+        }
+
+        block.first_byte = static_cast<unsigned>(__builtin_ctzl(mask)) / 8U;
+        block.last_byte  = (63U - static_cast<unsigned>(__builtin_clzl(mask))) / 8U;
+        block.extract.resize((block.last_byte - block.first_byte + 1U) * 256U);
+        for (auto c = block.first_byte; c <= block.last_byte; ++c) {
+            for (auto v = 0U; v < 256U; ++v) {
+                auto out = 0U;
+                for (auto j = 0U; j < 8U; ++j) {
+                    auto const site = 8U * c + j;
+                    if (((mask >> site) & 1U) != 0U && ((v >> j) & 1U) != 0U) {
+                        out |= 1U << rank[site];
+                    }
+                }
+                block.extract[(c - block.first_byte) * 256U + v] = static_cast<uint16_t>(out);
+            }
+        }
+
+        // Maps extracted chunk to the topmost chunk of the image, one byte at a time
+        auto const           number_elements = block.elements.size();
+        std::vector<uint16_t> low(number_elements * 256U);
+        std::vector<uint16_t> high(number_elements * 256U);
+        std::vector<uint16_t> flips(number_elements);
+        for (auto l = uint64_t{0}; l < number_elements; ++l) {
+            auto const& element = _elements[block.elements[l]];
+            flips[l] = static_cast<uint16_t>(element.flip >> (number_spins - chunk_bits));
+            for (auto v = 0U; v < 256U; ++v) {
+                auto lo = 0U;
+                auto hi = 0U;
+                for (auto t = 0U; t < chunk_bits; ++t) {
+                    auto const source =
+                        sources[element.network * number_spins + number_spins - chunk_bits + t];
+                    auto const r = rank[source];
+                    if (r < 8U) { lo |= ((v >> r) & 1U) << t; }
+                    else {
+                        hi |= ((v >> (r - 8U)) & 1U) << t;
+                    }
+                }
+                low[l * 256U + v]  = static_cast<uint16_t>(lo);
+                high[l * 256U + v] = static_cast<uint16_t>(hi);
+            }
+        }
+
+        auto const size = uint64_t{1} << chunk_bits;
+        block.minimum.resize(size);
+        block.candidates.resize(size);
+        std::vector<uint16_t> images(number_elements);
+        for (auto e = uint64_t{0}; e < size; ++e) {
+            auto smallest = std::numeric_limits<uint16_t>::max();
+            for (auto l = uint64_t{0}; l < number_elements; ++l) {
+                images[l] = static_cast<uint16_t>(low[l * 256U + (e & 0xFFU)]
+                                                  | high[l * 256U + (e >> 8U)])
+                            ^ flips[l];
+                smallest = std::min(smallest, images[l]);
+            }
+            auto candidates = uint64_t{0};
+            for (auto l = uint64_t{0}; l < number_elements; ++l) {
+                if (images[l] == smallest) { candidates |= uint64_t{1} << l; }
+            }
+            block.minimum[e]    = smallest;
+            block.candidates[e] = candidates;
+        }
+    }
+}
+
+auto sublattice_engine_t::chunk(block_t const& block, uint64_t const bits) const noexcept
+    -> unsigned
+{
+    auto const* table = block.extract.data();
+    auto        e     = 0U;
+    for (auto c = block.first_byte; c <= block.last_byte; ++c, table += 256) {
+        e |= table[(bits >> (8U * c)) & 0xFFU];
+    }
+    return e;
+}
+
+template <class Function>
+auto sublattice_engine_t::for_each_candidate(block_t const& block, unsigned const e,
+                                             Function&& f) const noexcept -> void
+{
+    for (auto candidates = block.candidates[e]; candidates != 0; candidates &= candidates - 1) {
+        f(block.elements[static_cast<unsigned>(__builtin_ctzl(candidates))]);
+    }
+}
+
+auto sublattice_engine_t::get_state_info(uint64_t const bits, uint64_t& representative,
+                                         std::complex<double>& character,
+                                         double&               norm) const noexcept -> void
+{
+    auto smallest = std::numeric_limits<unsigned>::max();
+    for (auto const& block : _blocks) {
+        smallest = std::min<unsigned>(smallest, block.minimum[chunk(block, bits)]);
+    }
+
+    auto r     = std::numeric_limits<uint64_t>::max();
+    auto index = std::numeric_limits<uint32_t>::max();
+    auto sum   = std::complex<double>{0.0, 0.0};
+    for (auto const& block : _blocks) {
+        auto const e = chunk(block, bits);
+        if (block.minimum[e] != smallest) { continue; }
+        for_each_candidate(block, e, [&](uint32_t const i) {
+            auto const& element = _elements[i];
+            auto const  y       = _networks[element.network](bits) ^ element.flip;
+            if (y < r) {
+                r     = y;
+                index = i;
+                sum   = element.character;
+            }
+            else if (y == r) {
+                index = std::min(index, i);
+                sum += element.character;
+            }
+        });
+    }
+    LATTICE_SYMMETRIES_ASSERT(r <= bits, "identity must be among the candidates");
+    representative = r;
+    character = r == bits ? std::complex<double>{1.0, 0.0} : _elements[index].character;
+
+    // Characters of all elements mapping bits to r differ by a character of the stabilizer, so
+    // their sum is the norm (up to a phase)
+    auto n = r == bits ? sum.real() : std::abs(sum);
+    if (std::abs(n) <= norm_threshold) { n = 0.0; }
+    LATTICE_SYMMETRIES_ASSERT(n >= 0.0, "");
+    norm = std::sqrt(n / static_cast<double>(_elements.size()));
+}
+
+auto sublattice_engine_t::is_representative(uint64_t const bits) const noexcept -> bool
+{
+    auto const top = static_cast<unsigned>(bits >> _shift);
+    for (auto const& block : _blocks) {
+        if (block.minimum[chunk(block, bits)] < top) { return false; }
+    }
+
+    auto n = 0.0;
+    for (auto const& block : _blocks) {
+        auto const e = chunk(block, bits);
+        if (block.minimum[e] != top) { continue; }
+        auto smaller = false;
+        for_each_candidate(block, e, [&](uint32_t const i) {
+            auto const& element = _elements[i];
+            auto const  y       = _networks[element.network](bits) ^ element.flip;
+            if (y < bits) { smaller = true; }
+            else if (y == bits) {
+                n += element.character.real();
+            }
+        });
+        if (smaller) { return false; }
+    }
+    if (std::abs(n) <= norm_threshold) { n = 0.0; }
+    LATTICE_SYMMETRIES_ASSERT(n >= 0.0, "");
+    return n > 0.0;
+}
+
+} // namespace lattice_symmetries
@@ -0,0 +1,88 @@
+// Copyright (c) 2019-2020, Tom Westerhout
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice, this
+//   list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+//
+// * Neither the name of the copyright holder nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "basis.hpp"
+#include "network.hpp"
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+namespace lattice_symmetries {
+
+/// Alternative to batched Benes networks for computing representatives in small bases.
+///
+/// The topmost `chunk_bits` bits of g(x) only depend on spins in g⁻¹(P) where P is the set of
+/// topmost sites ("the chunk"). We group symmetries by this source set and for every group
+/// tabulate the smallest chunk which any of its elements (optionally followed by a global spin
+/// flip) can produce, and which elements produce it. Representative of x is then found by first
+/// determining the smallest chunk with one table lookup per group, and then applying full Benes
+/// networks only to the few candidates which achieve it.
+class sublattice_engine_t {
+    struct element_t {
+        uint32_t             network;
+        uint64_t             flip;
+        std::complex<double> character;
+    };
+
+    struct block_t {
+        unsigned              first_byte;
+        unsigned              last_byte;
+        std::vector<uint16_t> extract;    // extract[(c - first_byte) * 256 + byte c of x]
+        std::vector<uint16_t> minimum;    // smallest chunk produced by elements of the block
+        std::vector<uint64_t> candidates; // which elements produce it
+        std::vector<uint32_t> elements;   // indices into _elements, at most 64 of them
+    };
+
+    unsigned                     _chunk_bits;
+    unsigned                     _shift;
+    std::vector<small_network_t> _networks;
+    std::vector<element_t>       _elements;
+    std::vector<block_t>         _blocks;
+
+    [[nodiscard]] auto chunk(block_t const& block, uint64_t bits) const noexcept -> unsigned;
+    template <class Function>
+    auto for_each_candidate(block_t const& block, unsigned chunk, Function&& f) const noexcept
+        -> void;
+
+  public:
+    sublattice_engine_t(basis_base_t const& header, small_basis_t const& payload);
+
+    auto get_state_info(uint64_t bits, uint64_t& representative, std::complex<double>& character,
+                        double& norm) const noexcept -> void;
+    [[nodiscard]] auto is_representative(uint64_t bits) const noexcept -> bool;
+
+    [[nodiscard]] auto chunk_bits() const noexcept -> unsigned { return _chunk_bits; }
+    [[nodiscard]] auto number_blocks() const noexcept -> unsigned
+    {
+        return static_cast<unsigned>(_blocks.size());
+    }
+};
+
+} // namespace lattice_symmetries
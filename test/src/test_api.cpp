@@ -1,6 +1,7 @@
 #include "bits.hpp"
 #include "cpu/search_sorted.hpp"
 #include "lattice_symmetries/lattice_symmetries.h"
+#include <algorithm>
 #include <bitset>
 #include <catch2/catch_approx.hpp>
 #include <catch2/catch_test_macros.hpp>
@@ -10,6 +11,8 @@
 #include <iostream>
 #include <memory>
 #include <numeric>
+#include <string>
+#include <thread>
 
 TEST_CASE("obtains CPU capabilities", "[api]")
 {
@@ -335,6 +338,182 @@ TEST_CASE("constructs basis", "[api]")
     }
 }
 
+TEST_CASE("indexes bases without symmetries", "[api]")
+{
+    auto const group = make_group({});
+    for (auto const hamming_weight : {-1, 0, 3, 6, 10}) {
+        auto const basis = make_spin_basis(group.get(), 10, hamming_weight, 0);
+        REQUIRE(ls_has_symmetries(basis.get()) == false);
+        REQUIRE(ls_build(basis.get()) == LS_SUCCESS);
+
+        uint64_t count;
+        REQUIRE(ls_get_number_states(basis.get(), &count) == LS_SUCCESS);
+        auto states = get_states(basis.get());
+        REQUIRE(ls_states_get_size(states.get()) == count);
+        auto const* begin = ls_states_get_data(states.get());
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            if (i > 0) { REQUIRE(begin[i - 1] < begin[i]); }
+            uint64_t index;
+            REQUIRE(ls_get_index(basis.get(), begin[i], &index) == LS_SUCCESS);
+            REQUIRE(index == i);
+            uint64_t representative;
+            REQUIRE(ls_get_representative(basis.get(), i, &representative) == LS_SUCCESS);
+            REQUIRE(representative == begin[i]);
+        }
+        uint64_t representative;
+        REQUIRE(ls_get_representative(basis.get(), count, &representative) == LS_INVALID_ARGUMENT);
+    }
+
+    {
+        // C(40, 20) states would not fit into memory
+        auto const basis = make_spin_basis(group.get(), 40, 20, 0);
+        REQUIRE(ls_build(basis.get()) == LS_SUCCESS);
+        uint64_t count;
+        REQUIRE(ls_get_number_states(basis.get(), &count) == LS_SUCCESS);
+        REQUIRE(count == 137846528820U);
+        for (auto const i : {uint64_t{0}, uint64_t{123456789}, count - 1}) {
+            uint64_t representative;
+            REQUIRE(ls_get_representative(basis.get(), i, &representative) == LS_SUCCESS);
+            uint64_t index;
+            REQUIRE(ls_get_index(basis.get(), representative, &index) == LS_SUCCESS);
+            REQUIRE(index == i);
+        }
+        uint64_t index;
+        REQUIRE(ls_get_index(basis.get(), 0b111, &index) == LS_NOT_A_REPRESENTATIVE);
+    }
+}
+
+TEST_CASE("indexes bases using Lin tables", "[api]")
+{
+    unsigned const permutation[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0};
+    auto           symmetry      = make_symmetry(std::size(permutation), permutation, 0);
+    auto const     group         = make_group({std::move(symmetry)});
+    auto const     trivial       = make_group({});
+    for (auto const* g : {group.get(), trivial.get()}) {
+        for (auto const hamming_weight : {-1, 8}) {
+            auto const basis = make_spin_basis(g, 16, hamming_weight, 0);
+            REQUIRE(ls_set_index_type(basis.get(), LS_INDEX_LIN) == LS_SUCCESS);
+            REQUIRE(ls_build(basis.get()) == LS_SUCCESS);
+
+            auto const  states = get_states(basis.get());
+            auto const* data   = ls_states_get_data(states.get());
+            for (auto i = uint64_t{0}; i < ls_states_get_size(states.get()); ++i) {
+                uint64_t index;
+                REQUIRE(ls_get_index(basis.get(), data[i], &index) == LS_SUCCESS);
+                REQUIRE(index == i);
+            }
+            uint64_t index;
+            REQUIRE(ls_get_index(basis.get(), uint64_t{1} << 16U, &index)
+                    == LS_NOT_A_REPRESENTATIVE);
+        }
+    }
+}
+
+TEST_CASE("indexes compressed lists of representatives", "[api]")
+{
+    unsigned const permutation[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0};
+    auto           symmetry      = make_symmetry(std::size(permutation), permutation, 0);
+    auto const     group         = make_group({std::move(symmetry)});
+    for (auto const hamming_weight : {-1, 8}) {
+        auto const reference = make_spin_basis(group.get(), 16, hamming_weight, 0);
+        auto const basis     = make_spin_basis(group.get(), 16, hamming_weight, 0);
+        REQUIRE(ls_set_index_type(basis.get(), LS_INDEX_COMPRESSED) == LS_SUCCESS);
+        REQUIRE(ls_build(reference.get()) == LS_SUCCESS);
+        REQUIRE(ls_build(basis.get()) == LS_SUCCESS);
+
+        auto const  expected = get_states(reference.get());
+        auto const* data     = ls_states_get_data(expected.get());
+        for (auto i = uint64_t{0}; i < ls_states_get_size(expected.get()); ++i) {
+            uint64_t index;
+            REQUIRE(ls_get_index(basis.get(), data[i], &index) == LS_SUCCESS);
+            REQUIRE(index == i);
+            uint64_t state;
+            REQUIRE(ls_get_representative(basis.get(), i, &state) == LS_SUCCESS);
+            REQUIRE(state == data[i]);
+        }
+        for (auto x = uint64_t{0}; x < (uint64_t{1} << 16U); x += 3U) {
+            uint64_t index;
+            uint64_t expected_index;
+            REQUIRE(ls_get_index(basis.get(), x, &index)
+                    == ls_get_index(reference.get(), x, &expected_index));
+        }
+
+        // Representatives are decoded on demand
+        auto const states = get_states(basis.get());
+        REQUIRE(ls_states_get_size(states.get()) == ls_states_get_size(expected.get()));
+        REQUIRE(std::equal(data, data + ls_states_get_size(expected.get()),
+                           ls_states_get_data(states.get())));
+    }
+}
+
+TEST_CASE("indexes bases with more than 64 spins", "[api]")
+{
+    constexpr auto number_spins = 72U;
+    auto           permutation  = std::vector<unsigned>(number_spins);
+    for (auto i = 0U; i < number_spins; ++i) {
+        permutation[i] = (i + 1U) % number_spins;
+    }
+    auto       symmetry = make_symmetry(permutation.size(), permutation.data(), 0);
+    auto const group    = make_group({std::move(symmetry)});
+    {
+        auto const basis = make_spin_basis(group.get(), number_spins, -1, 0);
+        REQUIRE(ls_build(basis.get()) == LS_INVALID_HAMMING_WEIGHT);
+    }
+    // Sparse sector and its complement which is enumerated via positions of spins down
+    for (auto const hamming_weight : {3, static_cast<int>(number_spins) - 3}) {
+        auto const basis = make_spin_basis(group.get(), number_spins, hamming_weight, 0);
+        uint64_t   count;
+        REQUIRE(ls_get_number_states(basis.get(), &count) == LS_CACHE_NOT_BUILT);
+        REQUIRE(ls_build(basis.get()) == LS_SUCCESS);
+        REQUIRE(ls_get_number_states(basis.get(), &count) == LS_SUCCESS);
+
+        auto expected = uint64_t{0};
+        for (auto i = 0U; i < number_spins; ++i) {
+            for (auto j = i + 1U; j < number_spins; ++j) {
+                for (auto k = j + 1U; k < number_spins; ++k) {
+                    ls_bits512 x;
+                    lattice_symmetries::set_zero(x);
+                    for (auto const n : {i, j, k}) {
+                        lattice_symmetries::set_bit(x, n);
+                    }
+                    if (hamming_weight != 3) {
+                        for (auto n = 0U; n < number_spins; ++n) {
+                            lattice_symmetries::toggle_bit(x, n);
+                        }
+                    }
+                    ls_bits512           repr;
+                    std::complex<double> character;
+                    double               norm;
+                    ls_get_state_info(basis.get(), &x, &repr, &character, &norm);
+                    uint64_t   index;
+                    auto const status = ls_get_index_512(basis.get(), &x, &index);
+                    if (repr == x && norm > 0.0) {
+                        REQUIRE(status == LS_SUCCESS);
+                        ++expected;
+                    }
+                    else {
+                        REQUIRE(status == LS_NOT_A_REPRESENTATIVE);
+                    }
+                }
+            }
+        }
+        REQUIRE(count == expected);
+
+        ls_bits512 previous;
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            ls_bits512 x;
+            REQUIRE(ls_get_representative_512(basis.get(), i, &x) == LS_SUCCESS);
+            if (i > 0) { REQUIRE(previous < x); }
+            uint64_t index;
+            REQUIRE(ls_get_index_512(basis.get(), &x, &index) == LS_SUCCESS);
+            REQUIRE(index == i);
+            previous = x;
+        }
+        ls_bits512 x;
+        REQUIRE(ls_get_representative_512(basis.get(), count, &x) == LS_INVALID_ARGUMENT);
+    }
+}
+
 TEST_CASE("finds correct states", "[api]")
 {
     {
@@ -425,6 +604,808 @@ TEST_CASE("finds correct states", "[api]")
     }
 }
 
+TEST_CASE("builds basis directly into a file", "[api]")
+{
+    unsigned const permutation[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0};
+    auto           symmetry      = make_symmetry(std::size(permutation), permutation, 0);
+    auto const     group         = make_group({std::move(symmetry)});
+    auto const     built         = make_spin_basis(group.get(), 16, 8, 1);
+    auto const     streamed      = make_spin_basis(group.get(), 16, 8, 1);
+
+    auto const* filename = "test_build_to_file.cache";
+    REQUIRE(ls_build_to_file(streamed.get(), filename) == LS_SUCCESS);
+    REQUIRE(ls_load_cache(streamed.get(), filename) == LS_SUCCESS);
+    REQUIRE(ls_build(built.get()) == LS_SUCCESS);
+    std::remove(filename);
+
+    auto const expected = get_states(built.get());
+    auto const states   = get_states(streamed.get());
+    REQUIRE(ls_states_get_size(states.get()) == ls_states_get_size(expected.get()));
+    REQUIRE(std::equal(ls_states_get_data(states.get()),
+                       ls_states_get_data(states.get()) + ls_states_get_size(states.get()),
+                       ls_states_get_data(expected.get())));
+}
+
+TEST_CASE("loads memory-mapped caches", "[api]")
+{
+    unsigned const permutation[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0};
+    auto           symmetry      = make_symmetry(std::size(permutation), permutation, 0);
+    auto const     group         = make_group({std::move(symmetry)});
+    auto const     built         = make_spin_basis(group.get(), 16, 8, 1);
+    REQUIRE(ls_build(built.get()) == LS_SUCCESS);
+    auto const  expected = get_states(built.get());
+    auto const* data     = ls_states_get_data(expected.get());
+    auto const  count    = ls_states_get_size(expected.get());
+
+    auto const* filename = "test_load_cache_mapped.cache";
+    REQUIRE(ls_save_cache(built.get(), filename) == LS_SUCCESS);
+    for (auto const mode : {LS_MAP_DEFAULT, LS_MAP_POPULATE, LS_MAP_WILLNEED, LS_MAP_COPY}) {
+        auto const loaded = make_spin_basis(group.get(), 16, 8, 1);
+        REQUIRE(ls_load_cache_mapped(loaded.get(), filename, mode) == LS_SUCCESS);
+        auto const states = get_states(loaded.get());
+        REQUIRE(ls_states_get_size(states.get()) == count);
+        REQUIRE(std::equal(data, data + count, ls_states_get_data(states.get())));
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            uint64_t index;
+            REQUIRE(ls_get_index(loaded.get(), data[i], &index) == LS_SUCCESS);
+            REQUIRE(index == i);
+        }
+    }
+    auto const loaded = make_spin_basis(group.get(), 16, 8, 1);
+    REQUIRE(ls_load_cache_mapped(loaded.get(), filename, static_cast<ls_map_mode>(42))
+            == LS_INVALID_ARGUMENT);
+    std::remove(filename);
+    REQUIRE(ls_load_cache(loaded.get(), filename) == LS_COULD_NOT_OPEN_FILE);
+}
+
+TEST_CASE("validates self-describing cache files", "[api]")
+{
+    unsigned const permutation[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0};
+    auto           symmetry      = make_symmetry(std::size(permutation), permutation, 0);
+    auto const     group         = make_group({std::move(symmetry)});
+    auto const     built         = make_spin_basis(group.get(), 16, 8, 1);
+    REQUIRE(ls_build(built.get()) == LS_SUCCESS);
+    auto const  expected = get_states(built.get());
+    auto const* data     = ls_states_get_data(expected.get());
+    auto const  count    = ls_states_get_size(expected.get());
+
+    auto const* filename = "test_cache_format.cache";
+    REQUIRE(ls_save_cache_with_norms(built.get(), filename, true) == LS_SUCCESS);
+    {
+        auto const loaded = make_spin_basis(group.get(), 16, 8, 1);
+        REQUIRE(ls_load_cache_mapped(loaded.get(), filename, LS_MAP_POPULATE) == LS_SUCCESS);
+        double const* norms = nullptr;
+        REQUIRE(ls_get_norms(loaded.get(), &norms) == LS_SUCCESS);
+        REQUIRE(norms != nullptr);
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            uint64_t index;
+            REQUIRE(ls_get_index(loaded.get(), data[i], &index) == LS_SUCCESS);
+            REQUIRE(index == i);
+            ls_bits512 bits;
+            ls_bits512 representative;
+            lattice_symmetries::set_zero(bits);
+            bits.words[0] = data[i];
+            std::complex<double> character;
+            double               norm;
+            ls_get_state_info(loaded.get(), &bits, &representative, &character, &norm);
+            REQUIRE(norms[i] == Catch::Approx(norm));
+        }
+    }
+    {
+        // Norms are only stored on request
+        REQUIRE(ls_save_cache(built.get(), filename) == LS_SUCCESS);
+        auto const    loaded  = make_spin_basis(group.get(), 16, 8, 1);
+        auto const    garbage = 1.0;
+        double const* norms   = &garbage;
+        REQUIRE(ls_load_cache(loaded.get(), filename) == LS_SUCCESS);
+        REQUIRE(ls_get_norms(loaded.get(), &norms) == LS_SUCCESS);
+        REQUIRE(norms == nullptr);
+    }
+    // Caches of a different sector or spin inversion are rejected
+    REQUIRE(ls_load_cache(make_spin_basis(group.get(), 16, 8, -1).get(), filename)
+            == LS_CACHE_MISMATCH);
+    {
+        unsigned const other_permutation[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0};
+        auto           other = make_symmetry(std::size(other_permutation), other_permutation, 1);
+        auto const     other_group = make_group({std::move(other)});
+        REQUIRE(ls_load_cache(make_spin_basis(other_group.get(), 16, 8, 1).get(), filename)
+                == LS_CACHE_MISMATCH);
+    }
+    // Damage the last word of the bucket table
+    {
+        auto* file = std::fopen(filename, "r+b");
+        REQUIRE(file != nullptr);
+        REQUIRE(std::fseek(file, -1, SEEK_END) == 0);
+        REQUIRE(std::fputc(0xFF, file) == 0xFF);
+        std::fclose(file);
+        REQUIRE(ls_load_cache(make_spin_basis(group.get(), 16, 8, 1).get(), filename)
+                == LS_CACHE_IS_CORRUPT);
+    }
+    // Files written by earlier versions are still accepted
+    {
+        auto* file = std::fopen(filename, "wb");
+        REQUIRE(file != nullptr);
+        char const header[16] = {42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42, 42};
+        REQUIRE(std::fwrite(header, 1, sizeof(header), file) == sizeof(header));
+        REQUIRE(std::fwrite(data, sizeof(uint64_t), count, file) == count);
+        std::fclose(file);
+        auto const loaded = make_spin_basis(group.get(), 16, 8, 1);
+        REQUIRE(ls_load_cache(loaded.get(), filename) == LS_SUCCESS);
+        auto const states = get_states(loaded.get());
+        REQUIRE(ls_states_get_size(states.get()) == count);
+        REQUIRE(std::equal(data, data + count, ls_states_get_data(states.get())));
+    }
+    std::remove(filename);
+}
+
+TEST_CASE("loads compressed caches", "[api]")
+{
+    unsigned const permutation[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0};
+    auto           symmetry      = make_symmetry(std::size(permutation), permutation, 0);
+    auto const     group         = make_group({std::move(symmetry)});
+    auto const     built         = make_spin_basis(group.get(), 16, 8, 1);
+    REQUIRE(ls_build(built.get()) == LS_SUCCESS);
+    auto const  expected = get_states(built.get());
+    auto const* data     = ls_states_get_data(expected.get());
+    auto const  count    = ls_states_get_size(expected.get());
+
+    auto const file_size = [](char const* filename) {
+        auto* file = std::fopen(filename, "rb");
+        REQUIRE(file != nullptr);
+        REQUIRE(std::fseek(file, 0, SEEK_END) == 0);
+        auto const size = std::ftell(file);
+        std::fclose(file);
+        return size;
+    };
+    auto const* plain      = "test_cache_plain.cache";
+    auto const* compressed = "test_cache_compressed.cache";
+    REQUIRE(ls_save_cache(built.get(), plain) == LS_SUCCESS);
+    REQUIRE(ls_save_cache_compressed(built.get(), compressed, false) == LS_SUCCESS);
+    REQUIRE(file_size(compressed) < file_size(plain));
+    for (auto const mode : {LS_MAP_DEFAULT, LS_MAP_POPULATE, LS_MAP_WILLNEED, LS_MAP_COPY}) {
+        auto const loaded = make_spin_basis(group.get(), 16, 8, 1);
+        REQUIRE(ls_load_cache_mapped(loaded.get(), compressed, mode) == LS_SUCCESS);
+        auto const states = get_states(loaded.get());
+        REQUIRE(ls_states_get_size(states.get()) == count);
+        REQUIRE(std::equal(data, data + count, ls_states_get_data(states.get())));
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            uint64_t index;
+            REQUIRE(ls_get_index(loaded.get(), data[i], &index) == LS_SUCCESS);
+            REQUIRE(index == i);
+        }
+    }
+    std::remove(plain);
+    std::remove(compressed);
+}
+
+TEST_CASE("reads and writes caches with direct I/O", "[api]")
+{
+    unsigned const permutation[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0};
+    auto           symmetry      = make_symmetry(std::size(permutation), permutation, 0);
+    auto const     group         = make_group({std::move(symmetry)});
+    auto const     built         = make_spin_basis(group.get(), 16, 8, 1);
+    REQUIRE(ls_build(built.get()) == LS_SUCCESS);
+    auto const  expected = get_states(built.get());
+    auto const* data     = ls_states_get_data(expected.get());
+    auto const  count    = ls_states_get_size(expected.get());
+
+    auto const* filename = "test_cache_direct.cache";
+    for (auto const direct : {true, false}) {
+        if (direct) {
+            ls_enable_direct_io();
+        }
+        else {
+            ls_disable_direct_io();
+        }
+        REQUIRE(ls_is_direct_io_enabled() == direct);
+        REQUIRE(ls_save_cache_with_norms(built.get(), filename, true) == LS_SUCCESS);
+        // Caches are written to a temporary file which is then renamed
+        REQUIRE(std::fopen("test_cache_direct.cache.tmp", "rb") == nullptr);
+        for (auto const mode : {LS_MAP_DEFAULT, LS_MAP_COPY}) {
+            auto const loaded = make_spin_basis(group.get(), 16, 8, 1);
+            REQUIRE(ls_load_cache_mapped(loaded.get(), filename, mode) == LS_SUCCESS);
+            auto const states = get_states(loaded.get());
+            REQUIRE(ls_states_get_size(states.get()) == count);
+            REQUIRE(std::equal(data, data + count, ls_states_get_data(states.get())));
+            double const* norms = nullptr;
+            REQUIRE(ls_get_norms(loaded.get(), &norms) == LS_SUCCESS);
+            REQUIRE(norms != nullptr);
+        }
+    }
+    std::remove(filename);
+}
+
+TEST_CASE("loads caches asynchronously", "[api]")
+{
+    unsigned const permutation[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0};
+    auto           symmetry      = make_symmetry(std::size(permutation), permutation, 0);
+    auto const     group         = make_group({std::move(symmetry)});
+    auto const     built         = make_spin_basis(group.get(), 16, 8, 1);
+    REQUIRE(ls_build(built.get()) == LS_SUCCESS);
+    auto const  expected = get_states(built.get());
+    auto const* data     = ls_states_get_data(expected.get());
+    auto const  count    = ls_states_get_size(expected.get());
+
+    auto const* filename = "test_cache_async.cache";
+    REQUIRE(ls_save_cache(built.get(), filename) == LS_SUCCESS);
+    for (auto const mode : {LS_MAP_DEFAULT, LS_MAP_COPY}) {
+        auto const loaded = make_spin_basis(group.get(), 16, 8, 1);
+        REQUIRE(ls_load_cache_async(loaded.get(), filename, mode) == LS_SUCCESS);
+        // Lookups block until the cache is ready, including concurrent ones
+        std::vector<std::thread> threads;
+        std::vector<char>        ok(4, 0);
+        for (auto t = 0U; t < ok.size(); ++t) {
+            threads.emplace_back([&loaded, &ok, data, count, t]() {
+                auto good = true;
+                for (auto i = uint64_t{0}; i < count; ++i) {
+                    uint64_t index;
+                    good = good && ls_get_index(loaded.get(), data[i], &index) == LS_SUCCESS
+                           && index == i;
+                }
+                ok[t] = static_cast<char>(good);
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        REQUIRE(std::all_of(ok.begin(), ok.end(), [](auto const x) { return x != 0; }));
+        REQUIRE(ls_wait_cache(loaded.get()) == LS_SUCCESS);
+    }
+    {
+        // Destroying the basis while the cache is being loaded waits for the loader
+        auto const loaded = make_spin_basis(group.get(), 16, 8, 1);
+        REQUIRE(ls_load_cache_async(loaded.get(), filename, LS_MAP_COPY) == LS_SUCCESS);
+    }
+    {
+        // Errors are reported when waiting, and the cache can then be built instead
+        auto const loaded = make_spin_basis(group.get(), 16, 8, 1);
+        REQUIRE(ls_load_cache_async(loaded.get(), "test_cache_async_missing.cache",
+                                    LS_MAP_DEFAULT)
+                == LS_SUCCESS);
+        REQUIRE(ls_wait_cache(loaded.get()) != LS_SUCCESS);
+        uint64_t index;
+        REQUIRE(ls_get_index(loaded.get(), data[0], &index) != LS_SUCCESS);
+        REQUIRE(ls_build(loaded.get()) == LS_SUCCESS);
+        REQUIRE(ls_wait_cache(loaded.get()) == LS_SUCCESS);
+        REQUIRE(ls_get_index(loaded.get(), data[0], &index) == LS_SUCCESS);
+        REQUIRE(index == 0);
+    }
+    {
+        // ls_build_sectors waits for pending loads, reports their errors, and keeps loaded caches
+        auto const     failed  = make_spin_basis(group.get(), 16, 8, 1);
+        auto const     loaded  = make_spin_basis(group.get(), 16, 8, 1);
+        ls_spin_basis* bases[] = {failed.get(), loaded.get()};
+        REQUIRE(ls_load_cache_async(failed.get(), "test_cache_async_missing.cache",
+                                    LS_MAP_DEFAULT)
+                == LS_SUCCESS);
+        REQUIRE(ls_load_cache_async(loaded.get(), filename, LS_MAP_COPY) == LS_SUCCESS);
+        REQUIRE(ls_build_sectors(static_cast<unsigned>(std::size(bases)), bases) != LS_SUCCESS);
+        REQUIRE(ls_build_sectors(static_cast<unsigned>(std::size(bases)), bases) == LS_SUCCESS);
+        for (auto const* basis : bases) {
+            auto const states = get_states(basis);
+            REQUIRE(ls_states_get_size(states.get()) == count);
+            REQUIRE(std::equal(data, data + count, ls_states_get_data(states.get())));
+        }
+    }
+    std::remove(filename);
+}
+
+TEST_CASE("resumes checkpointed builds", "[api]")
+{
+    unsigned const permutation[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 0};
+    auto           symmetry      = make_symmetry(std::size(permutation), permutation, 0);
+    auto const     group         = make_group({std::move(symmetry)});
+    auto const     built         = make_spin_basis(group.get(), 16, 8, 1);
+    REQUIRE(ls_build(built.get()) == LS_SUCCESS);
+    auto const expected = get_states(built.get());
+
+    auto const* directory = "test_build_checkpointed";
+    auto const  chunk     = [directory](unsigned const i) {
+        return std::string{directory} + "/chunk_" + std::to_string(i);
+    };
+    for (auto const interrupted : {false, true}) {
+        if (interrupted) {
+            // Pretend that the previous run was killed before finishing these tasks
+            REQUIRE(std::remove(chunk(0).c_str()) == 0);
+            REQUIRE(std::remove(chunk(3).c_str()) == 0);
+        }
+        auto const basis = make_spin_basis(group.get(), 16, 8, 1);
+        REQUIRE(ls_build_checkpointed(basis.get(), directory) == LS_SUCCESS);
+        auto const states = get_states(basis.get());
+        REQUIRE(ls_states_get_size(states.get()) == ls_states_get_size(expected.get()));
+        REQUIRE(std::equal(ls_states_get_data(states.get()),
+                           ls_states_get_data(states.get()) + ls_states_get_size(states.get()),
+                           ls_states_get_data(expected.get())));
+    }
+
+    // Checkpoints of a different basis are rejected
+    auto const other = make_spin_basis(group.get(), 16, 8, -1);
+    REQUIRE(ls_build_checkpointed(other.get(), directory) == LS_CACHE_IS_CORRUPT);
+
+    for (auto i = 0U; std::remove(chunk(i).c_str()) == 0; ++i) {}
+    std::remove((std::string{directory} + "/manifest").c_str());
+    std::remove(directory);
+}
+
+TEST_CASE("builds all sectors at once", "[api]")
+{
+    using basis_ptr = std::unique_ptr<ls_spin_basis, void (*)(ls_spin_basis*)>;
+    unsigned const permutation[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 0};
+    auto           together      = std::vector<basis_ptr>{};
+    auto           separately    = std::vector<basis_ptr>{};
+    for (auto sector = 0; sector < 12; ++sector) {
+        auto const group = make_group({make_symmetry(std::size(permutation), permutation, sector)});
+        for (auto const spin_inversion : {1, -1}) {
+            together.push_back(make_spin_basis(group.get(), 12, 6, spin_inversion));
+            separately.push_back(make_spin_basis(group.get(), 12, 6, spin_inversion));
+        }
+    }
+    auto bases = std::vector<ls_spin_basis*>{};
+    for (auto const& basis : together) {
+        bases.push_back(basis.get());
+    }
+    REQUIRE(ls_build_sectors(static_cast<unsigned>(bases.size()), bases.data()) == LS_SUCCESS);
+
+    auto total = uint64_t{0};
+    for (auto i = size_t{0}; i < bases.size(); ++i) {
+        REQUIRE(ls_build(separately[i].get()) == LS_SUCCESS);
+        auto const expected = get_states(separately[i].get());
+        auto const states   = get_states(together[i].get());
+        REQUIRE(ls_states_get_size(states.get()) == ls_states_get_size(expected.get()));
+        REQUIRE(std::equal(ls_states_get_data(states.get()),
+                           ls_states_get_data(states.get()) + ls_states_get_size(states.get()),
+                           ls_states_get_data(expected.get())));
+        total += ls_states_get_size(states.get());
+    }
+    // Sectors partition the whole Hilbert space
+    REQUIRE(total == 924U);
+
+    unsigned const reflection[]  = {11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0};
+    auto const     other_group   = make_group({make_symmetry(std::size(reflection), reflection, 0)});
+    auto const     incompatible  = make_spin_basis(other_group.get(), 12, 6, 1);
+    bases.push_back(incompatible.get());
+    REQUIRE(ls_build_sectors(static_cast<unsigned>(bases.size()), bases.data())
+            == LS_INCOMPATIBLE_SYMMETRIES);
+}
+
+TEST_CASE("prefix pruning does not lose representatives", "[api]")
+{
+    // Chain of 20 spins with translations (momentum 2π·3/20) and reflection
+    unsigned T[20];
+    unsigned P[20];
+    for (auto i = 0U; i < 20U; ++i) {
+        T[i] = (i + 1U) % 20U;
+        P[i] = 19U - i;
+    }
+    struct {
+        unsigned sector;
+        bool     reflection;
+        int      hamming_weight;
+        int      spin_inversion;
+    } const cases[] = {
+        {0, true, 10, 1}, {3, false, 10, 0}, {10, true, -1, 0}, {5, true, 10, -1}};
+    for (auto const& [sector, reflection, hamming_weight, spin_inversion] : cases) {
+        auto const group = reflection ? make_group({make_symmetry(std::size(T), T, sector),
+                                                    make_symmetry(std::size(P), P, 0U)})
+                                      : make_group({make_symmetry(std::size(T), T, sector)});
+        auto const basis = make_spin_basis(group.get(), 20, hamming_weight, spin_inversion);
+        REQUIRE(ls_build(basis.get()) == LS_SUCCESS);
+
+        // Compare with brute force enumeration
+        auto expected = std::vector<uint64_t>{};
+        for (auto x = uint64_t{0}; x < (uint64_t{1} << 20U); ++x) {
+            if (hamming_weight >= 0
+                && lattice_symmetries::popcount(x) != static_cast<unsigned>(hamming_weight)) {
+                continue;
+            }
+            uint8_t is_representative;
+            REQUIRE(ls_is_representative(basis.get(), 1, &x, &is_representative) == LS_SUCCESS);
+            if (is_representative != 0) { expected.push_back(x); }
+        }
+        auto const states = get_states(basis.get());
+        REQUIRE(ls_states_get_size(states.get()) == expected.size());
+        REQUIRE(std::equal(std::begin(expected), std::end(expected),
+                           ls_states_get_data(states.get())));
+    }
+}
+
+TEST_CASE("fast rejection does not lose representatives", "[api]")
+{
+    // Chain of 18 spins with translations and spin inversion, i.e. 18 symmetries, each of
+    // which is also combined with a global spin flip
+    unsigned T[18];
+    for (auto i = 0U; i < 18U; ++i) {
+        T[i] = (i + 1U) % 18U;
+    }
+    auto const group = make_group({make_symmetry(std::size(T), T, 0U)});
+    auto const basis = make_spin_basis(group.get(), 18, 9, 1);
+    REQUIRE(ls_build(basis.get()) == LS_SUCCESS);
+
+    uint64_t checked;
+    uint64_t rejected;
+    REQUIRE(ls_get_fast_reject_statistics(basis.get(), &checked, &rejected) == LS_SUCCESS);
+    REQUIRE(checked > 0U);
+    REQUIRE(rejected > 0U);
+    REQUIRE(rejected <= checked);
+
+    // ls_get_state_info does not use the pre-filter
+    auto expected = std::vector<uint64_t>{};
+    for (auto x = uint64_t{0}; x < (uint64_t{1} << 18U); ++x) {
+        if (lattice_symmetries::popcount(x) != 9U) { continue; }
+        ls_bits512 const     bits = {x, 0, 0, 0, 0, 0, 0, 0};
+        ls_bits512           repr;
+        std::complex<double> character;
+        double               norm;
+        ls_get_state_info(basis.get(), &bits, &repr, &character, &norm);
+        if (repr.words[0] == x && norm > 0.0) { expected.push_back(x); }
+    }
+    auto const states = get_states(basis.get());
+    REQUIRE(ls_states_get_size(states.get()) == expected.size());
+    REQUIRE(std::equal(std::begin(expected), std::end(expected), ls_states_get_data(states.get())));
+}
+
+TEST_CASE("reports progress and supports cancellation", "[api]")
+{
+    unsigned T[16];
+    for (auto i = 0U; i < 16U; ++i) {
+        T[i] = (i + 1U) % 16U;
+    }
+    auto const group = make_group({make_symmetry(std::size(T), T, 0U)});
+
+    struct counter_t {
+        uint64_t calls;
+        uint64_t processed;
+        uint64_t total;
+        bool     proceed;
+    };
+    auto const callback = [](ls_progress const* progress, void* cxt) {
+        auto& counter     = *static_cast<counter_t*>(cxt);
+        counter.calls     = counter.calls + 1U;
+        counter.processed = progress->processed;
+        counter.total     = progress->total;
+        return counter.proceed;
+    };
+
+    auto const cancelled = make_spin_basis(group.get(), 16, 8, 0);
+    auto       counter   = counter_t{0, 0, 0, false};
+    REQUIRE(ls_build_with_progress(cancelled.get(), callback, &counter) == LS_CANCELLED);
+    REQUIRE(counter.calls == 1U);
+    uint64_t number_states;
+    REQUIRE(ls_get_number_states(cancelled.get(), &number_states) == LS_CACHE_NOT_BUILT);
+
+    auto const basis    = make_spin_basis(group.get(), 16, 8, 0);
+    auto const expected = make_spin_basis(group.get(), 16, 8, 0);
+    counter             = counter_t{0, 0, 0, true};
+    REQUIRE(ls_build_with_progress(basis.get(), callback, &counter) == LS_SUCCESS);
+    REQUIRE(ls_build(expected.get()) == LS_SUCCESS);
+    REQUIRE(counter.calls >= 1U);
+    // Both passes over all 12870 configurations with Hamming weight 8
+    REQUIRE(counter.total == 2U * 12870U);
+    REQUIRE(counter.processed == counter.total);
+    auto const states_1 = get_states(basis.get());
+    auto const states_2 = get_states(expected.get());
+    REQUIRE(ls_states_get_size(states_1.get()) == ls_states_get_size(states_2.get()));
+    REQUIRE(std::equal(ls_states_get_data(states_1.get()),
+                       ls_states_get_data(states_1.get()) + ls_states_get_size(states_1.get()),
+                       ls_states_get_data(states_2.get())));
+
+    // Heisenberg chain
+    std::complex<double> const matrix[4][4] = {{1.0, 0.0, 0.0, 0.0},
+                                               {0.0, -1.0, 2.0, 0.0},
+                                               {0.0, 2.0, -1.0, 0.0},
+                                               {0.0, 0.0, 0.0, 1.0}};
+    uint16_t                   sites[16][2];
+    for (auto i = 0U; i < 16U; ++i) {
+        sites[i][0] = static_cast<uint16_t>(i);
+        sites[i][1] = static_cast<uint16_t>((i + 1U) % 16U);
+    }
+    ls_interaction* interaction = nullptr;
+    REQUIRE(ls_create_interaction2(&interaction, &(matrix[0][0]), std::size(sites), sites)
+            == LS_SUCCESS);
+    ls_interaction const* const terms[] = {interaction};
+    ls_operator*                op      = nullptr;
+    REQUIRE(ls_create_operator(&op, basis.get(), 1, terms) == LS_SUCCESS);
+
+    REQUIRE(ls_get_number_states(basis.get(), &number_states) == LS_SUCCESS);
+    auto x = std::vector<double>(number_states);
+    std::iota(std::begin(x), std::end(x), 1.0);
+    auto y_1 = std::vector<double>(number_states);
+    auto y_2 = std::vector<double>(number_states);
+    REQUIRE(ls_operator_matmat(op, LS_FLOAT64, number_states, 1, x.data(), number_states,
+                               y_1.data(), number_states)
+            == LS_SUCCESS);
+    counter = counter_t{0, 0, 0, true};
+    REQUIRE(ls_operator_matmat_with_progress(op, LS_FLOAT64, number_states, 1, x.data(),
+                                             number_states, y_2.data(), number_states, callback,
+                                             &counter)
+            == LS_SUCCESS);
+    REQUIRE(counter.total == number_states);
+    REQUIRE(counter.processed == number_states);
+    REQUIRE(y_1 == y_2);
+
+    counter = counter_t{0, 0, 0, false};
+    REQUIRE(ls_operator_matmat_with_progress(op, LS_FLOAT64, number_states, 1, x.data(),
+                                             number_states, y_2.data(), number_states, callback,
+                                             &counter)
+            == LS_CANCELLED);
+    REQUIRE(counter.calls == 1U);
+
+    ls_destroy_operator(op);
+    ls_destroy_interaction(interaction);
+}
+
+TEST_CASE("NUMA placement does not change the basis", "[api]")
+{
+    unsigned T[20];
+    for (auto i = 0U; i < 20U; ++i) {
+        T[i] = (i + 1U) % 20U;
+    }
+    auto const group    = make_group({make_symmetry(std::size(T), T, 1U)});
+    auto const expected = make_spin_basis(group.get(), 20, 10, 0);
+    REQUIRE(ls_build(expected.get()) == LS_SUCCESS);
+    auto const expected_states = get_states(expected.get());
+
+    for (auto const policy : {LS_NUMA_INTERLEAVE, LS_NUMA_PARTITION}) {
+        for (auto const replicate : {false, true}) {
+            auto const basis = make_spin_basis(group.get(), 20, 10, 0);
+            REQUIRE(ls_set_numa_policy(basis.get(), policy, replicate) == LS_SUCCESS);
+            REQUIRE(ls_get_numa_policy(basis.get()) == policy);
+            REQUIRE(ls_build(basis.get()) == LS_SUCCESS);
+            auto const states = get_states(basis.get());
+            REQUIRE(ls_states_get_size(states.get()) == ls_states_get_size(expected_states.get()));
+            for (auto i = uint64_t{0}; i < ls_states_get_size(states.get()); ++i) {
+                auto const x = ls_states_get_data(states.get())[i];
+                REQUIRE(x == ls_states_get_data(expected_states.get())[i]);
+                uint64_t index;
+                REQUIRE(ls_get_index(basis.get(), x, &index) == LS_SUCCESS);
+                REQUIRE(index == i);
+            }
+        }
+    }
+    REQUIRE(ls_set_numa_policy(expected.get(), static_cast<ls_numa_policy>(7), false)
+            == LS_INVALID_ARGUMENT);
+}
+
+TEST_CASE("batched index lookup", "[api]")
+{
+    unsigned T[20];
+    for (auto i = 0U; i < 20U; ++i) {
+        T[i] = (i + 1U) % 20U;
+    }
+    auto const group = make_group({make_symmetry(std::size(T), T, 0U)});
+    for (auto const type : {LS_INDEX_DEFAULT, LS_INDEX_LIN, LS_INDEX_COMPRESSED, LS_INDEX_HASH,
+                            LS_INDEX_BTREE}) {
+        auto const basis = make_spin_basis(group.get(), 20, 10, 0);
+        REQUIRE(ls_set_index_type(basis.get(), type) == LS_SUCCESS);
+        REQUIRE(ls_build(basis.get()) == LS_SUCCESS);
+        auto const states = get_states(basis.get());
+        auto const count  = ls_states_get_size(states.get());
+
+        // Representatives interleaved with spin configurations which are not
+        auto spins = std::vector<uint64_t>{};
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            auto const x = ls_states_get_data(states.get())[i];
+            spins.push_back(x);
+            // Translation of a representative is another element of its orbit
+            spins.push_back(((x << 1U) | (x >> 19U)) & 0xFFFFFU);
+        }
+        auto indices = std::vector<uint64_t>(spins.size());
+        REQUIRE(ls_batched_get_index(basis.get(), spins.size(), spins.data(), 1, indices.data(),
+                                     1)
+                == LS_NOT_A_REPRESENTATIVE);
+        constexpr auto sentinel = ~uint64_t{0};
+        REQUIRE(ls_batched_get_index_with_sentinel(basis.get(), spins.size(), spins.data(), 1,
+                                                   indices.data(), 1, sentinel)
+                == LS_SUCCESS);
+        for (auto i = uint64_t{0}; i < spins.size(); ++i) {
+            uint64_t   index;
+            auto const status = ls_get_index(basis.get(), spins[i], &index);
+            REQUIRE((status == LS_SUCCESS || status == LS_NOT_A_REPRESENTATIVE));
+            REQUIRE(indices[i] == (status == LS_SUCCESS ? index : sentinel));
+            if (i % 2 == 0) { REQUIRE(indices[i] == i / 2); }
+        }
+
+        // Only representatives, with strides
+        REQUIRE(ls_batched_get_index(basis.get(), count, spins.data(), 2, indices.data(), 2)
+                == LS_SUCCESS);
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            REQUIRE(indices[2 * i] == i);
+        }
+    }
+}
+
+TEST_CASE("B+tree index agrees with the default one", "[api]")
+{
+    // A chain of 32 spins with 4 spins up: all 1128 representatives end up in one bucket. And an
+    // ordinary chain of 20 spins at half filling, whose representatives are split into several
+    // buckets with thousands of states each.
+    for (auto const [number_spins, hamming_weight] : {std::pair{32U, 4}, std::pair{20U, 10}}) {
+        auto T = std::vector<unsigned>(number_spins);
+        for (auto i = 0U; i < number_spins; ++i) {
+            T[i] = (i + 1U) % number_spins;
+        }
+        auto const group     = make_group({make_symmetry(T.size(), T.data(), 0U)});
+        auto const reference = make_spin_basis(group.get(), number_spins, hamming_weight, 0);
+        REQUIRE(ls_build(reference.get()) == LS_SUCCESS);
+        auto const basis = make_spin_basis(group.get(), number_spins, hamming_weight, 0);
+        REQUIRE(ls_set_index_type(basis.get(), LS_INDEX_BTREE) == LS_SUCCESS);
+        REQUIRE(ls_build(basis.get()) == LS_SUCCESS);
+
+        auto const  states = get_states(reference.get());
+        auto const  count  = ls_states_get_size(states.get());
+        auto const* data   = ls_states_get_data(states.get());
+        // bucket_tree_t::min_bucket_size is 256
+        REQUIRE(count >= 256U);
+
+        // Representatives interleaved with spin configurations which are not
+        auto const mask  = (uint64_t{1} << number_spins) - 1U;
+        auto       spins = std::vector<uint64_t>{};
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            auto const x = data[i];
+            spins.push_back(x);
+            spins.push_back(((x << 1U) | (x >> (number_spins - 1U))) & mask);
+        }
+        constexpr auto sentinel = ~uint64_t{0};
+        auto           expected = std::vector<uint64_t>(spins.size());
+        auto           indices  = std::vector<uint64_t>(spins.size());
+        REQUIRE(ls_batched_get_index_with_sentinel(reference.get(), spins.size(), spins.data(), 1,
+                                                   expected.data(), 1, sentinel)
+                == LS_SUCCESS);
+        REQUIRE(ls_batched_get_index_with_sentinel(basis.get(), spins.size(), spins.data(), 1,
+                                                   indices.data(), 1, sentinel)
+                == LS_SUCCESS);
+        REQUIRE(indices == expected);
+        for (auto i = uint64_t{0}; i < spins.size(); ++i) {
+            uint64_t   index;
+            auto const status = ls_get_index(basis.get(), spins[i], &index);
+            REQUIRE(status == (expected[i] == sentinel ? LS_NOT_A_REPRESENTATIVE : LS_SUCCESS));
+            if (status == LS_SUCCESS) { REQUIRE(index == expected[i]); }
+            if (i % 2 == 0) { REQUIRE(expected[i] == i / 2); }
+        }
+    }
+}
+
+TEST_CASE("perfect hash index agrees with the default one", "[api]")
+{
+    unsigned T[20];
+    for (auto i = 0U; i < 20U; ++i) {
+        T[i] = (i + 1U) % 20U;
+    }
+    auto const group     = make_group({make_symmetry(std::size(T), T, 0U)});
+    auto const reference = make_spin_basis(group.get(), 20, 10, 0);
+    REQUIRE(ls_build(reference.get()) == LS_SUCCESS);
+    auto const built = make_spin_basis(group.get(), 20, 10, 0);
+    REQUIRE(ls_set_index_type(built.get(), LS_INDEX_HASH) == LS_SUCCESS);
+    REQUIRE(ls_build(built.get()) == LS_SUCCESS);
+
+    // The hash is stored in the cache file and restored instead of being rebuilt
+    auto const* filename = "test_cache_hash.cache";
+    REQUIRE(ls_save_cache(built.get(), filename) == LS_SUCCESS);
+    auto const loaded = make_spin_basis(group.get(), 20, 10, 0);
+    REQUIRE(ls_set_index_type(loaded.get(), LS_INDEX_HASH) == LS_SUCCESS);
+    REQUIRE(ls_load_cache(loaded.get(), filename) == LS_SUCCESS);
+    std::remove(filename);
+
+    auto const  states = get_states(reference.get());
+    auto const  count  = ls_states_get_size(states.get());
+    auto const* data   = ls_states_get_data(states.get());
+    for (auto const* basis : {built.get(), loaded.get()}) {
+        for (auto i = uint64_t{0}; i < count; ++i) {
+            auto const x = data[i];
+            uint64_t   index;
+            REQUIRE(ls_get_index(basis, x, &index) == LS_SUCCESS);
+            REQUIRE(index == i);
+            // Translation of a representative is another element of its orbit
+            auto const y = ((x << 1U) | (x >> 19U)) & 0xFFFFFU;
+            uint64_t   expected;
+            auto const status = ls_get_index(reference.get(), y, &expected);
+            REQUIRE(ls_get_index(basis, y, &index) == status);
+            if (status == LS_SUCCESS) { REQUIRE(index == expected); }
+        }
+    }
+}
+
+TEST_CASE("merge-join lookup of sorted batches", "[api]")
+{
+    unsigned T[20];
+    for (auto i = 0U; i < 20U; ++i) {
+        T[i] = (i + 1U) % 20U;
+    }
+    auto const group = make_group({make_symmetry(std::size(T), T, 0U)});
+    for (auto const type : {LS_INDEX_DEFAULT, LS_INDEX_LIN, LS_INDEX_COMPRESSED}) {
+        auto const basis = make_spin_basis(group.get(), 20, 10, 0);
+        REQUIRE(ls_set_index_type(basis.get(), type) == LS_SUCCESS);
+        REQUIRE(ls_build(basis.get()) == LS_SUCCESS);
+        auto const  states = get_states(basis.get());
+        auto const* data   = ls_states_get_data(states.get());
+        auto const  count  = ls_states_get_size(states.get());
+
+        // Every third representative, each twice, so that some chunks start in the middle
+        auto spins = std::vector<uint64_t>{};
+        for (auto i = uint64_t{0}; i < count; i += 3U) {
+            spins.push_back(data[i]);
+            spins.push_back(data[i]);
+        }
+        auto indices = std::vector<uint64_t>(spins.size());
+        REQUIRE(ls_batched_get_index_sorted(basis.get(), spins.size(), spins.data(), 1,
+                                            indices.data(), 1)
+                == LS_SUCCESS);
+        for (auto i = uint64_t{0}; i < spins.size(); ++i) {
+            REQUIRE(indices[i] == 3U * (i / 2U));
+        }
+
+        std::swap(spins.front(), spins.back());
+        REQUIRE(ls_batched_get_index_sorted(basis.get(), spins.size(), spins.data(), 1,
+                                            indices.data(), 1)
+                == LS_INVALID_ARGUMENT);
+        std::swap(spins.front(), spins.back());
+        // Translation of a representative is not one, but is larger than it
+        spins[1] = ((spins[1] << 1U) | (spins[1] >> 19U)) & 0xFFFFFU;
+        std::sort(std::begin(spins), std::end(spins));
+        REQUIRE(ls_batched_get_index_sorted(basis.get(), spins.size(), spins.data(), 1,
+                                            indices.data(), 1)
+                == LS_NOT_A_REPRESENTATIVE);
+        constexpr auto sentinel = ~uint64_t{0};
+        REQUIRE(ls_batched_get_index_sorted_with_sentinel(basis.get(), spins.size(), spins.data(),
+                                                          1, indices.data(), 1, sentinel)
+                == LS_SUCCESS);
+        for (auto i = uint64_t{0}; i < spins.size(); ++i) {
+            uint64_t   index;
+            auto const status = ls_get_index(basis.get(), spins[i], &index);
+            REQUIRE(indices[i] == (status == LS_SUCCESS ? index : sentinel));
+        }
+    }
+}
+
+TEST_CASE("sublattice engine agrees with Benes networks", "[api]")
+{
+    // 6x4 square lattice with translations (momentum 2π/6 along x) and spin inversion
+    unsigned T_x[24];
+    unsigned T_y[24];
+    for (auto i = 0U; i < 24U; ++i) {
+        auto const x = i % 6U;
+        auto const y = i / 6U;
+        T_x[i]       = (x + 1U) % 6U + 6U * y;
+        T_y[i]       = x + 6U * ((y + 1U) % 4U);
+    }
+    auto       t_x   = make_symmetry(std::size(T_x), T_x, 1);
+    auto       t_y   = make_symmetry(std::size(T_y), T_y, 0);
+    auto const group = make_group({std::move(t_x), std::move(t_y)});
+
+    auto const benes      = make_spin_basis(group.get(), 24, 12, -1);
+    auto const sublattice = make_spin_basis(group.get(), 24, 12, -1);
+    REQUIRE(ls_set_state_info_engine(sublattice.get(), LS_STATE_INFO_SUBLATTICE) == LS_SUCCESS);
+    REQUIRE(ls_build(benes.get()) == LS_SUCCESS);
+    REQUIRE(ls_build(sublattice.get()) == LS_SUCCESS);
+
+    auto const expected = get_states(benes.get());
+    auto const states   = get_states(sublattice.get());
+    REQUIRE(ls_states_get_size(states.get()) == ls_states_get_size(expected.get()));
+    REQUIRE(std::equal(ls_states_get_data(states.get()),
+                       ls_states_get_data(states.get()) + ls_states_get_size(states.get()),
+                       ls_states_get_data(expected.get())));
+
+    // Walk through all states with Hamming weight 12, most of which are not representatives
+    for (auto x = uint64_t{0xFFF}; x < (uint64_t{1} << 24U); x += 4099U) {
+        if (lattice_symmetries::popcount(x) != 12U) { continue; }
+        ls_bits512 const     bits = {x, 0, 0, 0, 0, 0, 0, 0};
+        ls_bits512           repr_1;
+        ls_bits512           repr_2;
+        std::complex<double> character_1;
+        std::complex<double> character_2;
+        double               norm_1;
+        double               norm_2;
+        ls_get_state_info(benes.get(), &bits, &repr_1, &character_1, &norm_1);
+        ls_get_state_info(sublattice.get(), &bits, &repr_2, &character_2, &norm_2);
+        REQUIRE(repr_1.words[0] == repr_2.words[0]);
+        REQUIRE(norm_1 == Catch::Approx(norm_2));
+        if (norm_1 > 0.0) {
+            REQUIRE(character_1.real() == Catch::Approx(character_2.real()));
+            REQUIRE(character_1.imag() == Catch::Approx(character_2.imag()).margin(1e-10));
+        }
+    }
+}
+
 TEST_CASE("constructs interactions", "[api]")
 {
     {
@@ -452,3 +1433,41 @@ TEST_CASE("constructs interactions", "[api]")
         ls_destroy_interaction(interaction);
     }
 }
+
+TEST_CASE("kernel dispatch table", "[api]")
+{
+    auto const original = ls_get_kernel_arch();
+    auto const count    = ls_get_kernel_info(nullptr, 0);
+    REQUIRE(count > 0);
+    auto info = std::vector<ls_kernel_info>(count);
+    REQUIRE(ls_get_kernel_info(info.data(), count) == count);
+    REQUIRE(std::any_of(std::begin(info), std::end(info), [](auto const& i) {
+        return std::string{i.name} == "search_sorted";
+    }));
+
+    unsigned T[16];
+    for (auto i = 0U; i < 16U; ++i) {
+        T[i] = (i + 1U) % 16U;
+    }
+    auto const group     = make_group({make_symmetry(std::size(T), T, 0U)});
+    auto const reference = make_spin_basis(group.get(), 16, 8, 0);
+    REQUIRE(ls_build(reference.get()) == LS_SUCCESS);
+    auto const expected = get_states(reference.get());
+
+    // Every tier is a subset of the next one, so the baseline is always available
+    REQUIRE(ls_set_kernel_arch(LS_ARCH_SSE2) == LS_SUCCESS);
+    REQUIRE(ls_get_kernel_arch() == LS_ARCH_SSE2);
+    ls_kernel_info first;
+    ls_get_kernel_info(&first, 1);
+    REQUIRE(std::string{first.variant} == "sse2");
+    auto const basis = make_spin_basis(group.get(), 16, 8, 0);
+    REQUIRE(ls_build(basis.get()) == LS_SUCCESS);
+    auto const states = get_states(basis.get());
+    REQUIRE(ls_states_get_size(states.get()) == ls_states_get_size(expected.get()));
+    REQUIRE(std::equal(ls_states_get_data(states.get()),
+                       ls_states_get_data(states.get()) + ls_states_get_size(states.get()),
+                       ls_states_get_data(expected.get())));
+
+    REQUIRE(ls_set_kernel_arch(static_cast<ls_arch>(42)) == LS_INVALID_ARGUMENT);
+    REQUIRE(ls_set_kernel_arch(original) == LS_SUCCESS);
+}